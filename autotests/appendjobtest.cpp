@@ -21,6 +21,7 @@
 #include "kimap2test/fakeserver.h"
 #include "kimap2/session.h"
 #include "kimap2/appendjob.h"
+#include "kimap2/capabilitiesjob.h"
 
 #include <QtTest>
 #include <QDateTime>
@@ -103,6 +104,88 @@ private Q_SLOTS:
         fakeServer.quit();
     }
 
+    void testAppendNonSynchronizing_data()
+    {
+        QTest::addColumn<QByteArray>("capability");
+        QTest::addColumn<QByteArray>("content");
+        QTest::addColumn<QByteArray>("literal");
+
+        QTest::newRow("LITERAL+") << QByteArray("LITERAL+") << QByteArray("content") << QByteArray("{7+}");
+        QTest::newRow("LITERAL-") << QByteArray("LITERAL-") << QByteArray("content") << QByteArray("{7+}");
+        QTest::newRow("LITERAL- above 4096 bytes") << QByteArray("LITERAL-") << QByteArray(5000, 'x') << QByteArray("{5000}");
+        QTest::newRow("no LITERAL+") << QByteArray("IDLE") << QByteArray("content") << QByteArray("{7}");
+    }
+
+    void testAppendNonSynchronizing()
+    {
+        QFETCH(QByteArray, capability);
+        QFETCH(QByteArray, content);
+        QFETCH(QByteArray, literal);
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1 " + capability
+                               << "S: A000001 OK done"
+                               << "C: A000002 APPEND \"INBOX\" " + literal + "\r\n" + content
+                               << "S: A000002 OK APPEND completed. [ APPENDUID 492 2671 ]"
+                              );
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::CapabilitiesJob *capabilities = new KIMAP2::CapabilitiesJob(&session);
+        QVERIFY(capabilities->exec());
+
+        KIMAP2::AppendJob *job = new KIMAP2::AppendJob(&session);
+        job->setContent(content);
+        job->setMailBox(QStringLiteral("INBOX"));
+        QVERIFY(job->exec());
+        QCOMPARE(job->uid(), qint64(2671));
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void testAppendStreamed()
+    {
+        // Several chunks, and more than the socket gets to hold at a time
+        QByteArray content(1000000, 'x');
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 APPEND \"INBOX\" {1000000}\r\n" + content
+                               << "S: A000001 OK APPEND completed. [ APPENDUID 492 2671 ]"
+                               << "C: A000002 APPEND \"INBOX\" {10}\r\n0123456789"
+                               << "S: A000002 OK APPEND completed. [ APPENDUID 492 2672 ]"
+                              );
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        QBuffer device(&content);
+        QVERIFY(device.open(QIODevice::ReadOnly));
+        KIMAP2::AppendJob *job = new KIMAP2::AppendJob(&session);
+        job->setContent(&device);
+        job->setMailBox(QStringLiteral("INBOX"));
+        QVERIFY(job->exec());
+        QCOMPARE(job->uid(), qint64(2671));
+        QVERIFY(device.atEnd());
+
+        int chunks = 0;
+        job = new KIMAP2::AppendJob(&session);
+        job->setContent(10, [&chunks](qint64) {
+            // Smaller chunks than asked for
+            return QByteArray("0123456789").mid(5 * chunks++, 5);
+        });
+        job->setMailBox(QStringLiteral("INBOX"));
+        QVERIFY(job->exec());
+        QCOMPARE(job->uid(), qint64(2672));
+        QCOMPARE(chunks, 2);
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
 };
 
 QTEST_GUILESS_MAIN(AppendJobTest)
@@ -0,0 +1,145 @@
+/*
+   Copyright (c) 2026 agent <agent@local>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <qtest.h>
+
+#include "kimap2test/fakeserver.h"
+#include "kimap2/session.h"
+#include "kimap2/compressjob.h"
+#include "kimap2/capabilitiesjob.h"
+#include "kimap2/fetchjob.h"
+
+#include <QtTest>
+
+class CompressJobTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testCompress_data()
+    {
+        QTest::addColumn<QList<QByteArray> >("scenario");
+        QTest::addColumn<QStringList>("capabilities");
+        QList<QByteArray> scenario;
+        scenario << FakeServer::preauth()
+                 << "C: A000001 COMPRESS DEFLATE"
+                 << "S: A000001 OK DEFLATE active"
+                 << "Z"
+                 << "C: A000002 CAPABILITY"
+                 << "S: * CAPABILITY IMAP4rev1 COMPRESS=DEFLATE"
+                 << "S: A000002 OK CAPABILITY completed";
+
+        QStringList capabilities;
+        capabilities << QStringLiteral("IMAP4REV1") << QStringLiteral("COMPRESS=DEFLATE");
+        QTest::newRow("good") << scenario << capabilities;
+
+        // The compressed data directly follows the completion
+        scenario.clear();
+        scenario << FakeServer::preauth()
+                 << "C: A000001 COMPRESS DEFLATE"
+                 << "S: A000001 OK DEFLATE active"
+                 << "Z"
+                 << "S: * 3 EXISTS"
+                 << "C: A000002 CAPABILITY"
+                 << "S: * CAPABILITY IMAP4rev1 COMPRESS=DEFLATE"
+                 << "S: A000002 OK CAPABILITY completed";
+        QTest::newRow("unsolicited") << scenario << capabilities;
+
+        scenario.clear();
+        scenario << FakeServer::preauth()
+                 << "C: A000001 COMPRESS DEFLATE"
+                 << "S: A000001 NO compression not supported"
+                 << "C: A000002 CAPABILITY"
+                 << "S: * CAPABILITY IMAP4rev1 COMPRESS=DEFLATE"
+                 << "S: A000002 OK CAPABILITY completed";
+        QTest::newRow("no") << scenario << capabilities;
+    }
+
+    void testCompress()
+    {
+        QFETCH(QList<QByteArray>, scenario);
+        QFETCH(QStringList, capabilities);
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(scenario);
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::CompressJob *job = new KIMAP2::CompressJob(&session);
+        bool result = job->exec();
+        QEXPECT_FAIL("no" , "Expected failure on NO response", Continue);
+        QVERIFY(result);
+
+        // The session keeps working, compressed or not
+        KIMAP2::CapabilitiesJob *capabilitiesJob = new KIMAP2::CapabilitiesJob(&session);
+        QVERIFY(capabilitiesJob->exec());
+        QCOMPARE(capabilitiesJob->capabilities(), capabilities);
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void testCompressedLiterals()
+    {
+        // Large enough to span several reads
+        QByteArray content = "Subject: compressed\r\n\r\n";
+        QByteArray body;
+        for (int i = 0; i < 2000; i++) {
+            content += "compressed line " + QByteArray::number(i) + "\r\n";
+            body += "compressed line " + QByteArray::number(i) + "\n";
+        }
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 COMPRESS DEFLATE"
+                               << "S: A000001 OK DEFLATE active"
+                               << "Z"
+                               << "C: A000002 FETCH 1 (BODY.PEEK[] UID)"
+                               << "S: * 1 FETCH ( UID 10 BODY[] {" + QByteArray::number(content.size()) + "}\r\n" + content + " )"
+                               << "S: A000002 OK fetch done"
+                              );
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::CompressJob *job = new KIMAP2::CompressJob(&session);
+        QVERIFY(job->exec());
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&session);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Content;
+        fetch->setScope(scope);
+        qint64 uid = 0;
+        QByteArray receivedBody;
+        connect(fetch, &KIMAP2::FetchJob::resultReceived, [&](const KIMAP2::FetchJob::Result &result) {
+            uid = result.uid;
+            receivedBody = result.message->body();
+        });
+        QVERIFY(fetch->exec());
+        QCOMPARE(uid, qint64(10));
+        QCOMPARE(receivedBody, body);
+
+        fakeServer.quit();
+    }
+};
+
+QTEST_GUILESS_MAIN(CompressJobTest)
+
+#include "compressjobtest.moc"
@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include <qtest.h>
+
+#include "delimiterscanner_p.h"
+
+#include <QtTest>
+
+using namespace KIMAP2;
+
+Q_DECLARE_METATYPE(KIMAP2::DelimiterScanner::Implementation)
+
+class DelimiterScannerTest: public QObject
+{
+    Q_OBJECT
+
+    DelimiterScanner::Implementation m_defaultImplementation;
+
+    static const char *findFirstOf(const char *begin, const char *end, const QByteArray &delimiters)
+    {
+        const char *p = begin;
+        while (p < end && !delimiters.contains(*p)) {
+            p++;
+        }
+        return p;
+    }
+
+private Q_SLOTS:
+    void initTestCase()
+    {
+        m_defaultImplementation = DelimiterScanner::implementation();
+    }
+
+    void cleanup()
+    {
+        DelimiterScanner::setImplementation(m_defaultImplementation);
+    }
+
+    void testFindFirstOf_data()
+    {
+        QTest::addColumn<DelimiterScanner::Implementation>("implementation");
+        QTest::addColumn<QByteArray>("delimiters");
+        QTest::addColumn<int>("offset");
+
+        const int size = 100;
+        const QList<QPair<const char *, DelimiterScanner::Implementation> > implementations = {
+            {"scalar", DelimiterScanner::Scalar},
+            {"sse2", DelimiterScanner::Sse2},
+            {"avx2", DelimiterScanner::Avx2}
+        };
+        //The delimiters of the parser states, and a full set
+        const QList<QPair<const char *, QByteArray> > delimiterSets = {
+            {"quoted", "\""},
+            {"string", " ()[]\r\""},
+            {"eight", "abcdefgh"}
+        };
+        //At the start and at both sides of the 16 and 32 byte blocks, -1 for no match
+        const QList<int> offsets = {0, 15, 16, 31, 32, size - 1, -1};
+
+        for (const auto &implementation : implementations) {
+            for (const auto &delimiters : delimiterSets) {
+                for (int offset : offsets) {
+                    const QByteArray name = QByteArray(implementation.first) + ' ' + delimiters.first + ' ' +
+                                            (offset < 0 ? QByteArray("none") : QByteArray::number(offset));
+                    QTest::newRow(name.constData()) << implementation.second << delimiters.second << offset;
+                }
+            }
+        }
+    }
+
+    void testFindFirstOf()
+    {
+        QFETCH(DelimiterScanner::Implementation, implementation);
+        QFETCH(QByteArray, delimiters);
+        QFETCH(int, offset);
+
+        if (!DelimiterScanner::setImplementation(implementation)) {
+            QSKIP("Not supported by this CPU");
+        }
+        QCOMPARE(DelimiterScanner::implementation(), implementation);
+
+        //Filler that is close to the delimiters, including bytes with the high bit set
+        QByteArray buffer(100, 'x');
+        for (int i = 0; i < buffer.size(); i++) {
+            buffer[i] = (i % 3) ? char(0x80 + i) : char('i' + i % 10);
+        }
+        if (offset >= 0) {
+            buffer[offset] = delimiters.at(delimiters.size() - 1);
+            //A later match must not be found first
+            if (offset + 1 < buffer.size()) {
+                buffer[offset + 1] = delimiters.at(0);
+            }
+        }
+        const DelimiterScanner::Delimiters scannerDelimiters(delimiters.constData());
+
+        //Also from an unaligned start and with a shortened end, to cover the tails
+        for (int start = 0; start < 3; start++) {
+            for (int end = buffer.size() - 2; end <= buffer.size(); end++) {
+                const char *begin = buffer.constData() + start;
+                const char *last = buffer.constData() + end;
+                const char *expected = findFirstOf(begin, last, delimiters);
+                QCOMPARE(DelimiterScanner::findFirstOf(begin, last, scannerDelimiters) - buffer.constData(),
+                         expected - buffer.constData());
+            }
+        }
+        if (offset >= 0) {
+            QCOMPARE(DelimiterScanner::findFirstOf(buffer.constData(), buffer.constData() + buffer.size(), scannerDelimiters) - buffer.constData(),
+                     qptrdiff(offset));
+        }
+    }
+};
+
+QTEST_GUILESS_MAIN(DelimiterScannerTest)
+
+#include "delimiterscannertest.moc"
@@ -312,6 +312,231 @@ private Q_SLOTS:
         m_attrs.clear();
     }
 
+    void testFetchToDevice()
+    {
+        QByteArray body;
+        body.fill('x', 20000);
+        QByteArray part;
+        part.fill('y', 5000);
+        QByteArray header;
+        header.fill('z', 2000);
+        QList<QByteArray> scenario;
+        scenario << FakeServer::preauth()
+                 << "C: A000001 FETCH 1:3 (BODY.PEEK[] UID)"
+                 //Large literals of other items don't go to a device
+                 << "S: * 1 FETCH (UID 10 RFC822.HEADER {" + QByteArray::number(header.size()) + "}\r\n" + header + " BODY[] {" + QByteArray::number(body.size()) + "}\r\n" + body + ")"
+                 << "S: * 2 FETCH (UID 20 BODY[] {15}\r\nSubject: Hi\r\n\r\n)"
+                 << "S: * 3 FETCH (UID 30 BODY[1] {" + QByteArray::number(part.size()) + "}\r\n" + part + ")"
+                 << "S: A000001 OK fetch done";
+
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Content;
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(scenario);
+        fakeServer.startAndWait();
+
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        QByteArray streamed[2];
+        QBuffer devices[2];
+        devices[0].setBuffer(&streamed[0]);
+        devices[0].open(QIODevice::WriteOnly);
+        devices[1].setBuffer(&streamed[1]);
+        devices[1].open(QIODevice::WriteOnly);
+        QList<QPair<qint64, QByteArray> > requested;
+        QList<qint64> announcedSizes;
+
+        KIMAP2::FetchJob *job = new KIMAP2::FetchJob(&session);
+        job->setUidBased(false);
+        job->setSequenceSet(KIMAP2::ImapSet(1, 3));
+        job->setScope(scope);
+        job->setContentDevice(1000, [&](qint64 sequenceNumber, const QByteArray &partId, qint64 size) {
+            requested << qMakePair(sequenceNumber, partId);
+            announcedSizes << size;
+            return &devices[requested.size() - 1];
+        });
+
+        QMap<qint64, QMap<QByteArray, QIODevice *> > streamedParts;
+        connect(job, &FetchJob::resultReceived, this, [&](const FetchJob::Result &result) {
+            streamedParts.insert(result.sequenceNumber, result.streamedParts);
+        });
+        connect(job, &FetchJob::resultReceived, this, &FetchJobTest::onResultReceived);
+
+        bool result = job->exec();
+        QVERIFY(result);
+        QCOMPARE(m_uids.count(), 3);
+
+        //The large sections went to their devices
+        QCOMPARE(requested.size(), 2);
+        QCOMPARE(requested.at(0), qMakePair(qint64(1), QByteArray()));
+        QCOMPARE(requested.at(1), qMakePair(qint64(3), QByteArray("1")));
+        QCOMPARE(announcedSizes.at(0), qint64(body.size()));
+        QCOMPARE(announcedSizes.at(1), qint64(part.size()));
+        QCOMPARE(streamed[0], body);
+        QCOMPARE(streamed[1], part);
+        QCOMPARE(streamedParts[1].size(), 1);
+        QCOMPARE(streamedParts[1].value(QByteArray()), static_cast<QIODevice *>(&devices[0]));
+        QVERIFY(!m_messages[1]);
+        QCOMPARE(streamedParts[3].size(), 1);
+        QCOMPARE(streamedParts[3].value("1"), static_cast<QIODevice *>(&devices[1]));
+
+        //The small one was received as usual
+        QVERIFY(streamedParts[2].isEmpty());
+        QVERIFY(m_messages[2]);
+        QCOMPARE(m_messages[2]->subject()->asUnicodeString(), QStringLiteral("Hi"));
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+
+        m_signals.clear();
+        m_uids.clear();
+        m_sizes.clear();
+        m_flags.clear();
+        m_messages.clear();
+        m_parts.clear();
+        m_attrs.clear();
+    }
+
+    void testFetchToMissingDevice()
+    {
+        QByteArray body;
+        body.fill('x', 20000);
+        QList<QByteArray> scenario;
+        scenario << FakeServer::preauth()
+                 << "C: A000001 FETCH 1:2 (BODY.PEEK[] UID)"
+                 << "S: * 1 FETCH (UID 10 BODY[] {" + QByteArray::number(body.size()) + "}\r\n" + body + ")"
+                 << "S: * 2 FETCH (UID 20 BODY[] {15}\r\nSubject: Hi\r\n\r\n)"
+                 << "S: A000001 OK fetch done";
+
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Content;
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(scenario);
+        fakeServer.startAndWait();
+
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::FetchJob *job = new KIMAP2::FetchJob(&session);
+        job->setUidBased(false);
+        job->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        job->setScope(scope);
+        job->setContentDevice(1000, [](qint64, const QByteArray &, qint64) {
+            return static_cast<QIODevice *>(nullptr);
+        });
+        connect(job, &FetchJob::resultReceived, this, &FetchJobTest::onResultReceived);
+
+        //The content can't be stored anywhere, which is an error rather than silent data loss
+        bool result = job->exec();
+        QVERIFY(!result);
+        QCOMPARE(m_uids.count(), 2);
+        QVERIFY(!m_messages[1]);
+        QVERIFY(m_messages[2]);
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+
+        m_signals.clear();
+        m_uids.clear();
+        m_sizes.clear();
+        m_flags.clear();
+        m_messages.clear();
+        m_parts.clear();
+        m_attrs.clear();
+    }
+
+    void testFetchToDeviceInWorkerThread()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>() << FakeServer::preauth());
+        fakeServer.startAndWait();
+
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989, KIMAP2::Session::WorkerThreadIo);
+
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Content;
+
+        QBuffer device;
+        KIMAP2::FetchJob *job = new KIMAP2::FetchJob(&session);
+        job->setUidBased(false);
+        job->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        job->setScope(scope);
+        job->setContentDevice(1000, [&device](qint64, const QByteArray &, qint64) {
+            return &device;
+        });
+
+        //The content would end up in memory instead, so the job fails without sending the command
+        QVERIFY(!job->exec());
+        QCOMPARE(static_cast<int>(job->error()), static_cast<int>(KJob::UserDefinedError));
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void testFetchBatches()
+    {
+        QList<QByteArray> scenario;
+        scenario << FakeServer::preauth()
+                 << "C: A000001 FETCH 1:200 (FLAGS UID)";
+        //All responses in a single write, so they arrive together
+        QList<QByteArray> responses;
+        for (int i = 1; i <= 200; i++) {
+            responses << "* " + QByteArray::number(i) + " FETCH (FLAGS (\\Seen) UID " + QByteArray::number(i * 10) + ")";
+        }
+        responses << "A000001 OK fetch done";
+        scenario << "S: " + responses.join("\r\n");
+
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(scenario);
+        fakeServer.startAndWait();
+
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::FetchJob *job = new KIMAP2::FetchJob(&session);
+        job->setUidBased(false);
+        job->setSequenceSet(KIMAP2::ImapSet(1, 200));
+        job->setScope(scope);
+
+        int batches = 0;
+        QList<qint64> batchedUids;
+        connect(job, &FetchJob::resultsReceived, this, [&](const QVector<FetchJob::Result> &results) {
+            batches++;
+            for (const FetchJob::Result &result : results) {
+                batchedUids << result.uid;
+            }
+        });
+        connect(job, &FetchJob::resultReceived, this, &FetchJobTest::onResultReceived);
+
+        QVERIFY(job->exec());
+
+        //Every result is reported by both signals, in order
+        QCOMPARE(batchedUids.count(), 200);
+        QCOMPARE(m_uids.count(), 200);
+        //Responses that are parsed from the same read are delivered together
+        QVERIFY(batches > 0);
+        QVERIFY(batches < 200);
+        for (int i = 0; i < 200; i++) {
+            QCOMPARE(batchedUids.at(i), qint64((i + 1) * 10));
+            QCOMPARE(m_uids.value(i + 1), qint64((i + 1) * 10));
+            QCOMPARE(m_flags.value(i + 1), KIMAP2::MessageFlags() << "\\Seen");
+        }
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+
+        m_signals.clear();
+        m_uids.clear();
+        m_sizes.clear();
+        m_flags.clear();
+        m_messages.clear();
+        m_parts.clear();
+        m_attrs.clear();
+    }
+
 };
 
 QTEST_GUILESS_MAIN(FetchJobTest)
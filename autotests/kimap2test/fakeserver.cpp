@@ -32,6 +32,8 @@
 #include <qtest.h>
 
 #include "imapstreamparser.h"
+#include "deflatestream.h"
+#include "trafficcapture.h"
 
 QByteArray FakeServer::preauth()
 {
@@ -86,6 +88,7 @@ void FakeServer::newConnection()
     m_clientSockets << m_tcpServer->nextPendingConnection();
     connect(m_clientSockets.last(), SIGNAL(readyRead()), this, SLOT(dataAvailable()));
     m_clientParsers << new KIMAP2::ImapStreamParser(m_clientSockets.last(), true);
+    m_clientDeflaters << Q_NULLPTR;
 
     QVERIFY(m_clientSockets.size() <= m_scenarios.size());
 
@@ -115,6 +118,7 @@ void FakeServer::run()
     exec();
 
     qDeleteAll(m_clientParsers);
+    qDeleteAll(m_clientDeflaters);
     qDeleteAll(m_clientSockets);
 
     delete m_tcpServer;
@@ -160,6 +164,99 @@ void FakeServer::addScenarioFromFile(const QString &fileName)
     addScenario(scenario);
 }
 
+// Returns the end of the command starting at @p start, including its literals, or -1 if it is incomplete.
+static int commandEnd(const QByteArray &data, int start)
+{
+    int pos = start;
+    while (true) {
+        const int lineEnd = data.indexOf("\r\n", pos);
+        if (lineEnd < 0) {
+            return -1;
+        }
+        int literalSize = 0;
+        if (lineEnd > pos && data.at(lineEnd - 1) == '}') {
+            const int open = data.lastIndexOf('{', lineEnd);
+            if (open >= pos) {
+                QByteArray size = data.mid(open + 1, lineEnd - open - 2);
+                if (size.endsWith('+')) {
+                    size.chop(1);
+                }
+                literalSize = size.toInt();
+            }
+        }
+        if (!literalSize) {
+            return lineEnd;
+        }
+        pos = lineEnd + 2 + literalSize;
+        if (pos > data.size()) {
+            return -1;
+        }
+    }
+}
+
+void FakeServer::addScenarioFromCapture(const QString &fileName)
+{
+    QVector<KIMAP2::TrafficCapture::Record> records;
+    QVERIFY(KIMAP2::TrafficCapture::read(fileName, records));
+
+    QList<QByteArray> scenario;
+    QByteArray clientData;
+    int commandStart = 0;
+    QByteArray serverData;
+    QByteArray compressTag;
+    QScopedPointer<KIMAP2::DeflateStream> clientInflater;
+    QScopedPointer<KIMAP2::DeflateStream> serverInflater;
+
+    foreach (const KIMAP2::TrafficCapture::Record &record, records) {
+        if (record.direction == KIMAP2::TrafficCapture::Sent) {
+            clientData += clientInflater ? clientInflater->process(record.data) : record.data;
+            int end;
+            while ((end = commandEnd(clientData, commandStart)) >= 0) {
+                const QByteArray command = clientData.mid(commandStart, end - commandStart);
+                scenario << "C: " + command.trimmed();
+                const QList<QByteArray> words = command.split(' ');
+                if (words.size() >= 2 && words.at(1).toUpper() == "COMPRESS") {
+                    compressTag = words.at(0);
+                }
+                commandStart = end + 2;
+            }
+            continue;
+        }
+
+        // The server compresses everything after its OK for COMPRESS, which may be part of the same read
+        QByteArray data = record.data;
+        while (!data.isEmpty()) {
+            serverData += serverInflater ? serverInflater->process(data) : data;
+            data.clear();
+            int lineEnd;
+            while ((lineEnd = serverData.indexOf("\r\n")) >= 0) {
+                const QByteArray line = serverData.left(lineEnd);
+                serverData.remove(0, lineEnd + 2);
+                // The fake server sends its own continuation requests for literals
+                const bool waitingForLiteral = clientData.endsWith("}\r\n") && commandStart < clientData.size();
+                if (line.startsWith('+') && waitingForLiteral) {
+                    continue;
+                }
+                scenario << "S: " + line;
+                if (!compressTag.isEmpty() && line.startsWith(compressTag + ' ')) {
+                    const bool compressed = line.mid(compressTag.size() + 1).startsWith("OK");
+                    compressTag.clear();
+                    if (compressed) {
+                        scenario << "Z";
+                        clientInflater.reset(new KIMAP2::DeflateStream(KIMAP2::DeflateStream::Decompress));
+                        serverInflater.reset(new KIMAP2::DeflateStream(KIMAP2::DeflateStream::Decompress));
+                        data = serverData;
+                        serverData.clear();
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    addScenario(scenario);
+}
+
 bool FakeServer::isScenarioDone(int scenarioNumber) const
 {
     QMutexLocker locker(&m_mutex);
@@ -190,12 +287,15 @@ void FakeServer::writeServerPart(int scenarioNumber)
     QTcpSocket *clientSocket = m_clientSockets[scenarioNumber];
 
     while (!scenario.isEmpty() &&
-            (scenario.first().startsWith("S: ") || scenario.first().startsWith("W: "))) {
+            (scenario.first().startsWith("S: ") || scenario.first().startsWith("W: ") || scenario.first().startsWith("Z"))) {
         QByteArray rule = scenario.takeFirst();
 
         if (rule.startsWith("S: ")) {
             QByteArray payload = rule.mid(3);
-            clientSocket->write(payload + "\r\n");
+            writeToClient(scenarioNumber, payload + "\r\n");
+        } else if (rule.startsWith("Z")) {
+            m_clientDeflaters[scenarioNumber] = new KIMAP2::DeflateStream(KIMAP2::DeflateStream::Compress);
+            m_clientParsers[scenarioNumber]->startCompression();
         } else {
             int timeout = rule.mid(3).toInt();
             QTest::qWait(timeout);
@@ -215,6 +315,16 @@ void FakeServer::writeServerPart(int scenarioNumber)
     m_scenarios[scenarioNumber] = scenario;
 }
 
+void FakeServer::writeToClient(int scenarioNumber, const QByteArray &data)
+{
+    QTcpSocket *clientSocket = m_clientSockets[scenarioNumber];
+    if (KIMAP2::DeflateStream *deflater = m_clientDeflaters[scenarioNumber]) {
+        clientSocket->write(deflater->process(data));
+    } else {
+        clientSocket->write(data);
+    }
+}
+
 void FakeServer::compareReceived(const QByteArray &received, const QByteArray &expected) const
 {
     QCOMPARE(QString::fromUtf8(received), QString::fromUtf8(expected));
@@ -31,6 +31,7 @@
 namespace KIMAP2
 {
 class ImapStreamParser;
+class DeflateStream;
 }
 
 Q_DECLARE_METATYPE(QList<QByteArray>)
@@ -74,6 +75,18 @@ Q_DECLARE_METATYPE(QList<QByteArray>)
  * X
  * @endcode
  *
+ * A line starting with Z indicates that the server compresses the
+ * connection from there on, as negotiated by the COMPRESS=DEFLATE
+ * extension.  Server responses that follow it are sent compressed
+ * and the client is expected to compress its commands as well:
+ * @code
+ * C: A000001 COMPRESS DEFLATE
+ * S: A000001 OK DEFLATE active
+ * Z
+ * C: A000002 NOOP
+ * S: A000002 OK NOOP completed
+ * @endcode
+ *
  * FakeServer::preauth() and FakeServer::greeting() provide standard
  * PREAUTH and OK responses, respectively, that can be used (unmodified)
  * as the first line of a scenario.
@@ -193,6 +206,21 @@ public:
      */
     void addScenarioFromFile(const QString &fileName);
 
+    /**
+     * Adds a new scenario from a traffic capture of a real session
+     *
+     * The captured commands become the client parts and the captured
+     * responses the server parts, in the order they were recorded.
+     * A compressed connection is decompressed, and compressed again
+     * when the scenario is played. The continuation requests for
+     * literals are left out, since the fake server sends its own.
+     *
+     * @see KIMAP2::TrafficCapture, KIMAP2_CAPTURE
+     *
+     * @param fileName  the name of the capture file
+     */
+    void addScenarioFromCapture(const QString &fileName);
+
     /**
      * Checks whether a particular scenario has completed
      *
@@ -221,12 +249,15 @@ private Q_SLOTS:
 private:
     void writeServerPart(int scenarioNumber);
     void readClientPart(int scenarioNumber);
+    void writeToClient(int scenarioNumber, const QByteArray &data);
 
     QList< QList<QByteArray> > m_scenarios;
     QTcpServer *m_tcpServer;
     mutable QMutex m_mutex;
     QList<QTcpSocket *> m_clientSockets;
     QList<KIMAP2::ImapStreamParser *> m_clientParsers;
+    //Null until the connection is compressed
+    QList<KIMAP2::DeflateStream *> m_clientDeflaters;
     bool m_encrypted;
     bool m_starttls;
     bool m_receivedStarttls;
@@ -73,6 +73,9 @@ void SslServer::incomingConnection(qintptr handle)
 {
     QSslSocket *socket = new QSslSocket();
     socket->setSocketDescriptor(handle);
+    if (!mSharedConfiguration.isNull()) {
+        socket->setSslConfiguration(mSharedConfiguration);
+    }
 
     socket->setProtocol(mProtocol);
 
@@ -89,6 +92,7 @@ void SslServer::incomingConnection(qintptr handle)
     socket->ignoreSslErrors();
     connect(socket, SIGNAL(sslErrors(QList<QSslError>)), this, SLOT(sslErrors(QList<QSslError>)));
     connect(socket, SIGNAL(error(QAbstractSocket::SocketError)), this, SLOT(error(QAbstractSocket::SocketError)));
+    connect(socket, SIGNAL(encrypted()), this, SLOT(encrypted()));
     if (!mStartTls) {
         socket->startServerEncryption();
     }
@@ -114,3 +118,11 @@ void SslServer::error(QAbstractSocket::SocketError error)
     }
     qWarning() << error;
 }
+
+void SslServer::encrypted()
+{
+    QSslSocket *socket = qobject_cast<QSslSocket *>(QObject::sender());
+    if (socket && mSharedConfiguration.isNull()) {
+        mSharedConfiguration = socket->sslConfiguration();
+    }
+}
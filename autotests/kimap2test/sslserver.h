@@ -20,6 +20,7 @@
 #define SSLSERVER_H
 
 #include <QTcpServer>
+#include <QSslConfiguration>
 #include <QSslSocket>
 
 class SslServer: public QTcpServer
@@ -32,11 +33,14 @@ public:
 private Q_SLOTS:
     void sslErrors(const QList<QSslError> &errors);
     void error(QAbstractSocket::SocketError);
+    void encrypted();
 
 private:
     QSsl::SslProtocol mProtocol;
     QSslSocket mSocket;
     const bool mStartTls;
+    //Shares the context of the first connection with the later ones, so they can resume its TLS session
+    QSslConfiguration mSharedConfiguration;
 };
 
 #endif
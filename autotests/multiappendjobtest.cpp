@@ -0,0 +1,153 @@
+/*
+   Copyright (C) 2026 agent <agent@local>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <qtest.h>
+
+#include "kimap2test/fakeserver.h"
+#include "kimap2/session.h"
+#include "kimap2/capabilitiesjob.h"
+#include "kimap2/multiappendjob.h"
+
+#include <QtTest>
+
+class MultiAppendJobTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void testMultiAppend_data()
+    {
+        QTest::addColumn<QByteArray>("capabilities");
+        QTest::addColumn<QList<QByteArray> >("scenario");
+        QTest::addColumn<bool>("result");
+        QTest::addColumn<QList<QByteArray> >("uids");
+        QTest::addColumn<qint64>("appendedCount");
+
+        QTest::newRow("MULTIAPPEND") << QByteArray("MULTIAPPEND LITERAL+ UIDPLUS")
+                                     << (QList<QByteArray>()
+                                         << "C: A000002 APPEND \"INBOX\" {3+}\r\none {3+}\r\ntwo"
+                                         << "S: A000002 OK [APPENDUID 1234 10:11] done"
+                                         << "C: A000003 APPEND \"INBOX\" (\\Seen) {5+}\r\nthree"
+                                         << "S: A000003 OK [APPENDUID 1234 12] done")
+                                     << true
+                                     << (QList<QByteArray>() << "10:11" << "12")
+                                     << qint64(3);
+
+        QTest::newRow("MULTIAPPEND with synchronizing literals") << QByteArray("MULTIAPPEND UIDPLUS")
+                << (QList<QByteArray>()
+                    << "C: A000002 APPEND \"INBOX\" {3}\r\none {3}\r\ntwo"
+                    << "S: A000002 OK [APPENDUID 1234 10:11] done"
+                    << "C: A000003 APPEND \"INBOX\" (\\Seen) {5}\r\nthree"
+                    << "S: A000003 OK [APPENDUID 1234 12] done")
+                << true
+                << (QList<QByteArray>() << "10:11" << "12")
+                << qint64(3);
+
+        // Without MULTIAPPEND the commands of a batch go out without waiting for each other
+        QTest::newRow("single APPENDs") << QByteArray("LITERAL+ UIDPLUS")
+                                        << (QList<QByteArray>()
+                                            << "C: A000002 APPEND \"INBOX\" {3+}\r\none"
+                                            << "C: A000003 APPEND \"INBOX\" {3+}\r\ntwo"
+                                            << "S: A000002 OK [APPENDUID 1234 10] done"
+                                            << "S: A000003 OK [APPENDUID 1234 11] done"
+                                            << "C: A000004 APPEND \"INBOX\" (\\Seen) {5+}\r\nthree"
+                                            << "S: A000004 OK [APPENDUID 1234 12] done")
+                                        << true
+                                        << (QList<QByteArray>() << "10:11" << "12")
+                                        << qint64(3);
+
+        // The messages whose commands succeeded are appended even if another one of the batch failed
+        QTest::newRow("failed single APPEND") << QByteArray("LITERAL+ UIDPLUS")
+                                              << (QList<QByteArray>()
+                                                  << "C: A000002 APPEND \"INBOX\" {3+}\r\none"
+                                                  << "C: A000003 APPEND \"INBOX\" {3+}\r\ntwo"
+                                                  << "S: A000002 NO [OVERQUOTA] too large"
+                                                  << "S: A000003 OK [APPENDUID 1234 11] done")
+                                              << false
+                                              << (QList<QByteArray>() << "11")
+                                              << qint64(1);
+
+        QTest::newRow("failed batch") << QByteArray("MULTIAPPEND LITERAL+")
+                                      << (QList<QByteArray>()
+                                          << "C: A000002 APPEND \"INBOX\" {3+}\r\none {3+}\r\ntwo"
+                                          << "S: A000002 NO [TRYCREATE] no such mailbox")
+                                      << false
+                                      << QList<QByteArray>()
+                                      << qint64(0);
+    }
+
+    void testMultiAppend()
+    {
+        QFETCH(QByteArray, capabilities);
+        QFETCH(QList<QByteArray>, scenario);
+        QFETCH(bool, result);
+        QFETCH(QList<QByteArray>, uids);
+        QFETCH(qint64, appendedCount);
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1 " + capabilities
+                               << "S: A000001 OK done"
+                               << scenario);
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::CapabilitiesJob *capabilitiesJob = new KIMAP2::CapabilitiesJob(&session);
+        QVERIFY(capabilitiesJob->exec());
+
+        KIMAP2::MultiAppendJob *job = new KIMAP2::MultiAppendJob(&session);
+        job->setMailBox(QStringLiteral("INBOX"));
+        job->setBatchLimits(2, 1024);
+        job->addMessage("one");
+        int sourced = 0;
+        job->setMessageSource([&](KIMAP2::MultiAppendJob::Item &item) {
+            if (sourced == 2) {
+                return false;
+            }
+            sourced++;
+            item.content = (sourced == 1) ? "two" : "three";
+            if (sourced == 2) {
+                item.flags << "\\Seen";
+            }
+            return true;
+        });
+        qRegisterMetaType<KIMAP2::ImapSet>();
+        QSignalSpy batchSpy(job, SIGNAL(batchAppended(KIMAP2::ImapSet,int)));
+
+        QCOMPARE(job->exec(), result);
+        QCOMPARE(job->uids().size(), uids.size());
+        for (int i = 0; i < uids.size(); i++) {
+            QCOMPARE(job->uids().at(i).toImapSequenceSet(), uids.at(i));
+        }
+        QCOMPARE(batchSpy.count(), uids.size());
+        QCOMPARE(job->appendedCount(), appendedCount);
+        if (appendedCount) {
+            QCOMPARE(job->uidValidity(), qint64(1234));
+        }
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+};
+
+QTEST_GUILESS_MAIN(MultiAppendJobTest)
+
+#include "multiappendjobtest.moc"
@@ -0,0 +1,131 @@
+/*
+   Copyright (c) 2026 agent <agent@local>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <qtest.h>
+
+#include "kimap2test/fakeserver.h"
+#include "kimap2/session.h"
+#include "kimap2/sessionpool.h"
+#include "kimap2/capabilitiesjob.h"
+#include "kimap2/loginjob.h"
+
+#include <QtTest>
+
+class SessionPoolTest: public QObject
+{
+    Q_OBJECT
+
+private Q_SLOTS:
+
+    void shouldKeepMailBoxSelected()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 SELECT \"INBOX\""
+                               << "S: A000001 OK [READ-WRITE] SELECT completed"
+                               << "C: A000002 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1"
+                               << "S: A000002 OK CAPABILITY completed"
+                               << "C: A000003 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1"
+                               << "S: A000003 OK CAPABILITY completed"
+                               << "C: A000004 SELECT \"Archive\""
+                               << "S: A000004 OK [READ-WRITE] SELECT completed"
+                               << "C: A000005 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1"
+                               << "S: A000005 OK CAPABILITY completed"
+                              );
+        fakeServer.startAndWait();
+
+        KIMAP2::SessionPool pool(QStringLiteral("127.0.0.1"), 5989, 1, [](KIMAP2::LoginJob *) {});
+        QSignalSpy queueSpy(&pool, SIGNAL(queueSizeChanged(int)));
+
+        int done = 0;
+        auto createJob = [&done](KIMAP2::Session *session) {
+            auto job = new KIMAP2::CapabilitiesJob(session);
+            QObject::connect(job, &KJob::result, [&done](KJob *job) {
+                QVERIFY(!job->error());
+                done++;
+            });
+            return job;
+        };
+        pool.enqueue(QStringLiteral("INBOX"), createJob);
+        pool.enqueue(QStringLiteral("INBOX"), createJob);
+        pool.enqueue(QStringLiteral("Archive"), createJob);
+        QCOMPARE(pool.queueSize(), 3);
+
+        QTRY_COMPARE(done, 3);
+        QCOMPARE(pool.queueSize(), 0);
+        QCOMPARE(queueSpy.last().at(0).toInt(), 0);
+        QCOMPARE(pool.sessionCount(), 1);
+        QCOMPARE(pool.busySessionCount(), 0);
+        QCOMPARE(pool.utilization(), qreal(0));
+        QVERIFY(fakeServer.isAllScenarioDone());
+
+        fakeServer.quit();
+    }
+
+    void shouldReplaceFailedSessions()
+    {
+        FakeServer fakeServer;
+        fakeServer.addScenario(QList<QByteArray>()
+                               << FakeServer::greeting()
+                               << "C: A000001 CAPABILITY"
+                               << "S: A000001 OK"
+                               << "C: A000002 LOGIN \"user\" \"password\""
+                               << "S: A000002 NO Login failed: try again later"
+                              );
+        fakeServer.addScenario(QList<QByteArray>()
+                               << FakeServer::greeting()
+                               << "C: A000001 CAPABILITY"
+                               << "S: A000001 OK"
+                               << "C: A000002 LOGIN \"user\" \"password\""
+                               << "S: A000002 OK User logged in"
+                               << "C: A000003 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1"
+                               << "S: A000003 OK CAPABILITY completed"
+                              );
+        fakeServer.startAndWait();
+
+        KIMAP2::SessionPool pool(QStringLiteral("127.0.0.1"), 5989, 1, [](KIMAP2::LoginJob *login) {
+            login->setUserName(QStringLiteral("user"));
+            login->setPassword(QStringLiteral("password"));
+        });
+        pool.setReconnectInterval(100);
+
+        QStringList capabilities;
+        pool.enqueue(QString(), [&capabilities](KIMAP2::Session *session) {
+            auto job = new KIMAP2::CapabilitiesJob(session);
+            QObject::connect(job, &KIMAP2::CapabilitiesJob::capabilitiesReceived, [&capabilities](const QStringList &received) {
+                capabilities = received;
+            });
+            return job;
+        });
+
+        QTRY_COMPARE(capabilities, QStringList() << QStringLiteral("IMAP4REV1"));
+        QCOMPARE(pool.sessionCount(), 1);
+        QVERIFY(fakeServer.isAllScenarioDone());
+
+        fakeServer.quit();
+    }
+};
+
+QTEST_GUILESS_MAIN(SessionPoolTest)
+
+#include "sessionpooltest.moc"
@@ -21,6 +21,7 @@
 #include "kimap2test/fakeserver.h"
 #include "kimap2/session.h"
 #include "kimap2/setmetadatajob.h"
+#include "kimap2/capabilitiesjob.h"
 
 #include <QtTest>
 
@@ -114,6 +115,51 @@ private Q_SLOTS:
         fakeServer.quit();
     }
 
+    void testSetMetaDataNonSynchronizing_data()
+    {
+        QTest::addColumn<QByteArray>("capability");
+        QTest::addColumn<QByteArray>("value");
+        QTest::addColumn<QByteArray>("literal");
+
+        QTest::newRow("LITERAL+") << QByteArray("LITERAL+") << QByteArray("comment\ntest") << QByteArray("{12+}");
+        QTest::newRow("LITERAL-") << QByteArray("LITERAL-") << QByteArray("comment\ntest") << QByteArray("{12+}");
+        QTest::newRow("LITERAL- above 4096 bytes") << QByteArray("LITERAL-") << QByteArray("\n" + QByteArray(4999, 'x')) << QByteArray("{5000}");
+        QTest::newRow("no LITERAL+") << QByteArray("IDLE") << QByteArray("comment\ntest") << QByteArray("{12}");
+    }
+
+    void testSetMetaDataNonSynchronizing()
+    {
+        QFETCH(QByteArray, capability);
+        QFETCH(QByteArray, value);
+        QFETCH(QByteArray, literal);
+
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1 METADATA " + capability
+                               << "S: A000001 OK done"
+                               << "C: A000002 SETMETADATA \"Folder1\" (\"/shared/comment\" " + literal + "\r\n" + value + ")"
+                               //A continuation the job doesn't wait for must not be taken for one
+                               << "S: + go ahead"
+                               << "S: A000002 OK SETMETADATA complete"
+                              );
+        fakeServer.startAndWait();
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+
+        KIMAP2::CapabilitiesJob *capabilities = new KIMAP2::CapabilitiesJob(&session);
+        QVERIFY(capabilities->exec());
+
+        KIMAP2::SetMetaDataJob *setMetadataJob = new KIMAP2::SetMetaDataJob(&session);
+        setMetadataJob->setServerCapability(KIMAP2::MetaDataJobBase::Metadata);
+        setMetadataJob->setMailBox(QStringLiteral("Folder1"));
+        setMetadataJob->addMetaData("/shared/comment", value);
+        QVERIFY(setMetadataJob->exec());
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
     void annotatemore_data()
     {
         QTest::addColumn<QList<QByteArray> >("scenario");
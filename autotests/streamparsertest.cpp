@@ -376,6 +376,396 @@ private Q_SLOTS:
         QVERIFY(!parser.error());
     }
 
+    //A '}' in literal data must not be mistaken for the end of a literal header
+    void testLiteralContainingBrace()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        bool gotResponse = false;
+        Message message;
+        parser.onResponseReceived([this, &gotResponse, &message](const Message &response) {
+            gotResponse = true;
+            printResponse(response);
+            message = response;
+        });
+
+        //The first byte of the literal is a '}'
+        QVERIFY(socket.write("* 11 FETCH (UID 123 BODY[] {10}\r\n}abc") != -1);
+        parser.parseStream();
+        QVERIFY(!gotResponse);
+        //The first byte of the next read is a '}', still inside the literal
+        QVERIFY(socket.write("}defgh FLAGS ())\r\n") != -1);
+        parser.parseStream();
+
+        QList<QByteArray> expectedList;
+        expectedList << "UID";
+        expectedList << "123";
+        expectedList << "BODY[]";
+        expectedList << "}abc}defgh";
+        expectedList << "FLAGS";
+        expectedList << "()";
+
+        QVERIFY(gotResponse);
+        QCOMPARE(message.content.last().toList(), expectedList);
+        QVERIFY(parser.availableDataSize() == 0);
+        QVERIFY(!parser.error());
+    }
+
+    void testStreamLargeLiteral()
+    {
+        const auto payloadSize = 64000;
+        QByteArray payload;
+        payload.fill('c', payloadSize);
+        const auto data = QString("* 11 FETCH (UID 123 BODY[] {%1}\r\n").arg(payloadSize).toLatin1() + payload + " BODY[1] {5}\r\nsmall FLAGS ())\r\n";
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write(data) != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        QByteArray streamed;
+        qint64 announcedSize = 0;
+        QByteArray announcedItem;
+        parser.setLiteralSink(1000, [&](const Message &response, const QByteArray &item, qint64 size) {
+            QCOMPARE(response.content.size(), 3);
+            QCOMPARE(response.content.at(2).toString(), QByteArray("FETCH"));
+            announcedItem = item;
+            announcedSize = size;
+            return [&](const char *data, int size) {
+                QVERIFY(size <= payloadSize);
+                streamed.append(data, size);
+            };
+        });
+
+        bool gotResponse = false;
+        Message message;
+        parser.onResponseReceived([&](const Message &response) {
+            gotResponse = true;
+            message = response;
+        });
+        parser.parseStream();
+        QVERIFY(gotResponse);
+        QCOMPARE(announcedItem, QByteArray("BODY[]"));
+        QCOMPARE(announcedSize, qint64(payloadSize));
+        QCOMPARE(streamed, payload);
+
+        const QList<QByteArray> list = message.content.last().toList();
+        QCOMPARE(list.size(), 8);
+        QCOMPARE(list.at(2), QByteArray("BODY[]"));
+        QVERIFY(list.at(3).isNull());
+        //Small literals are still collected in the message
+        QCOMPARE(list.at(5), QByteArray("small"));
+        QVERIFY(parser.availableDataSize() == 0);
+        QVERIFY(!parser.error());
+    }
+
+    //A single token that doesn't fit into the initial buffer
+    void testParseLargeToken()
+    {
+        QByteArray labels;
+        for (int i = 0; i < 5000; i++) {
+            if (i) {
+                labels += ' ';
+            }
+            labels += "\\Label" + QByteArray::number(i);
+        }
+        QByteArray data = "* 1 FETCH (X-GM-LABELS (" + labels + ") UID 1)\r\n";
+        for (int i = 0; i < 2000; i++) {
+            data += "* " + QByteArray::number(i + 2) + " FETCH (FLAGS (\\Seen) UID 1)\r\n";
+        }
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write(data) != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+        const int initialBufferSize = parser.bufferSize();
+        QVERIFY(labels.size() > initialBufferSize);
+
+        int responseCount = 0;
+        int maxBufferSize = 0;
+        QList<QByteArray> firstList;
+        parser.onResponseReceived([&](const Message &response) {
+            if (!responseCount) {
+                firstList = response.content.last().toList();
+            }
+            responseCount++;
+            maxBufferSize = qMax(maxBufferSize, parser.bufferSize());
+        });
+        while (parser.availableDataSize()) {
+            parser.parseStream();
+        }
+        QCOMPARE(responseCount, 2001);
+        QCOMPARE(firstList.size(), 4);
+        QCOMPARE(firstList.at(1), "(" + labels + ")");
+        QVERIFY(!parser.error());
+
+        //The buffer grew for the large token and shrunk back afterwards
+        QVERIFY(maxBufferSize > initialBufferSize);
+        QCOMPARE(parser.bufferSize(), initialBufferSize);
+        QVERIFY(parser.trimCount() > 0);
+        QVERIFY(parser.trimmedBytes() > 0);
+        //Growing keeps the copying overhead linear in the token size
+        QVERIFY(parser.trimmedBytes() < 2 * labels.size());
+    }
+
+    void testTokenEvents()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write("* OK [PERMANENTFLAGS (\\Seen)] Ok\r\n* 1 FETCH (FLAGS (\\Seen) BODY[] {5}\r\nhello)\r\n") != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        QList<QByteArray> events;
+        parser.onString([&](const char *data, int size) {
+            events << QByteArray(data, size);
+        });
+        parser.onListStart([&]() {
+            events << "<list>";
+        });
+        parser.onListEnd([&]() {
+            events << "</list>";
+        });
+        parser.onResponseCodeStart([&]() {
+            events << "<code>";
+        });
+        parser.onResponseCodeEnd([&]() {
+            events << "</code>";
+        });
+        parser.onLiteralStart([&](qint64 size) {
+            events << "<literal " + QByteArray::number(size) + ">";
+        });
+        parser.onLiteralPart([&](const char *data, int size) {
+            events << QByteArray(data, size);
+        });
+        parser.onLiteralEnd([&]() {
+            events << "</literal>";
+        });
+        parser.onLineEnd([&]() {
+            events << "<end>";
+        });
+        parser.parseStream();
+
+        QList<QByteArray> expected;
+        expected << "*" << "OK" << "<code>" << "PERMANENTFLAGS" << "<list>" << "\\Seen" << "</list>" << "</code>" << "Ok" << "<end>";
+        expected << "*" << "1" << "FETCH" << "<list>" << "FLAGS" << "<list>" << "\\Seen" << "</list>" << "BODY[]" << "<literal 5>" << "hello" << "</literal>" << "</list>" << "<end>";
+        QCOMPARE(events, expected);
+        QVERIFY(parser.availableDataSize() == 0);
+        QVERIFY(!parser.error());
+    }
+
+    void testNestedLists()
+    {
+        const QByteArray structure = "((\"TEXT\" \"PLAIN\" (\"NAME\" \"a(b\") NIL NIL \"7BIT\" 72 4 NIL NIL NIL)(\"IMAGE\" \"JPEG\" NIL NIL NIL \"BASE64\" 53338 NIL (\"ATTACHMENT\" (\"FILENAME\" {9}\r\nphoto.jpg)) NIL) \"MIXED\" (\"BOUNDARY\" \"0003\") NIL NIL)";
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write("* 2 FETCH (UID 20 BODYSTRUCTURE " + structure + ")\r\n") != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        bool gotResponse = false;
+        Message message;
+        parser.onResponseReceived([&](const Message &response) {
+            gotResponse = true;
+            message = response;
+        });
+        parser.parseStream();
+        QVERIFY(gotResponse);
+        QVERIFY(!parser.error());
+
+        const Message::PartRange items = message.content.last().children();
+        QCOMPARE(items.size(), 4);
+        QCOMPARE(items.at(3).type(), Message::Part::List);
+        //Nested lists still provide their text
+        QCOMPARE(items.at(3).toString(), structure);
+        QCOMPARE(message.content.last().toList().last(), structure);
+
+        const Message::PartRange parts = items.at(3).children();
+        QCOMPARE(parts.size(), 6);
+        QCOMPARE(parts.at(0).children().size(), 11);
+        QCOMPARE(parts.at(0).children().at(2).children().at(1).toString(), QByteArray("a(b"));
+        QCOMPARE(parts.at(1).children().at(8).children().at(1).children().at(1).toString(), QByteArray("photo.jpg"));
+        QCOMPARE(parts.at(2).toString(), QByteArray("MIXED"));
+        QCOMPARE(parts.at(3).children().at(1).toString(), QByteArray("0003"));
+        //So do the lists nested deeper
+        QCOMPARE(parts.at(1).children().at(8).toString(), QByteArray("(\"ATTACHMENT\" (\"FILENAME\" {9}\r\nphoto.jpg))"));
+        QCOMPARE(parts.at(3).toString(), QByteArray("(\"BOUNDARY\" \"0003\")"));
+    }
+
+    void testMessageStorageReuse()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write("* 1 FETCH (FLAGS (\\Seen a) UID 1)\r\n") != -1);
+        QVERIFY(socket.write("* 2 FETCH (FLAGS (b (c d)) UID 2)\r\n") != -1);
+        QVERIFY(socket.write("* 3 FETCH (FLAGS (e) UID 3)\r\n") != -1);
+        QVERIFY(socket.write("* 4 FETCH (FLAGS (f) UID 4)\r\n") != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        QList<const Message::Arena *> arenas;
+        Message kept;
+        parser.onResponseReceived([&](const Message &response) {
+            arenas << response.arena.data();
+            if (arenas.size() == 2) {
+                kept = response;
+            }
+        });
+        parser.parseStream();
+        QVERIFY(!parser.error());
+        QCOMPARE(arenas.size(), 4);
+
+        //Storage is reused unless a consumer keeps the message
+        QCOMPARE(arenas.at(1), arenas.at(0));
+        QVERIFY(arenas.at(2) != arenas.at(1));
+        QCOMPARE(arenas.at(3), arenas.at(2));
+
+        QCOMPARE(kept.content.last().children().at(1).children().at(1).children().at(1).toString(), QByteArray("d"));
+        kept.detach();
+        QCOMPARE(kept.content.last().children().at(1).children().at(0).toString(), QByteArray("b"));
+    }
+
+    //A list refers to the storage of its message, so a part that is kept needs the message as well
+    void testPartKeptAcrossResponses()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write("* 1 FETCH (FLAGS (a (b c)) UID 1)\r\n") != -1);
+        QVERIFY(socket.write("* 2 FETCH (FLAGS (d (e f)) UID 2)\r\n") != -1);
+        QVERIFY(socket.write("* 3 FETCH (FLAGS (g (h i)) UID 3)\r\n") != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        int count = 0;
+        Message kept;
+        Message::Part flags(QByteArray{});
+        parser.onResponseReceived([&](const Message &response) {
+            if (++count == 1) {
+                kept = response;
+                flags = response.content.last().children().at(1);
+            }
+        });
+        parser.parseStream();
+        QVERIFY(!parser.error());
+        QCOMPARE(count, 3);
+
+        QCOMPARE(flags.type(), Message::Part::List);
+        QCOMPARE(flags.children().size(), 2);
+        QCOMPARE(flags.children().at(0).toString(), QByteArray("a"));
+        QCOMPARE(flags.children().at(1).children().at(1).toString(), QByteArray("c"));
+    }
+
+    //Delivered responses must not keep the receive buffer alive, or it is reallocated on every trim
+    void testZeroCopyTrimReusesBuffer()
+    {
+        //The nested lists of the first response are not opened again by the ones that follow
+        QByteArray buffer = "* 1 FETCH (FLAGS (\\Seen (a b)) UID 1)\r\n";
+        for (int i = 2; i <= 3000; i++) {
+            buffer += "* " + QByteArray::number(i) + " FETCH (UID " + QByteArray::number(i) + ")\r\n";
+        }
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+        parser.setZeroCopyEnabled(true);
+
+        int count = 0;
+        parser.onResponseReceived([&count](const Message &) {
+            count++;
+        });
+        while (parser.availableDataSize()) {
+            parser.parseStream();
+        }
+        QVERIFY(!parser.error());
+        QCOMPARE(count, 3000);
+        QVERIFY(parser.trimCount() > 2);
+        QCOMPARE(parser.bufferAllocations(), 0);
+    }
+
+    void testBatchDelivery()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+        QVERIFY(socket.write("* 1 FETCH (UID 10)\r\n") != -1);
+        QVERIFY(socket.write("* 2 FETCH (UID 20)\r\n") != -1);
+        QVERIFY(socket.write("A000001 OK fetch done\r\n") != -1);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket);
+
+        QList<int> batchSizes;
+        QList<QByteArray> tags;
+        parser.onResponsesReceived([&](const MessageRange &responses) {
+            batchSizes << responses.size();
+            for (const Message &response : responses) {
+                tags << response.content.first().toString();
+            }
+        });
+        parser.parseStream();
+        QVERIFY(!parser.error());
+
+        //Everything was read at once, so it arrives in one batch
+        QCOMPARE(batchSizes, QList<int>() << 3);
+        QCOMPARE(tags, QList<QByteArray>() << "*" << "*" << "A000001");
+    }
+
+    void testServerModeCommands()
+    {
+        QByteArray buffer;
+        QBuffer socket(&buffer);
+        socket.open(QBuffer::WriteOnly);
+
+        QBuffer readSocket(&buffer);
+        readSocket.open(QBuffer::ReadOnly);
+        ImapStreamParser parser(&readSocket, true);
+
+        QList<QByteArray> commands;
+        parser.onCommandReceived([&](const QByteArray &command) {
+            commands << command;
+        });
+
+        //Commands are reported as soon as they are complete, no matter how they arrive
+        QVERIFY(socket.write("A000001 LOGIN user \"pass") != -1);
+        parser.parseStream();
+        QVERIFY(commands.isEmpty());
+        QVERIFY(socket.write(" word\"\r\nA000002 SELECT INBOX\r\nA000003 FETCH 1:* (FLAGS UID)\r\nA000004 NO") != -1);
+        parser.parseStream();
+        QCOMPARE(commands.size(), 3);
+        QVERIFY(socket.write("OP\r\n") != -1);
+        parser.parseStream();
+        QVERIFY(!parser.error());
+
+        QCOMPARE(commands, QList<QByteArray>() << "A000001 LOGIN user \"pass word\""
+                                               << "A000002 SELECT INBOX"
+                                               << "A000003 FETCH 1:* (FLAGS UID)"
+                                               << "A000004 NOOP");
+    }
+
     void testRecursiveParse()
     {
         QByteArray buffer;
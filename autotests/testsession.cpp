@@ -21,12 +21,21 @@
     Boston, MA 02110-1301, USA.
   */
 
+#include <QtCore/QDir>
 #include <QtCore/QEventLoop>
 #include <QtCore/QObject>
+#include <QtCore/QTemporaryDir>
 #include <QtTest/QtTest>
 
 #include "session.h"
 #include "job.h"
+#include "capabilitiesjob.h"
+#include "fetchjob.h"
+#include "loginjob.h"
+#include "namespacejob.h"
+#include "selectjob.h"
+#include "statusjob.h"
+#include "trafficcapture.h"
 #include "kimap2test/fakeserver.h"
 #include "kimap2test/mockjob.h"
 
@@ -344,6 +353,717 @@ private Q_SLOTS:
         }
     }
 
+    void shouldPipelineIndependentJobs()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 FETCH 1:2 (FLAGS UID)"
+                               << "C: A000002 STATUS \"INBOX\" (MESSAGES)"
+                               << "S: * 1 FETCH ( FLAGS (\\Seen) UID 10 )"
+                               << "S: * STATUS \"INBOX\" (MESSAGES 4)"
+                               << "S: * 2 FETCH ( FLAGS () UID 11 )"
+                               << "S: A000001 OK fetch done"
+                               << "S: A000002 OK status done"
+                               << "C: A000003 SELECT \"INBOX\""
+                               << "S: A000003 OK select done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        QVERIFY(!s.isPipeliningEnabled());
+        s.setPipeliningEnabled(true);
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        QList<qint64> uids;
+        connect(fetch, &KIMAP2::FetchJob::resultReceived, [&uids](const KIMAP2::FetchJob::Result &result) {
+            uids << result.uid;
+        });
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        KIMAP2::StatusJob *status = new KIMAP2::StatusJob(&s);
+        status->setMailBox(QStringLiteral("INBOX"));
+        status->setDataItems({ "MESSAGES" });
+        status->setAutoDelete(false);
+        connect(status, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        // SELECT changes the session state, it has to wait for the others
+        KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&s);
+        select->setMailBox(QStringLiteral("INBOX"));
+        connect(select, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        fetch->start();
+        status->start();
+        select->start();
+
+        QTRY_COMPARE(m_jobs.size(), 3);
+        QCOMPARE(m_jobs[0], fetch);
+        QCOMPARE(m_jobs[1], status);
+        QCOMPARE(m_jobs[2], select);
+        QCOMPARE(uids, QList<qint64>() << 10 << 11);
+        QCOMPARE(status->error(), 0);
+        QCOMPARE(status->status().count(), 1);
+        QCOMPARE(status->status().first().second, qint64(4));
+
+        delete status;
+        fakeServer.quit();
+    }
+
+    void shouldScheduleJobsByPriority()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 STATUS \"Drafts\" (MESSAGES)"
+                               << "S: * STATUS \"Drafts\" (MESSAGES 1)"
+                               << "S: A000001 OK status done"
+                               << "C: A000002 STATUS \"INBOX\" (MESSAGES)"
+                               << "S: * STATUS \"INBOX\" (MESSAGES 4)"
+                               << "S: A000002 OK status done"
+                               << "C: A000003 FETCH 1:2 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: * 2 FETCH ( FLAGS () UID 11 )"
+                               << "S: A000003 OK fetch done"
+                               // Queued while the first chunk was fetched
+                               << "C: A000004 STATUS \"Sent\" (MESSAGES)"
+                               << "S: * STATUS \"Sent\" (MESSAGES 2)"
+                               << "S: A000004 OK status done"
+                               << "C: A000005 FETCH 3:4 (FLAGS UID)"
+                               << "S: * 3 FETCH ( FLAGS () UID 12 )"
+                               << "S: * 4 FETCH ( FLAGS () UID 13 )"
+                               << "S: A000005 OK fetch done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        s.setMetricsEnabled(true);
+
+        auto status = [this, &s](const QString &mailBox, KIMAP2::Job::Priority priority) {
+            KIMAP2::StatusJob *job = new KIMAP2::StatusJob(&s);
+            job->setMailBox(mailBox);
+            job->setDataItems({ "MESSAGES" });
+            job->setPriority(priority);
+            connect(job, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+            job->start();
+            return job;
+        };
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1, 4));
+        fetch->setChunkSize(2);
+        fetch->setPriority(KIMAP2::Job::Background);
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        QList<qint64> uids;
+        KJob *sent = Q_NULLPTR;
+        connect(fetch, &KIMAP2::FetchJob::resultReceived, [&](const KIMAP2::FetchJob::Result &result) {
+            uids << result.uid;
+            if (!sent) {
+                sent = status(QStringLiteral("Sent"), KIMAP2::Job::Interactive);
+            }
+        });
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+        fetch->start();
+
+        KJob *inbox = status(QStringLiteral("INBOX"), KIMAP2::Job::Normal);
+        KJob *drafts = status(QStringLiteral("Drafts"), KIMAP2::Job::Interactive);
+
+        QTRY_COMPARE(m_jobs.size(), 4);
+        QCOMPARE(m_jobs, QList<KJob *>() << drafts << inbox << sent << fetch);
+        QCOMPARE(uids, QList<qint64>() << 10 << 11 << 12 << 13);
+        QVERIFY(fakeServer.isAllScenarioDone());
+
+        QCOMPARE(s.queueWaitTime(KIMAP2::Job::Interactive).count(), qint64(2));
+        QCOMPARE(s.queueWaitTime(KIMAP2::Job::Normal).count(), qint64(1));
+        // The fetch waited again after its first chunk
+        QCOMPARE(s.queueWaitTime(KIMAP2::Job::Background).count(), qint64(2));
+
+        fakeServer.quit();
+    }
+
+    void shouldNotStarveBackgroundJobs()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 STATUS \"Drafts\" (MESSAGES)"
+                               << "S: A000001 OK status done"
+                               << "C: A000002 FETCH 1 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: A000002 OK fetch done"
+                               << "C: A000003 STATUS \"Sent\" (MESSAGES)"
+                               << "S: A000003 OK status done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        QCOMPARE(s.starvationLimit(), 16);
+        s.setStarvationLimit(1);
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1));
+        fetch->setPriority(KIMAP2::Job::Background);
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+        fetch->start();
+
+        QList<KJob *> statusJobs;
+        foreach (const QString &mailBox, QStringList() << QStringLiteral("Drafts") << QStringLiteral("Sent")) {
+            KIMAP2::StatusJob *job = new KIMAP2::StatusJob(&s);
+            job->setMailBox(mailBox);
+            job->setDataItems({ "MESSAGES" });
+            job->setPriority(KIMAP2::Job::Interactive);
+            connect(job, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+            job->start();
+            statusJobs << job;
+        }
+
+        // Passed over once, the fetch goes before the second interactive job
+        QTRY_COMPARE(m_jobs.size(), 3);
+        QCOMPARE(m_jobs, QList<KJob *>() << statusJobs[0] << fetch << statusJobs[1]);
+
+        fakeServer.quit();
+    }
+
+    void shouldCoalesceWrites()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 FETCH 1 (FLAGS UID)"
+                               << "C: A000002 STATUS \"INBOX\" (MESSAGES)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: * STATUS \"INBOX\" (MESSAGES 4)"
+                               << "S: A000001 OK fetch done"
+                               << "S: A000002 OK status done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        s.setPipeliningEnabled(true);
+        // Give the second job enough time to queue its command behind the first one
+        s.setWriteCoalescing(16384, 200);
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        KIMAP2::StatusJob *status = new KIMAP2::StatusJob(&s);
+        status->setMailBox(QStringLiteral("INBOX"));
+        status->setDataItems({ "MESSAGES" });
+        connect(status, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        fetch->start();
+        status->start();
+
+        QTRY_COMPARE(m_jobs.size(), 2);
+        QCOMPARE(s.writeCount(), qint64(1));
+        QCOMPARE(s.bytesWritten(), qint64(QByteArray("A000001 FETCH 1 (FLAGS UID)\r\n"
+                                                     "A000002 STATUS \"INBOX\" (MESSAGES)\r\n").size()));
+
+        fakeServer.quit();
+    }
+
+    void shouldWriteEveryCommandAtOnceWithoutCoalescing()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 FETCH 1 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: A000001 OK fetch done"
+                               << "C: A000002 STATUS \"INBOX\" (MESSAGES)"
+                               << "S: * STATUS \"INBOX\" (MESSAGES 4)"
+                               << "S: A000002 OK status done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        s.setWriteCoalescing(0, 0);
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        KIMAP2::StatusJob *status = new KIMAP2::StatusJob(&s);
+        status->setMailBox(QStringLiteral("INBOX"));
+        status->setDataItems({ "MESSAGES" });
+        connect(status, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        fetch->start();
+        status->start();
+
+        //One write per command, including its CRLF
+        QTRY_COMPARE(m_jobs.size(), 2);
+        QCOMPARE(s.writeCount(), qint64(2));
+        QCOMPARE(s.bytesWritten(), qint64(QByteArray("A000001 FETCH 1 (FLAGS UID)\r\n"
+                                                     "A000002 STATUS \"INBOX\" (MESSAGES)\r\n").size()));
+
+        fakeServer.quit();
+    }
+
+    void shouldDoIoOnWorkerThread()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 SELECT \"INBOX\""
+                               << "S: * 2 EXISTS"
+                               << "S: A000001 OK [READ-WRITE] select done"
+                               << "C: A000002 FETCH 1:2 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS (\\Seen) UID 10 )"
+                               << "S: * 2 FETCH ( FLAGS () UID 11 )"
+                               << "S: A000002 OK fetch done"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989, KIMAP2::Session::WorkerThreadIo);
+
+        KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&s);
+        select->setMailBox(QStringLiteral("INBOX"));
+        connect(select, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        QList<qint64> uids;
+        connect(fetch, &KIMAP2::FetchJob::resultReceived, [&uids](const KIMAP2::FetchJob::Result &result) {
+            // Results are still delivered in the thread of the session
+            QCOMPARE(QThread::currentThread(), qApp->thread());
+            uids << result.uid;
+        });
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        select->start();
+        fetch->start();
+
+        QTRY_COMPARE(m_jobs.size(), 2);
+        QCOMPARE(m_jobs[0], select);
+        QCOMPARE(m_jobs[1], fetch);
+        QCOMPARE((int)s.state(), (int)KIMAP2::Session::Selected);
+        QCOMPARE(uids, QList<qint64>() << 10 << 11);
+
+        fakeServer.quit();
+    }
+
+    void shouldRecordCommandMetrics()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 FETCH 1:2 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: * 2 FETCH ( FLAGS () UID 11 )"
+                               << "S: A000001 OK fetch done"
+                               << "C: A000002 SELECT \"Foo\""
+                               << "S: A000002 NO no such mailbox"
+                              );
+        fakeServer.startAndWait();
+
+        m_jobs.clear();
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        QVERIFY(!s.isMetricsEnabled());
+        s.setMetricsEnabled(true);
+        QList<KIMAP2::CommandMetrics> completed;
+        s.onCommandCompleted([&completed](const KIMAP2::CommandMetrics &metrics) {
+            completed << metrics;
+        });
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        connect(fetch, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&s);
+        select->setMailBox(QStringLiteral("Foo"));
+        connect(select, SIGNAL(result(KJob*)), this, SLOT(jobDone(KJob*)));
+
+        fetch->start();
+        select->start();
+
+        QTRY_COMPARE(m_jobs.size(), 2);
+        QCOMPARE(completed.size(), 2);
+
+        const KIMAP2::CommandMetrics &metrics = completed.first();
+        QCOMPARE(metrics.command, QByteArray("FETCH"));
+        QCOMPARE(metrics.tag, QByteArray("A000001"));
+        QCOMPARE(metrics.result, QByteArray("OK"));
+        QCOMPARE(metrics.untaggedResponses, 2);
+        QCOMPARE(metrics.bytesOut, qint64(QByteArray("A000001 FETCH 1:2 (FLAGS UID)\r\n").size()));
+        QCOMPARE(metrics.bytesIn, qint64(QByteArray("* 1 FETCH ( FLAGS () UID 10 )\r\n"
+                                                    "* 2 FETCH ( FLAGS () UID 11 )\r\n"
+                                                    "A000001 OK fetch done\r\n").size()));
+        QVERIFY(metrics.firstResponseTime >= 0);
+        QVERIFY(metrics.completionTime >= metrics.firstResponseTime);
+
+        QCOMPARE(completed.last().command, QByteArray("SELECT"));
+        QCOMPARE(completed.last().result, QByteArray("NO"));
+
+        const QHash<QByteArray, KIMAP2::CommandStatistics> statistics = s.commandStatistics();
+        QCOMPARE(statistics.size(), 2);
+        QCOMPARE(statistics["FETCH"].count, qint64(1));
+        QCOMPARE(statistics["FETCH"].failures, qint64(0));
+        QCOMPARE(statistics["FETCH"].completionTime.count(), qint64(1));
+        QCOMPARE(statistics["FETCH"].completionTime.max(), metrics.completionTime);
+        QCOMPARE(statistics["SELECT"].failures, qint64(1));
+
+        s.resetCommandStatistics();
+        QVERIFY(s.commandStatistics().isEmpty());
+
+        fakeServer.quit();
+    }
+
+    void shouldRecordCommandMetricsOfLostCommands()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 FETCH 1:2 (FLAGS UID)"
+                               << "X"
+                              );
+        fakeServer.startAndWait();
+
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        s.setMetricsEnabled(true);
+        QList<KIMAP2::CommandMetrics> completed;
+        s.onCommandCompleted([&completed](const KIMAP2::CommandMetrics &metrics) {
+            completed << metrics;
+        });
+
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1, 2));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        QVERIFY(!fetch->exec());
+
+        QCOMPARE(completed.size(), 1);
+        QVERIFY(completed.first().result.isEmpty());
+        QCOMPARE(completed.first().firstResponseTime, qint64(-1));
+
+        //The command is counted, but doesn't distort the response times
+        const KIMAP2::CommandStatistics statistics = s.commandStatistics()["FETCH"];
+        QCOMPARE(statistics.count, qint64(1));
+        QCOMPARE(statistics.failures, qint64(1));
+        QCOMPARE(statistics.lost, qint64(1));
+        QCOMPARE(statistics.queueTime.count(), qint64(1));
+        QCOMPARE(statistics.firstResponseTime.count(), qint64(0));
+        QCOMPARE(statistics.completionTime.count(), qint64(0));
+
+        fakeServer.quit();
+    }
+
+    void shouldCaptureAndReplayTraffic()
+    {
+        const QByteArray fetchCommand = "A000001 FETCH 1 (RFC822.SIZE INTERNALDATE BODY.PEEK[HEADER.FIELDS (TO FROM MESSAGE-ID REFERENCES IN-REPLY-TO SUBJECT DATE)] FLAGS UID)";
+        const QByteArray fetchResponse = "* 1 FETCH (RFC822.SIZE 18 UID 10 FLAGS () BODY[HEADER.FIELDS (TO FROM MESSAGE-ID REFERENCES IN-REPLY-TO SUBJECT DATE)] {18}\r\nSubject: hello\r\n\r\n)";
+
+        auto fetch = [](KIMAP2::Session *session) {
+            KIMAP2::FetchJob *job = new KIMAP2::FetchJob(session);
+            job->setSequenceSet(KIMAP2::ImapSet(1));
+            KIMAP2::FetchJob::FetchScope scope;
+            scope.mode = KIMAP2::FetchJob::FetchScope::Headers;
+            job->setScope(scope);
+            QList<KIMAP2::FetchJob::Result> results;
+            connect(job, &KIMAP2::FetchJob::resultReceived, [&results](const KIMAP2::FetchJob::Result &result) {
+                results << result;
+            });
+            job->exec();
+            return results;
+        };
+
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        {
+            FakeServer fakeServer;
+            fakeServer.setScenario(QList<QByteArray>()
+                                   << FakeServer::preauth()
+                                   << "C: " + fetchCommand
+                                   << "S: " + fetchResponse
+                                   << "S: A000001 OK fetch done"
+                                  );
+            fakeServer.startAndWait();
+
+            qputenv("KIMAP2_CAPTURE", QFile::encodeName(dir.path() + QStringLiteral("/capture")));
+            KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+            qunsetenv("KIMAP2_CAPTURE");
+            QCOMPARE(fetch(&s).size(), 1);
+            fakeServer.quit();
+        }
+
+        const QStringList captures = QDir(dir.path()).entryList(QDir::Files);
+        QCOMPARE(captures.size(), 1);
+        const QString captureFile = dir.path() + QLatin1Char('/') + captures.first();
+
+        QVector<KIMAP2::TrafficCapture::Record> records;
+        QVERIFY(KIMAP2::TrafficCapture::read(captureFile, records));
+        QCOMPARE(KIMAP2::TrafficCapture::data(records, KIMAP2::TrafficCapture::Sent), fetchCommand + "\r\n");
+        QCOMPARE(KIMAP2::TrafficCapture::data(records, KIMAP2::TrafficCapture::Received),
+                 FakeServer::preauth().mid(3) + "\r\n" + fetchResponse + "\r\nA000001 OK fetch done\r\n");
+
+        // The capture plays the server part of the same exchange
+        FakeServer replayServer;
+        replayServer.addScenarioFromCapture(captureFile);
+        replayServer.startAndWait();
+
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        const QList<KIMAP2::FetchJob::Result> results = fetch(&s);
+        QCOMPARE(results.size(), 1);
+        QCOMPARE(results.first().uid, qint64(10));
+        QCOMPARE(results.first().size, qint64(18));
+        QVERIFY(replayServer.isAllScenarioDone());
+
+        replayServer.quit();
+    }
+
+    void shouldStartFromSnapshot()
+    {
+        auto login = [](KIMAP2::Session *session) {
+            KIMAP2::LoginJob *job = new KIMAP2::LoginJob(session);
+            job->setUserName(QStringLiteral("user"));
+            job->setPassword(QStringLiteral("password"));
+            return job->exec();
+        };
+
+        FakeServer fakeServer;
+        fakeServer.addScenario(QList<QByteArray>()
+                               << FakeServer::greeting()
+                               << "C: A000001 CAPABILITY"
+                               << "S: * CAPABILITY IMAP4rev1 AUTH=PLAIN"
+                               << "S: A000001 OK"
+                               << "C: A000002 LOGIN \"user\" \"password\""
+                               << "S: A000002 OK [CAPABILITY IMAP4rev1 NAMESPACE CONDSTORE] logged in"
+                               << "C: A000003 NAMESPACE"
+                               << "S: * NAMESPACE ((\"\" \"/\")) NIL ((\"Shared/\" \"/\"))"
+                               << "S: A000003 OK namespace done"
+                               << "C: A000004 SELECT \"INBOX\""
+                               << "S: * OK [UIDVALIDITY 1234]"
+                               << "S: * OK [HIGHESTMODSEQ 42]"
+                               << "S: A000004 OK [READ-WRITE] select done"
+                              );
+        // The same server, only the authenticated state needs to be established again
+        fakeServer.addScenario(QList<QByteArray>()
+                               << FakeServer::greeting()
+                               << "C: A000001 LOGIN \"user\" \"password\""
+                               << "S: A000001 OK logged in"
+                              );
+        // A different greeting invalidates the snapshot
+        fakeServer.addScenario(QList<QByteArray>()
+                               << "S: * OK [CAPABILITY IMAP4rev1 AUTH=PLAIN] upgraded server ready"
+                               << "C: A000001 LOGIN \"user\" \"password\""
+                               << "S: A000001 OK logged in"
+                               << "C: A000002 NAMESPACE"
+                               << "S: * NAMESPACE ((\"INBOX.\" \".\")) NIL NIL"
+                               << "S: A000002 OK namespace done"
+                              );
+        fakeServer.startAndWait();
+
+        QByteArray snapshotData;
+        {
+            KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+            QVERIFY(login(&session));
+            QVERIFY((new KIMAP2::NamespaceJob(&session))->exec());
+            KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&session);
+            select->setMailBox(QStringLiteral("INBOX"));
+            QVERIFY(select->exec());
+            QVERIFY(!session.isSnapshotValid());
+
+            const KIMAP2::SessionSnapshot snapshot = session.snapshot();
+            QCOMPARE(snapshot.userName, QStringLiteral("user"));
+            QCOMPARE(snapshot.capabilities, QStringList() << QStringLiteral("IMAP4rev1") << QStringLiteral("AUTH=PLAIN"));
+            QCOMPARE(snapshot.authenticatedCapabilities, QStringList() << QStringLiteral("IMAP4REV1") << QStringLiteral("NAMESPACE") << QStringLiteral("CONDSTORE"));
+            QCOMPARE(snapshot.selectedMailBox, QStringLiteral("INBOX"));
+            QCOMPARE(snapshot.uidValidity, qint64(1234));
+            QCOMPARE(snapshot.highestModSequence, quint64(42));
+            snapshotData = snapshot.toByteArray();
+        }
+
+        {
+            KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+            session.restoreSnapshot(KIMAP2::SessionSnapshot::fromByteArray(snapshotData));
+            QVERIFY(login(&session));
+            QVERIFY(session.isSnapshotValid());
+
+            KIMAP2::CapabilitiesJob *capabilities = new KIMAP2::CapabilitiesJob(&session);
+            QVERIFY(capabilities->exec());
+            QCOMPARE(capabilities->capabilities(), QStringList() << QStringLiteral("IMAP4REV1") << QStringLiteral("NAMESPACE") << QStringLiteral("CONDSTORE"));
+
+            KIMAP2::NamespaceJob *namespaces = new KIMAP2::NamespaceJob(&session);
+            QVERIFY(namespaces->exec());
+            QCOMPARE(namespaces->personalNamespaces().size(), 1);
+            QCOMPARE(namespaces->personalNamespaces().first().separator, QLatin1Char('/'));
+            QCOMPARE(namespaces->sharedNamespaces().first().name, QStringLiteral("Shared/"));
+            QVERIFY(fakeServer.isScenarioDone(1));
+        }
+
+        {
+            KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+            session.restoreSnapshot(KIMAP2::SessionSnapshot::fromByteArray(snapshotData));
+            // The capabilities of the greeting spare the CAPABILITY command anyways
+            QVERIFY(login(&session));
+            QVERIFY(!session.isSnapshotValid());
+
+            KIMAP2::NamespaceJob *namespaces = new KIMAP2::NamespaceJob(&session);
+            QVERIFY(namespaces->exec());
+            QCOMPARE(namespaces->personalNamespaces().first().name, QStringLiteral("INBOX."));
+        }
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void shouldDeliverUnsolicitedMailBoxEvents()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 SELECT \"INBOX\""
+                               << "S: * 4 EXISTS"
+                               << "S: A000001 OK [READ-WRITE] select done"
+                               << "S: * 5 EXISTS"
+                               << "S: * 2 RECENT"
+                               << "C: A000002 STATUS \"Drafts\" (MESSAGES)"
+                               << "S: * 3 EXPUNGE"
+                               << "S: * STATUS \"Drafts\" (MESSAGES 4)"
+                               << "S: A000002 OK status done"
+                               << "C: A000003 FETCH 1 (FLAGS UID)"
+                               << "S: * 1 FETCH ( FLAGS () UID 10 )"
+                               << "S: * VANISHED 20:22"
+                               << "S: A000003 OK fetch done"
+                               << "S: * 4 FETCH (FLAGS (\\Seen) UID 14 MODSEQ (120))"
+                              );
+        fakeServer.startAndWait();
+
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        QVector<KIMAP2::MailBoxEvent> events;
+        int batches = 0;
+        s.subscribe(KIMAP2::MailBoxEvent::Exists | KIMAP2::MailBoxEvent::Recent | KIMAP2::MailBoxEvent::Expunge |
+                    KIMAP2::MailBoxEvent::Vanished | KIMAP2::MailBoxEvent::Flags,
+                    [&](const QVector<KIMAP2::MailBoxEvent> &batch) {
+            events << batch;
+            batches++;
+        });
+        QVector<KIMAP2::MailBoxEvent> exists;
+        const int existsId = s.subscribe(KIMAP2::MailBoxEvent::Exists, [&](const QVector<KIMAP2::MailBoxEvent> &batch) {
+            exists << batch;
+        });
+
+        KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&s);
+        select->setMailBox(QStringLiteral("INBOX"));
+        QVERIFY(select->exec());
+
+        KIMAP2::StatusJob *status = new KIMAP2::StatusJob(&s);
+        status->setMailBox(QStringLiteral("Drafts"));
+        status->setDataItems({ "MESSAGES" });
+        QVERIFY(status->exec());
+        s.unsubscribe(existsId);
+
+        // The flags the FetchJob asked for are not an event
+        KIMAP2::FetchJob *fetch = new KIMAP2::FetchJob(&s);
+        fetch->setSequenceSet(KIMAP2::ImapSet(1));
+        KIMAP2::FetchJob::FetchScope scope;
+        scope.mode = KIMAP2::FetchJob::FetchScope::Flags;
+        fetch->setScope(scope);
+        QVERIFY(fetch->exec());
+
+        QTRY_COMPARE(events.size(), 5);
+        QVERIFY(batches <= events.size());
+
+        // The EXISTS that answers the SELECT is for the SelectJob
+        QCOMPARE(exists.size(), 1);
+        QCOMPARE(exists[0].number, qint64(5));
+
+        QCOMPARE(events[0].type, KIMAP2::MailBoxEvent::Exists);
+        QCOMPARE(events[0].mailBox, QStringLiteral("INBOX"));
+        QCOMPARE(events[1].type, KIMAP2::MailBoxEvent::Recent);
+        QCOMPARE(events[1].number, qint64(2));
+        QCOMPARE(events[2].type, KIMAP2::MailBoxEvent::Expunge);
+        QCOMPARE(events[2].number, qint64(3));
+        QCOMPARE(events[3].type, KIMAP2::MailBoxEvent::Vanished);
+        QCOMPARE(events[3].uids.toImapSequenceSet(), QByteArray("20:22"));
+        QVERIFY(!events[3].earlier);
+        QCOMPARE(events[4].type, KIMAP2::MailBoxEvent::Flags);
+        QCOMPARE(events[4].number, qint64(4));
+        QCOMPARE(events[4].uid, qint64(14));
+        QCOMPARE(events[4].flags, QList<QByteArray>() << "\\Seen");
+        QCOMPARE(events[4].modSequence, quint64(120));
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void shouldIdleAutomatically()
+    {
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>()
+                               << FakeServer::preauth()
+                               << "C: A000001 SELECT \"INBOX\""
+                               << "S: A000001 OK [READ-WRITE] select done"
+                               << "C: A000002 IDLE"
+                               << "S: + idling"
+                               << "S: * 5 EXISTS"
+                               << "C: DONE"
+                               << "S: A000002 OK idle done"
+                               << "C: A000003 STATUS \"Drafts\" (MESSAGES)"
+                               << "S: A000003 OK status done"
+                               << "C: A000004 IDLE"
+                               << "S: + idling"
+                              );
+        fakeServer.startAndWait();
+
+        KIMAP2::Session s(QStringLiteral("127.0.0.1"), 5989);
+        s.setMetricsEnabled(true);
+        s.setAutoIdleEnabled(true);
+        s.setAutoIdleDelay(50);
+        QVector<KIMAP2::MailBoxEvent> events;
+        s.subscribe(KIMAP2::MailBoxEvent::Exists, [&](const QVector<KIMAP2::MailBoxEvent> &batch) {
+            events << batch;
+        });
+
+        KIMAP2::SelectJob *select = new KIMAP2::SelectJob(&s);
+        select->setMailBox(QStringLiteral("INBOX"));
+        QVERIFY(select->exec());
+
+        // The push arrives while idling, which doesn't count as a job
+        QTRY_COMPARE(events.size(), 1);
+        QCOMPARE(events[0].number, qint64(5));
+        QCOMPARE(s.jobQueueSize(), 0);
+
+        // A new job ends IDLE, which is entered again once it is done
+        KIMAP2::StatusJob *status = new KIMAP2::StatusJob(&s);
+        status->setMailBox(QStringLiteral("Drafts"));
+        status->setDataItems({ "MESSAGES" });
+        QVERIFY(status->exec());
+        QCOMPARE(s.idleExitTime().count(), qint64(1));
+        QCOMPARE(s.commandStatistics()["IDLE"].count, qint64(1));
+
+        QTRY_VERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
 public Q_SLOTS:
     void jobDone(KJob *job)
     {
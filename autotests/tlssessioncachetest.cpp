@@ -0,0 +1,169 @@
+/*
+   Copyright (c) 2026 agent <agent@local>
+
+   This program is free software; you can redistribute it and/or
+   modify it under the terms of the GNU General Public
+   License as published by the Free Software Foundation; either
+   version 2 of the License, or (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, write to the Free Software
+   Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301, USA.
+*/
+
+#include <qtest.h>
+
+#include "kimap2test/fakeserver.h"
+#include "kimap2/session.h"
+#include "kimap2/loginjob.h"
+#include "kimap2/tlssessioncache.h"
+
+#include <QtTest>
+
+class TlsSessionCacheTest: public QObject
+{
+    Q_OBJECT
+
+    static bool login(KIMAP2::Session::IoMode ioMode, bool startTls, const QSharedPointer<KIMAP2::TlsSessionCache> &cache,
+                      int *error = Q_NULLPTR)
+    {
+        KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989, ioMode);
+        session.setTlsSessionCache(cache);
+        QObject::connect(&session, &KIMAP2::Session::sslErrors, [&session](const QList<QSslError> &errors) {
+            session.ignoreErrors(errors);
+        });
+        KIMAP2::LoginJob *login = new KIMAP2::LoginJob(&session);
+        login->setUserName(QStringLiteral("user"));
+        login->setPassword(QStringLiteral("password"));
+        login->setEncryptionMode(QSsl::TlsV1_2, startTls);
+        const bool result = login->exec();
+        if (error) {
+            *error = login->error();
+        }
+        return result;
+    }
+
+private Q_SLOTS:
+
+    void testTickets()
+    {
+        KIMAP2::TlsSessionCache cache;
+        QCOMPARE(cache.size(), 0);
+        QVERIFY(cache.sessionTicket(QStringLiteral("imap.example.com"), 993).isEmpty());
+
+        cache.insert(QStringLiteral("imap.example.com"), 993, "ticket1");
+        cache.insert(QStringLiteral("imap.example.com"), 143, "ticket2");
+        cache.insert(QStringLiteral("mail.example.com"), 993, "ticket3");
+        //Empty tickets are not stored
+        cache.insert(QStringLiteral("other.example.com"), 993, QByteArray());
+        QCOMPARE(cache.size(), 3);
+
+        //One ticket per host and port, host names are case insensitive
+        QCOMPARE(cache.sessionTicket(QStringLiteral("imap.example.com"), 993), QByteArray("ticket1"));
+        QCOMPARE(cache.sessionTicket(QStringLiteral("IMAP.example.com"), 993), QByteArray("ticket1"));
+        QCOMPARE(cache.sessionTicket(QStringLiteral("imap.example.com"), 143), QByteArray("ticket2"));
+        QCOMPARE(cache.sessionTicket(QStringLiteral("mail.example.com"), 993), QByteArray("ticket3"));
+
+        cache.insert(QStringLiteral("imap.example.com"), 993, "ticket4");
+        QCOMPARE(cache.sessionTicket(QStringLiteral("imap.example.com"), 993), QByteArray("ticket4"));
+        QCOMPARE(cache.size(), 3);
+
+        cache.remove(QStringLiteral("imap.example.com"), 993);
+        QVERIFY(cache.sessionTicket(QStringLiteral("imap.example.com"), 993).isEmpty());
+        QCOMPARE(cache.sessionTicket(QStringLiteral("imap.example.com"), 143), QByteArray("ticket2"));
+        QCOMPARE(cache.size(), 2);
+
+        cache.clear();
+        QCOMPARE(cache.size(), 0);
+        QCOMPARE(cache.handshakes(), qint64(0));
+        QCOMPARE(cache.resumptionAttempts(), qint64(0));
+    }
+
+    void testResumption_data()
+    {
+        QTest::addColumn<int>("ioMode");
+        QTest::addColumn<bool>("startTls");
+
+        QTest::newRow("tls") << static_cast<int>(KIMAP2::Session::SameThreadIo) << false;
+        QTest::newRow("starttls") << static_cast<int>(KIMAP2::Session::SameThreadIo) << true;
+        QTest::newRow("tls worker thread") << static_cast<int>(KIMAP2::Session::WorkerThreadIo) << false;
+        QTest::newRow("starttls worker thread") << static_cast<int>(KIMAP2::Session::WorkerThreadIo) << true;
+    }
+
+    void testResumption()
+    {
+        QFETCH(int, ioMode);
+        QFETCH(bool, startTls);
+        const int count = 3;
+
+        QList<QByteArray> scenario;
+        scenario << FakeServer::greeting();
+        if (startTls) {
+            scenario << "C: A000001 STARTTLS"
+                     << "S: A000001 OK"
+                     << "C: A000002 CAPABILITY"
+                     << "S: A000002 OK"
+                     << "C: A000003 LOGIN \"user\" \"password\""
+                     << "S: A000003 OK";
+        } else {
+            scenario << "C: A000001 CAPABILITY"
+                     << "S: A000001 OK"
+                     << "C: A000002 LOGIN \"user\" \"password\""
+                     << "S: A000002 OK";
+        }
+
+        FakeServer fakeServer;
+        fakeServer.setEncrypted(QSsl::TlsV1_2, startTls);
+        for (int i = 0; i < count; i++) {
+            fakeServer.addScenario(scenario);
+        }
+        fakeServer.startAndWait();
+
+        QSharedPointer<KIMAP2::TlsSessionCache> cache(new KIMAP2::TlsSessionCache);
+        for (int i = 0; i < count; i++) {
+            QVERIFY(login(static_cast<KIMAP2::Session::IoMode>(ioMode), startTls, cache));
+            //The session of the first connection is stored and offered by every later one
+            QCOMPARE(cache->size(), 1);
+            QVERIFY(!cache->sessionTicket(QStringLiteral("127.0.0.1"), 5989).isEmpty());
+            QCOMPARE(cache->handshakes(), qint64(i + 1));
+            QCOMPARE(cache->resumptionAttempts(), qint64(i));
+        }
+
+        QVERIFY(fakeServer.isAllScenarioDone());
+        fakeServer.quit();
+    }
+
+    void testFailedHandshake()
+    {
+        //The server doesn't speak TLS, so the handshake fails
+        FakeServer fakeServer;
+        fakeServer.setScenario(QList<QByteArray>() << FakeServer::greeting());
+        fakeServer.startAndWait();
+
+        QSharedPointer<KIMAP2::TlsSessionCache> cache(new KIMAP2::TlsSessionCache);
+        cache->insert(QStringLiteral("127.0.0.1"), 5989, "ticket");
+        cache->insert(QStringLiteral("127.0.0.1"), 5990, "ticket");
+
+        int error = 0;
+        QVERIFY(!login(KIMAP2::Session::SameThreadIo, false, cache, &error));
+        QCOMPARE(error, static_cast<int>(KIMAP2::SslHandshakeFailed));
+
+        //The ticket was offered, and isn't offered again after the failure
+        QCOMPARE(cache->handshakes(), qint64(1));
+        QCOMPARE(cache->resumptionAttempts(), qint64(1));
+        QVERIFY(cache->sessionTicket(QStringLiteral("127.0.0.1"), 5989).isEmpty());
+        //The ones of other servers are kept
+        QCOMPARE(cache->sessionTicket(QStringLiteral("127.0.0.1"), 5990), QByteArray("ticket"));
+
+        fakeServer.quit();
+    }
+};
+
+QTEST_GUILESS_MAIN(TlsSessionCacheTest)
+
+#include "tlssessioncachetest.moc"
@@ -19,6 +19,8 @@
 
 #include "appendjob.h"
 
+#include <QtCore/QIODevice>
+
 #include "job_p.h"
 #include "message_p.h"
 #include "session_p.h"
@@ -29,7 +31,22 @@ namespace KIMAP2
 class AppendJobPrivate : public JobPrivate
 {
 public:
-    AppendJobPrivate(Session *session, const QString &name) : JobPrivate(session, name), uid(0) { }
+    AppendJobPrivate(Session *session, const QString &name) : JobPrivate(session, name), uid(0), contentSent(false), streamSize(-1) { }
+
+    qint64 contentSize() const
+    {
+        return produce ? streamSize : content.size();
+    }
+    void sendContent()
+    {
+        if (produce) {
+            sessionInternal()->streamData(q_ptr, streamSize, produce);
+        } else {
+            sessionInternal()->sendData(q_ptr, content);
+        }
+        contentSent = true;
+    }
+
     ~AppendJobPrivate() { }
 
     QString mailBox;
@@ -37,6 +54,10 @@ public:
     QDateTime internalDate;
     QByteArray content;
     qint64 uid;
+    bool contentSent;
+    //Set if the content is streamed
+    std::function<QByteArray(qint64)> produce;
+    qint64 streamSize;
 };
 }
 
@@ -91,6 +112,25 @@ void AppendJob::setContent(const QByteArray &content)
 {
     Q_D(AppendJob);
     d->content = content;
+    d->produce = nullptr;
+}
+
+void AppendJob::setContent(QIODevice *device, qint64 size)
+{
+    if (size < 0) {
+        size = device->size() - device->pos();
+    }
+    setContent(size, [device](qint64 maxSize) {
+        return device->read(maxSize);
+    });
+}
+
+void AppendJob::setContent(qint64 size, std::function<QByteArray(qint64 maxSize)> produce)
+{
+    Q_D(AppendJob);
+    d->content.clear();
+    d->produce = produce;
+    d->streamSize = size;
 }
 
 QByteArray AppendJob::content() const
@@ -125,16 +165,21 @@ void AppendJob::doStart()
         parameters += " \"" + QLocale::c().toString(utcDateTime, QStringLiteral("dd-MMM-yyyy hh:mm:ss")).toLatin1() + " +0000" + '\"';
     }
 
-    parameters += " {" + QByteArray::number(d->content.size()) + '}';
+    //The content can follow right away if we don't have to wait for the continuation
+    const bool synchronizing = !d->sessionInternal()->canSendNonSynchronizingLiteral(d->contentSize());
+    parameters += " {" + QByteArray::number(d->contentSize()) + (synchronizing ? "}" : "+}");
 
     d->sendCommand("APPEND", parameters);
+    if (!synchronizing) {
+        d->sendContent();
+    }
 }
 
 void AppendJob::handleResponse(const Message &response)
 {
     Q_D(AppendJob);
 
-    for (QList<Message::Part>::ConstIterator it = response.responseCode.begin();
+    for (QVector<Message::Part>::ConstIterator it = response.responseCode.begin();
             it != response.responseCode.end(); ++it) {
         if (it->toString() == "APPENDUID") {
             it = it + 2;
@@ -146,8 +191,8 @@ void AppendJob::handleResponse(const Message &response)
     }
 
     if (handleErrorReplies(response) == NotHandled) {
-        if (!response.content.isEmpty() && response.content[0].toString() == "+") {
-            d->sessionInternal()->sendData(d->content);
+        if (!response.content.isEmpty() && response.content[0].toString() == "+" && !d->contentSent) {
+            d->sendContent();
         }
     }
 }
@@ -25,6 +25,10 @@
 #include "job.h"
 #include <QDateTime>
 
+#include <functional>
+
+class QIODevice;
+
 namespace KIMAP2
 {
 
@@ -110,9 +114,30 @@ public:
     void setContent(const QByteArray &content);
     /**
      * The content that the message will have.
+     *
+     * Empty if the content is streamed.
      */
     QByteArray content() const;
 
+    /**
+     * Stream the content from @p device instead of holding all of it in memory.
+     *
+     * The content is read in chunks from the current position of the device as the connection
+     * can take it. The device must be open and stay valid until the job is done. A sequential device
+     * has to return data whenever it is read, otherwise the content is considered incomplete.
+     *
+     * @param device  the device to read the content from
+     * @param size    the size of the content, or -1 to read up to the end of a random access device
+     */
+    void setContent(QIODevice *device, qint64 size = -1);
+
+    /**
+     * Stream @p size bytes of content, returned by @p produce in chunks of at most the requested size.
+     *
+     * The connection is closed if @p produce returns an empty chunk before the content is complete.
+     */
+    void setContent(qint64 size, std::function<QByteArray(qint64 maxSize)> produce);
+
     /**
      * The UID of the new message.
      *
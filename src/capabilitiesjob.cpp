@@ -55,6 +55,15 @@ QStringList CapabilitiesJob::capabilities() const
 void CapabilitiesJob::doStart()
 {
     Q_D(CapabilitiesJob);
+    //The capabilities before authentication are of no interest after the LoginJob
+    const SessionSnapshot *snapshot = d->sessionInternal()->restoredSnapshotForUser();
+    if (snapshot && !snapshot->authenticatedCapabilities.isEmpty()) {
+        d->capabilities = snapshot->authenticatedCapabilities;
+        d->sessionInternal()->capabilitiesReceived(d->capabilities);
+        emit capabilitiesReceived(d->capabilities);
+        emitResult();
+        return;
+    }
     d->sendCommand("CAPABILITY", {});
 }
 
@@ -68,6 +77,7 @@ void CapabilitiesJob::handleResponse(const Message &response)
             for (int i = 2; i < response.content.size(); ++i) {
                 d->capabilities << QLatin1String(response.content[i].toString().toUpper());
             }
+            d->sessionInternal()->capabilitiesReceived(d->capabilities);
             emit capabilitiesReceived(d->capabilities);
         }
     }
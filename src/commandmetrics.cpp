@@ -0,0 +1,163 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "commandmetrics.h"
+
+#include <cmath>
+
+using namespace KIMAP2;
+
+static int bucketIndex(qint64 value)
+{
+    int index = 0;
+    while (value > 0) {
+        value >>= 1;
+        index++;
+    }
+    return index;
+}
+
+Histogram::Histogram()
+    : m_count(0),
+      m_sum(0),
+      m_min(0),
+      m_max(0)
+{
+}
+
+void Histogram::add(qint64 value)
+{
+    const int index = bucketIndex(value);
+    if (index >= m_buckets.size()) {
+        m_buckets.resize(index + 1);
+    }
+    m_buckets[index]++;
+    m_min = m_count ? qMin(m_min, value) : value;
+    m_max = m_count ? qMax(m_max, value) : value;
+    m_count++;
+    m_sum += value;
+}
+
+void Histogram::merge(const Histogram &other)
+{
+    if (!other.m_count) {
+        return;
+    }
+    if (other.m_buckets.size() > m_buckets.size()) {
+        m_buckets.resize(other.m_buckets.size());
+    }
+    for (int i = 0; i < other.m_buckets.size(); i++) {
+        m_buckets[i] += other.m_buckets.at(i);
+    }
+    m_min = m_count ? qMin(m_min, other.m_min) : other.m_min;
+    m_max = m_count ? qMax(m_max, other.m_max) : other.m_max;
+    m_count += other.m_count;
+    m_sum += other.m_sum;
+}
+
+qint64 Histogram::count() const
+{
+    return m_count;
+}
+
+qint64 Histogram::sum() const
+{
+    return m_sum;
+}
+
+qint64 Histogram::min() const
+{
+    return m_min;
+}
+
+qint64 Histogram::max() const
+{
+    return m_max;
+}
+
+qreal Histogram::mean() const
+{
+    return m_count ? qreal(m_sum) / m_count : 0;
+}
+
+qint64 Histogram::percentile(qreal percentile) const
+{
+    if (!m_count) {
+        return 0;
+    }
+    const qint64 rank = qMax(qint64(1), qint64(std::ceil(m_count * qBound(qreal(0), percentile, qreal(100)) / 100)));
+    qint64 seen = 0;
+    for (int i = 0; i < m_buckets.size(); i++) {
+        seen += m_buckets.at(i);
+        if (seen >= rank) {
+            const qint64 upperBound = i ? (qint64(1) << i) - 1 : 0;
+            return qMin(upperBound, m_max);
+        }
+    }
+    return m_max;
+}
+
+QVector<qint64> Histogram::buckets() const
+{
+    return m_buckets;
+}
+
+CommandMetrics::CommandMetrics()
+    : queueTime(0),
+      firstResponseTime(0),
+      completionTime(0),
+      parseTime(0),
+      bytesOut(0),
+      bytesIn(0),
+      untaggedResponses(0)
+{
+}
+
+CommandStatistics::CommandStatistics()
+    : count(0),
+      failures(0),
+      lost(0),
+      bytesOut(0),
+      bytesIn(0),
+      untaggedResponses(0)
+{
+}
+
+void CommandStatistics::add(const CommandMetrics &metrics)
+{
+    count++;
+    if (metrics.result != "OK") {
+        failures++;
+    }
+    bytesOut += metrics.bytesOut;
+    bytesIn += metrics.bytesIn;
+    untaggedResponses += metrics.untaggedResponses;
+    queueTime.add(metrics.queueTime);
+    if (metrics.firstResponseTime >= 0) {
+        firstResponseTime.add(metrics.firstResponseTime);
+    }
+    //The time until the connection dropped says nothing about the command
+    if (metrics.result.isEmpty()) {
+        lost++;
+    } else {
+        completionTime.add(metrics.completionTime);
+    }
+    parseTime.add(metrics.parseTime);
+}
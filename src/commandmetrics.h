@@ -0,0 +1,146 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_COMMANDMETRICS_H
+#define KIMAP2_COMMANDMETRICS_H
+
+#include "kimap2_export.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QVector>
+
+namespace KIMAP2
+{
+
+/**
+ * Counts values, e.g. latencies, in buckets of powers of two.
+ *
+ * Bucket 0 counts the values up to 0, bucket i the values from 2^(i-1) to 2^i - 1.
+ */
+class KIMAP2_EXPORT Histogram
+{
+public:
+    Histogram();
+
+    void add(qint64 value);
+    void merge(const Histogram &other);
+
+    qint64 count() const;
+    qint64 sum() const;
+    qint64 min() const;
+    qint64 max() const;
+    qreal mean() const;
+
+    /**
+     * Returns the upper bound of the bucket that contains the given percentile (0 to 100),
+     * which is never more than max().
+     */
+    qint64 percentile(qreal percentile) const;
+
+    QVector<qint64> buckets() const;
+
+private:
+    QVector<qint64> m_buckets;
+    qint64 m_count;
+    qint64 m_sum;
+    qint64 m_min;
+    qint64 m_max;
+};
+
+/**
+ * What it took to run a single command.
+ *
+ * All times are in microseconds.
+ */
+struct KIMAP2_EXPORT CommandMetrics
+{
+    CommandMetrics();
+
+    /**
+     * The command without its arguments, e.g. "UID FETCH".
+     */
+    QByteArray command;
+    QByteArray tag;
+    /**
+     * The status of the tagged completion, e.g. "OK" or "NO". Empty if the connection was lost before.
+     */
+    QByteArray result;
+
+    /**
+     * From the moment the job was queued, or its previous command completed, until the command was sent.
+     */
+    qint64 queueTime;
+    /**
+     * From sending the command until the first response to it arrived, which may be the completion.
+     * -1 if the connection was lost before any response arrived.
+     */
+    qint64 firstResponseTime;
+    /**
+     * From sending the command until its tagged completion arrived.
+     */
+    qint64 completionTime;
+    /**
+     * The time spent parsing the responses to the command.
+     */
+    qint64 parseTime;
+
+    /**
+     * The bytes sent for the command, including literals and continuation data.
+     */
+    qint64 bytesOut;
+    /**
+     * The bytes of all responses to the command, after decompression.
+     */
+    qint64 bytesIn;
+    int untaggedResponses;
+};
+
+/**
+ * The metrics of all commands with the same name.
+ */
+struct KIMAP2_EXPORT CommandStatistics
+{
+    CommandStatistics();
+
+    void add(const CommandMetrics &metrics);
+
+    qint64 count;
+    /**
+     * Commands that did not complete with OK.
+     */
+    qint64 failures;
+    /**
+     * Commands that never completed because the connection was lost, they count as failures as well.
+     * Their completion time is not part of completionTime, and their first response time only if there was one.
+     */
+    qint64 lost;
+    qint64 bytesOut;
+    qint64 bytesIn;
+    qint64 untaggedResponses;
+
+    Histogram queueTime;
+    Histogram firstResponseTime;
+    Histogram completionTime;
+    Histogram parseTime;
+};
+
+}
+
+#endif
@@ -0,0 +1,153 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "commandtracker_p.h"
+
+#include "message_p.h"
+
+using namespace KIMAP2;
+
+CommandTracker::CommandTracker()
+{
+    m_clock.start();
+}
+
+qint64 CommandTracker::now() const
+{
+    return m_clock.nsecsElapsed() / 1000;
+}
+
+void CommandTracker::jobQueued(Job *job)
+{
+    m_jobReadySince.insert(job, now());
+}
+
+void CommandTracker::jobDone(Job *job)
+{
+    m_jobReadySince.remove(job);
+    m_jobTags.remove(job);
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (it->job == job) {
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void CommandTracker::commandSent(Job *job, const QByteArray &tag, const QByteArray &command)
+{
+    const qint64 time = now();
+    PendingCommand pending;
+    pending.metrics.command = command;
+    pending.metrics.tag = tag;
+    pending.metrics.queueTime = time - m_jobReadySince.value(job, time);
+    pending.metrics.firstResponseTime = -1;
+    pending.job = job;
+    pending.sentAt = time;
+    pending.parseTime = 0;
+    m_pending.insert(tag, pending);
+    m_jobTags.insert(job, tag);
+    m_lastTag = tag;
+}
+
+void CommandTracker::dataSent(Job *job, qint64 bytes)
+{
+    //With pipelining the last command sent may be another job's already
+    auto it = m_pending.find(m_jobTags.value(job));
+    if (it != m_pending.end()) {
+        it->metrics.bytesOut += bytes;
+    }
+}
+
+QVector<CommandMetrics> CommandTracker::responsesReceived(const MessageRange &responses, qint64 parseTime,
+                                                          const std::function<Job *(const Message &)> &untaggedOwner)
+{
+    QVector<CommandMetrics> completed;
+    qint64 batchBytes = 0;
+    for (const Message &response : responses) {
+        batchBytes += response.size;
+    }
+
+    const qint64 time = now();
+    for (const Message &response : responses) {
+        if (response.content.isEmpty()) {
+            continue;
+        }
+        const Message::Slice &first = response.content[0].stringSlice();
+        const bool untagged = (first == "*");
+        QByteArray tag;
+        if (untagged) {
+            if (Job *job = untaggedOwner(response)) {
+                tag = m_jobTags.value(job);
+            }
+        } else if (first == "+") {
+            tag = m_lastTag;
+        } else {
+            tag = first.toByteArray();
+        }
+
+        auto it = m_pending.find(tag);
+        if (it == m_pending.end()) {
+            continue;
+        }
+        if (it->metrics.firstResponseTime < 0) {
+            it->metrics.firstResponseTime = time - it->sentAt;
+        }
+        it->metrics.bytesIn += response.size;
+        //We only know how long the whole batch took, so every response gets its share by size
+        if (batchBytes > 0) {
+            it->parseTime += parseTime * response.size / batchBytes;
+        }
+        if (untagged) {
+            it->metrics.untaggedResponses++;
+        } else if (first != "+") {
+            completed << complete(tag, response.content.size() >= 2 ? response.content[1].toString() : QByteArray());
+        }
+    }
+    return completed;
+}
+
+QVector<CommandMetrics> CommandTracker::connectionLost()
+{
+    QVector<CommandMetrics> lost;
+    foreach (const QByteArray &tag, m_pending.keys()) {
+        lost << complete(tag, QByteArray());
+    }
+    return lost;
+}
+
+CommandMetrics CommandTracker::complete(const QByteArray &tag, const QByteArray &result)
+{
+    const qint64 time = now();
+    const PendingCommand pending = m_pending.take(tag);
+    CommandMetrics metrics = pending.metrics;
+    metrics.result = result;
+    metrics.completionTime = time - pending.sentAt;
+    metrics.parseTime = pending.parseTime / 1000;
+
+    if (m_jobReadySince.contains(pending.job)) {
+        m_jobReadySince.insert(pending.job, time);
+    }
+    if (m_jobTags.value(pending.job) == tag) {
+        m_jobTags.remove(pending.job);
+    }
+    return metrics;
+}
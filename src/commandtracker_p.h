@@ -0,0 +1,94 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_COMMANDTRACKER_P_H
+#define KIMAP2_COMMANDTRACKER_P_H
+
+#include "commandmetrics.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
+
+#include <functional>
+
+namespace KIMAP2
+{
+
+class Job;
+struct Message;
+class MessageRange;
+
+/**
+ * Records the CommandMetrics of the commands sent by a session.
+ */
+class CommandTracker
+{
+public:
+    CommandTracker();
+
+    void jobQueued(Job *job);
+    void jobDone(Job *job);
+
+    /**
+     * Call before the command line is sent.
+     */
+    void commandSent(Job *job, const QByteArray &tag, const QByteArray &command);
+    /**
+     * Data that is sent by @p job is accounted to the last command the job sent.
+     */
+    void dataSent(Job *job, qint64 bytes);
+
+    /**
+     * Account a batch of responses that took @p parseTime nanoseconds to parse.
+     *
+     * @p untaggedOwner returns the job an untagged response belongs to.
+     * Returns the metrics of the commands that completed with this batch.
+     */
+    QVector<CommandMetrics> responsesReceived(const MessageRange &responses, qint64 parseTime,
+                                              const std::function<Job *(const Message &)> &untaggedOwner);
+
+    /**
+     * Returns the metrics of the commands that will never complete.
+     */
+    QVector<CommandMetrics> connectionLost();
+
+private:
+    struct PendingCommand {
+        CommandMetrics metrics;
+        Job *job;
+        qint64 sentAt;
+        qint64 parseTime;
+    };
+
+    qint64 now() const;
+    CommandMetrics complete(const QByteArray &tag, const QByteArray &result);
+
+    QElapsedTimer m_clock;
+    QHash<QByteArray, PendingCommand> m_pending;
+    //The last command sent by each job, untagged responses are accounted to it
+    QHash<Job *, QByteArray> m_jobTags;
+    //When each job was queued or its last command completed
+    QHash<Job *, qint64> m_jobReadySince;
+    QByteArray m_lastTag;
+};
+
+}
+
+#endif
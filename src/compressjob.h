@@ -0,0 +1,61 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef KIMAP2_COMPRESSJOB_H
+#define KIMAP2_COMPRESSJOB_H
+
+#include "kimap2_export.h"
+
+#include "job.h"
+
+namespace KIMAP2
+{
+
+class Session;
+class CompressJobPrivate;
+
+/**
+ * Enables compression of the session traffic.
+ *
+ * This job should be run once the session is authenticated,
+ * and requires the COMPRESS=DEFLATE capability (RFC 4978).
+ *
+ * Once the job succeeded all data that is sent and received
+ * is compressed with DEFLATE, which is transparent to all
+ * other jobs. Compression stays active until the connection
+ * is closed.
+ */
+class KIMAP2_EXPORT CompressJob : public Job
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(CompressJob)
+
+    friend class SessionPrivate;
+
+public:
+    explicit CompressJob(Session *session);
+    virtual ~CompressJob();
+
+protected:
+    void doStart() Q_DECL_OVERRIDE;
+};
+
+}
+
+#endif
@@ -116,7 +116,7 @@ void CopyJob::handleResponse(const Message &response)
 {
     Q_D(CopyJob);
 
-    for (QList<Message::Part>::ConstIterator it = response.responseCode.begin();
+    for (QVector<Message::Part>::ConstIterator it = response.responseCode.begin();
             it != response.responseCode.end(); ++it) {
         if (it->toString() == "COPYUID") {
             it = it + 3;
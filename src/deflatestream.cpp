@@ -0,0 +1,94 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "deflatestream.h"
+
+#include <zlib.h>
+
+using namespace KIMAP2;
+
+//RFC 4978 uses raw DEFLATE, negative window bits leave out the zlib header and checksum
+static const int s_windowBits = -15;
+static const int s_chunkSize = 16384;
+
+DeflateStream::DeflateStream(Direction direction)
+    : m_direction(direction),
+    m_stream(new z_stream),
+    m_error(false)
+{
+    m_stream->zalloc = Z_NULL;
+    m_stream->zfree = Z_NULL;
+    m_stream->opaque = Z_NULL;
+    m_stream->next_in = Z_NULL;
+    m_stream->avail_in = 0;
+    int result;
+    if (m_direction == Compress) {
+        result = deflateInit2(m_stream.data(), Z_DEFAULT_COMPRESSION, Z_DEFLATED, s_windowBits, 8, Z_DEFAULT_STRATEGY);
+    } else {
+        result = inflateInit2(m_stream.data(), s_windowBits);
+    }
+    m_error = (result != Z_OK);
+}
+
+DeflateStream::~DeflateStream()
+{
+    if (m_direction == Compress) {
+        deflateEnd(m_stream.data());
+    } else {
+        inflateEnd(m_stream.data());
+    }
+}
+
+QByteArray DeflateStream::process(const QByteArray &data)
+{
+    return process(data.constData(), data.size());
+}
+
+QByteArray DeflateStream::process(const char *data, int size)
+{
+    QByteArray result;
+    if (m_error || size <= 0) {
+        return result;
+    }
+    m_stream->next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data));
+    m_stream->avail_in = size;
+    //Keep going as long as the output fills up the space we provide, there may be more
+    do {
+        const int offset = result.size();
+        result.resize(offset + s_chunkSize);
+        m_stream->next_out = reinterpret_cast<Bytef *>(result.data() + offset);
+        m_stream->avail_out = s_chunkSize;
+        const int status = (m_direction == Compress) ? deflate(m_stream.data(), Z_SYNC_FLUSH) : inflate(m_stream.data(), Z_SYNC_FLUSH);
+        result.resize(offset + s_chunkSize - m_stream->avail_out);
+        //Z_BUF_ERROR only means that no progress was possible with the data we have
+        if (status != Z_OK && status != Z_BUF_ERROR && status != Z_STREAM_END) {
+            m_error = true;
+            break;
+        }
+        if (status == Z_STREAM_END) {
+            break;
+        }
+    } while (m_stream->avail_out == 0);
+    return result;
+}
+
+bool DeflateStream::error() const
+{
+    return m_error;
+}
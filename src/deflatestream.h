@@ -0,0 +1,68 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef KIMAP2_DEFLATESTREAM_H
+#define KIMAP2_DEFLATESTREAM_H
+
+#include "kimap2_export.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QScopedPointer>
+
+struct z_stream_s;
+
+namespace KIMAP2
+{
+
+/**
+  One direction of a raw DEFLATE stream, as used by the COMPRESS extension (RFC 4978).
+
+  The data passed to process() is a chunk of the stream. Compressed output is flushed
+  at the end of every chunk, so the peer can decompress everything written so far.
+*/
+class KIMAP2_EXPORT DeflateStream
+{
+public:
+    enum Direction {
+        Compress,
+        Decompress
+    };
+
+    explicit DeflateStream(Direction direction);
+    ~DeflateStream();
+
+    QByteArray process(const char *data, int size);
+    QByteArray process(const QByteArray &data);
+
+    /**
+     * Whether the stream is broken, e.g. because the received data is not valid DEFLATE data.
+     */
+    bool error() const;
+
+private:
+    Q_DISABLE_COPY(DeflateStream)
+
+    Direction m_direction;
+    QScopedPointer<z_stream_s> m_stream;
+    bool m_error;
+};
+
+}
+
+#endif
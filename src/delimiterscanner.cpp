@@ -0,0 +1,184 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "delimiterscanner_p.h"
+
+#include <string.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__) && defined(__SSE2__)
+#define KIMAP2_SCANNER_SSE2
+#define KIMAP2_SCANNER_AVX2
+#include <immintrin.h>
+#elif defined(_M_X64)
+#define KIMAP2_SCANNER_SSE2
+#include <emmintrin.h>
+#include <intrin.h>
+#endif
+
+using namespace KIMAP2;
+using namespace KIMAP2::DelimiterScanner;
+
+Delimiters::Delimiters(const char *delimiters)
+    : count(0)
+{
+    memset(table, 0, sizeof(table));
+    for (const char *c = delimiters; *c && count < MaxCount; c++) {
+        characters[count++] = *c;
+        table[static_cast<unsigned char>(*c)] = true;
+    }
+}
+
+static const char *findFirstOfScalar(const char *begin, const char *end, const Delimiters &delimiters)
+{
+    const char *p = begin;
+    while (p < end && !delimiters.table[static_cast<unsigned char>(*p)]) {
+        p++;
+    }
+    return p;
+}
+
+#ifdef KIMAP2_SCANNER_SSE2
+static inline int countTrailingZeros(unsigned int mask)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static const char *findFirstOfSse2(const char *begin, const char *end, const Delimiters &delimiters)
+{
+    __m128i needles[Delimiters::MaxCount];
+    for (int i = 0; i < delimiters.count; i++) {
+        needles[i] = _mm_set1_epi8(delimiters.characters[i]);
+    }
+    const char *p = begin;
+    while (end - p >= 16) {
+        const __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i matches = _mm_cmpeq_epi8(block, needles[0]);
+        for (int i = 1; i < delimiters.count; i++) {
+            matches = _mm_or_si128(matches, _mm_cmpeq_epi8(block, needles[i]));
+        }
+        const int mask = _mm_movemask_epi8(matches);
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 16;
+    }
+    return findFirstOfScalar(p, end, delimiters);
+}
+#endif
+
+#ifdef KIMAP2_SCANNER_AVX2
+__attribute__((target("avx2")))
+static const char *findFirstOfAvx2(const char *begin, const char *end, const Delimiters &delimiters)
+{
+    __m256i needles[Delimiters::MaxCount];
+    for (int i = 0; i < delimiters.count; i++) {
+        needles[i] = _mm256_set1_epi8(delimiters.characters[i]);
+    }
+    const char *p = begin;
+    while (end - p >= 32) {
+        const __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p));
+        __m256i matches = _mm256_cmpeq_epi8(block, needles[0]);
+        for (int i = 1; i < delimiters.count; i++) {
+            matches = _mm256_or_si256(matches, _mm256_cmpeq_epi8(block, needles[i]));
+        }
+        const unsigned int mask = _mm256_movemask_epi8(matches);
+        if (mask) {
+            return p + countTrailingZeros(mask);
+        }
+        p += 32;
+    }
+    return findFirstOfSse2(p, end, delimiters);
+}
+#endif
+
+static bool isSupported(Implementation implementation)
+{
+    switch (implementation) {
+    case Scalar:
+        return true;
+    case Sse2:
+#ifdef KIMAP2_SCANNER_SSE2
+        return true;
+#else
+        return false;
+#endif
+    case Avx2:
+#ifdef KIMAP2_SCANNER_AVX2
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+#else
+        return false;
+#endif
+    }
+    return false;
+}
+
+static Implementation bestImplementation()
+{
+    if (isSupported(Avx2)) {
+        return Avx2;
+    }
+    if (isSupported(Sse2)) {
+        return Sse2;
+    }
+    return Scalar;
+}
+
+static Implementation s_implementation = bestImplementation();
+
+const char *DelimiterScanner::findFirstOf(const char *begin, const char *end, const Delimiters &delimiters)
+{
+    if (delimiters.count == 1) {
+        const void *match = memchr(begin, delimiters.characters[0], end - begin);
+        return match ? static_cast<const char *>(match) : end;
+    }
+    switch (s_implementation) {
+#ifdef KIMAP2_SCANNER_AVX2
+    case Avx2:
+        return findFirstOfAvx2(begin, end, delimiters);
+#endif
+#ifdef KIMAP2_SCANNER_SSE2
+    case Sse2:
+        return findFirstOfSse2(begin, end, delimiters);
+#endif
+    default:
+        break;
+    }
+    return findFirstOfScalar(begin, end, delimiters);
+}
+
+Implementation DelimiterScanner::implementation()
+{
+    return s_implementation;
+}
+
+bool DelimiterScanner::setImplementation(Implementation implementation)
+{
+    if (!isSupported(implementation)) {
+        return false;
+    }
+    s_implementation = implementation;
+    return true;
+}
@@ -0,0 +1,81 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef KIMAP2_DELIMITERSCANNER_P_H
+#define KIMAP2_DELIMITERSCANNER_P_H
+
+#include "kimap2_export.h"
+
+namespace KIMAP2
+{
+
+/**
+ * Finds the next delimiter in a buffer.
+ *
+ * The parser spends most of its time skipping over the bytes of long atoms and quoted strings,
+ * so this is done with SSE2 or AVX2 where available. The implementation is chosen at runtime
+ * depending on what the CPU supports, with a table based scalar fallback.
+ */
+namespace DelimiterScanner
+{
+
+enum Implementation {
+    Scalar,
+    Sse2,
+    Avx2
+};
+
+/**
+ * A set of up to eight delimiter characters.
+ */
+class KIMAP2_EXPORT Delimiters
+{
+public:
+    enum { MaxCount = 8 };
+
+    explicit Delimiters(const char *delimiters);
+
+    char characters[MaxCount];
+    int count;
+    bool table[256];
+};
+
+/**
+ * Returns a pointer to the first byte in [@p begin, @p end) that is contained in @p delimiters,
+ * or @p end if there is none.
+ */
+KIMAP2_EXPORT const char *findFirstOf(const char *begin, const char *end, const Delimiters &delimiters);
+
+/**
+ * The implementation that is currently in use.
+ */
+KIMAP2_EXPORT Implementation implementation();
+
+/**
+ * Override the implementation, i.e. for benchmarks.
+ *
+ * @return false if the implementation is not supported by this CPU.
+ */
+KIMAP2_EXPORT bool setImplementation(Implementation);
+
+}
+
+}
+
+#endif
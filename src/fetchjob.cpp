@@ -26,6 +26,9 @@
 #include "message_p.h"
 #include "session_p.h"
 
+#include <QtCore/QIODevice>
+#include <QtCore/QMap>
+
 namespace KIMAP2
 {
 class FetchJobPrivate : public JobPrivate
@@ -36,16 +39,22 @@ public:
         , q(job)
         , uidBased(false)
         , avoidParsing(false)
-    { }
+        , contentThreshold(0)
+        , chunkSize(0)
+    {
+        pipelineResponses << "FETCH";
+    }
 
     ~FetchJobPrivate()
     { }
 
-    void parseBodyStructure(const QByteArray &structure, int &pos, KMime::Content *content);
-    void parsePart(const QByteArray &structure, int &pos, KMime::Content *content);
-    QByteArray parseString(const QByteArray &structure, int &pos);
-    QByteArray parseSentence(const QByteArray &structure, int &pos);
-    void skipLeadingSpaces(const QByteArray &structure, int &pos);
+    bool parseResult(const Message &response, FetchJob::Result &result);
+    void parseBodyStructure(const Message::Part &structure, KMime::Content *content);
+    void parsePart(const Message::Part &structure, KMime::Content *content);
+    void parseDisposition(const Message::Part &disposition, KMime::Content *content);
+    ImapSet takeChunk();
+    void sendNextChunk();
+    void handleResponses(const MessageRange &responses) Q_DECL_OVERRIDE;
 
     FetchJob *const q;
 
@@ -54,6 +63,17 @@ public:
     FetchJob::FetchScope scope;
     QString selectedMailBox;
     bool avoidParsing;
+    qint64 contentThreshold;
+    std::function<QIODevice *(qint64, const QByteArray &, qint64)> createContentDevice;
+    //The devices that receive streamed content, by sequence number and part id
+    QMap<QPair<qint64, QByteArray>, QIODevice *> streamedDevices;
+
+    int chunkSize;
+    //The command and the data items, set once the job started
+    QByteArray command;
+    QByteArray items;
+    //What is left to fetch after the current chunk
+    ImapSet remaining;
 };
 }
 
@@ -119,13 +139,33 @@ FetchJob::FetchScope FetchJob::scope() const
     return d->scope;
 }
 
+void FetchJob::setContentDevice(qint64 threshold, std::function<QIODevice *(qint64 sequenceNumber, const QByteArray &partId, qint64 size)> createDevice)
+{
+    Q_D(FetchJob);
+    d->contentThreshold = threshold;
+    d->createContentDevice = createDevice;
+}
+
+void FetchJob::setChunkSize(int count)
+{
+    Q_D(FetchJob);
+    d->chunkSize = count;
+}
+
 void FetchJob::doStart()
 {
     Q_D(FetchJob);
 
+    //The session paused us between two chunks
+    if (!d->command.isEmpty()) {
+        d->sendNextChunk();
+        return;
+    }
+
     d->set.optimize();
-    QByteArray parameters = d->set.toImapSequenceSet() + ' ';
-    Q_ASSERT(!parameters.trimmed().isEmpty());
+    Q_ASSERT(!d->set.isEmpty());
+    d->remaining = d->set;
+    QByteArray parameters;
 
     switch (d->scope.mode) {
     case FetchScope::Headers:
@@ -184,332 +224,368 @@ void FetchJob::doStart()
         parameters += " (CHANGEDSINCE " + QByteArray::number(d->scope.changedSince) + ")";
     }
 
-    QByteArray command = "FETCH";
+    d->command = "FETCH";
     if (d->uidBased) {
-        command = "UID " + command;
+        d->command = "UID " + d->command;
     }
+    d->items = parameters;
 
     d->selectedMailBox = d->m_session->selectedMailBox();
-    d->sendCommand(command, parameters);
+    d->sendNextChunk();
 }
 
-void FetchJob::handleResponse(const Message &response)
+ImapSet FetchJobPrivate::takeChunk()
 {
-    Q_D(FetchJob);
+    if (chunkSize <= 0) {
+        const ImapSet chunk = remaining;
+        remaining = ImapSet();
+        return chunk;
+    }
 
-    if (handleErrorReplies(response) == NotHandled) {
-        if (response.content.size() == 4 &&
-                response.content[2].toString() == "FETCH" &&
-                response.content[3].type() == Message::Part::List) {
-
-            const QList<QByteArray> content = response.content[3].toList();
-
-            Result result;
-            result.sequenceNumber = response.content[1].toString().toLongLong();
-            bool shouldParseMessage = false;
-            for (QList<QByteArray>::ConstIterator it = content.constBegin();
-                    it != content.constEnd(); ++it) {
-                QByteArray str = *it;
-                ++it;
-                if (it == content.constEnd()) {   // Uh oh, message was truncated?
-                    qCWarning(KIMAP2_LOG) << "FETCH reply got truncated, skipping.";
-                    qCWarning(KIMAP2_LOG) << response.toString();
-                    qCWarning(KIMAP2_LOG) << result.sequenceNumber;
-                    qCWarning(KIMAP2_LOG) << content;
-                    qCWarning(KIMAP2_LOG) << str;
-                    break;
+    ImapSet chunk;
+    ImapSet rest;
+    qint64 count = 0;
+    foreach (const ImapInterval &interval, remaining.intervals()) {
+        if (count >= chunkSize) {
+            rest.add(interval);
+        } else if (!interval.hasDefinedBegin() || !interval.hasDefinedEnd()) {
+            //The size of an open interval is unknown, it is a chunk of its own
+            if (count == 0) {
+                chunk.add(interval);
+                count = chunkSize;
+            } else {
+                rest.add(interval);
+            }
+        } else {
+            const qint64 size = qMin(interval.size(), qint64(chunkSize) - count);
+            chunk.add(ImapInterval(interval.begin(), interval.begin() + size - 1));
+            if (size < interval.size()) {
+                rest.add(ImapInterval(interval.begin() + size, interval.end()));
+            }
+            count += size;
+        }
+    }
+    remaining = rest;
+    return chunk;
+}
+
+void FetchJobPrivate::sendNextChunk()
+{
+    //Installed again for every chunk, the session drops it while the job is paused
+    if (createContentDevice && contentThreshold > 0) {
+        const bool streaming = sessionInternal()->setLiteralSink(q, contentThreshold, [this](const Message &response, const QByteArray &item, qint64 size) {
+            //Anything but message content is collected in memory as usual
+            if (response.content.size() < 3 || response.content[2].stringSlice() != "FETCH" ||
+                    !item.startsWith("BODY[") || !item.endsWith(']')) {     //krazy:exclude=strings
+                return std::function<void(const char *, int)>();
+            }
+            const qint64 sequenceNumber = response.content[1].toString().toLongLong();
+            const QByteArray partId = item.mid(5, item.size() - 6);
+            QIODevice *device = createContentDevice(sequenceNumber, partId, size);
+            if (!device) {
+                q->setError(KJob::UserDefinedError);
+                q->setErrorText(QString("No device to stream BODY[%1] of message %2 to.").arg(QLatin1String(partId)).arg(sequenceNumber));
+                return std::function<void(const char *, int)>([](const char *, int) {});
+            }
+            streamedDevices.insert(qMakePair(sequenceNumber, partId), device);
+            return std::function<void(const char *, int)>([device](const char *data, int size) {
+                device->write(data, size);
+            });
+        });
+        //Rather than silently keeping content in memory that was supposed to go to a device
+        if (!streaming) {
+            q->setError(KJob::UserDefinedError);
+            q->setErrorText(QStringLiteral("Content can't be streamed to a device with Session::WorkerThreadIo."));
+            q->emitResult();
+            return;
+        }
+    }
+
+    sendCommand(command, takeChunk().toImapSequenceSet() + ' ' + items);
+}
+
+bool FetchJobPrivate::parseResult(const Message &response, FetchJob::Result &result)
+{
+    if (response.content.size() != 4 ||
+            response.content[2].stringSlice() != "FETCH" ||
+            response.content[3].type() != Message::Part::List) {
+        return false;
+    }
+
+    const Message::PartRange content = response.content[3].children();
+
+    result.sequenceNumber = response.content[1].toString().toLongLong();
+    bool shouldParseMessage = false;
+    for (Message::PartRange::const_iterator it = content.constBegin();
+            it != content.constEnd(); ++it) {
+        QByteArray str = it->toString();
+        ++it;
+        if (it == content.constEnd()) {   // Uh oh, message was truncated?
+            qCWarning(KIMAP2_LOG) << "FETCH reply got truncated, skipping.";
+            qCWarning(KIMAP2_LOG) << response.toString();
+            qCWarning(KIMAP2_LOG) << result.sequenceNumber;
+            qCWarning(KIMAP2_LOG) << response.content[3].toList();
+            qCWarning(KIMAP2_LOG) << str;
+            break;
+        }
+
+        if (str == "UID") {
+            result.uid = it->toString().toLongLong();
+        } else if (str == "RFC822.SIZE") {
+            result.size = it->toString().toLongLong();
+        } else if (str == "INTERNALDATE") {
+            if (!result.message) {
+                result.message = MessagePtr(new KMime::Message);
+            }
+            result.message->date()->setDateTime(QDateTime::fromString(QLatin1String(it->toString()), Qt::RFC2822Date));
+        } else if (str == "FLAGS") {
+            if (it->type() == Message::Part::List) {
+                foreach (const Message::Part &flag, it->children()) {
+                    result.flags << flag.toString();
+                }
+            } else {
+                result.flags << it->toString();
+            }
+        } else if (str == "X-GM-LABELS") {
+            result.attributes << qMakePair<QByteArray, QVariant>("X-GM-LABELS", it->toString());
+        } else if (str == "X-GM-THRID") {
+            result.attributes << qMakePair<QByteArray, QVariant>("X-GM-THRID", it->toString());
+        } else if (str == "X-GM-MSGID") {
+            result.attributes << qMakePair<QByteArray, QVariant>("X-GM-MSGID", it->toString());
+        } else if (str == "BODYSTRUCTURE") {
+            if (!result.message) {
+                result.message = MessagePtr(new KMime::Message);
+            }
+            parseBodyStructure(*it, result.message.data());
+            result.message->assemble();
+        } else if (str.startsWith("BODY[")) {     //krazy:exclude=strings
+            if (!str.endsWith(']')) {     // BODY[ ... ] might have been split, skip until we find the ]
+                while (it != content.constEnd() && !it->toString().endsWith(']')) {
+                    ++it;
                 }
+            }
+
+            if (it->type() == Message::Part::String && it->stringSlice().isNull()) {
+                //The content went to a device instead of the message (or was dropped for lack of one)
+                const QByteArray partId = str.mid(5, str.size() - 6);
+                if (QIODevice *device = streamedDevices.take(qMakePair(result.sequenceNumber, partId))) {
+                    result.streamedParts.insert(partId, device);
+                }
+                continue;
+            }
 
-                if (str == "UID") {
-                    result.uid = it->toLongLong();
-                } else if (str == "RFC822.SIZE") {
-                    result.size = it->toLongLong();
-                } else if (str == "INTERNALDATE") {
+            const QByteArray value = it->toString();
+            int index;
+            if ((index = str.indexOf("HEADER")) > 0 || (index = str.indexOf("MIME")) > 0) {           // headers
+                if (str[index - 1] == '.') {
+                    QByteArray partId = str.mid(5, index - 6);
+                    if (!result.parts.contains(partId)) {
+                        result.parts[partId] = ContentPtr(new KMime::Content);
+                    }
+                    result.parts[partId]->setHead(value);
+                    result.parts[partId]->parse();
+                } else {
                     if (!result.message) {
                         result.message = MessagePtr(new KMime::Message);
                     }
-                    result.message->date()->setDateTime(QDateTime::fromString(QLatin1String(*it), Qt::RFC2822Date));
-                } else if (str == "FLAGS") {
-                    if ((*it).startsWith('(') && (*it).endsWith(')')) {
-                        QByteArray str = *it;
-                        str.chop(1);
-                        str.remove(0, 1);
-                        result.flags = str.split(' ');
-                    } else {
-                        result.flags << *it;
-                    }
-                } else if (str == "X-GM-LABELS") {
-                    result.attributes << qMakePair<QByteArray, QVariant>("X-GM-LABELS", *it);
-                } else if (str == "X-GM-THRID") {
-                    result.attributes << qMakePair<QByteArray, QVariant>("X-GM-THRID", *it);
-                } else if (str == "X-GM-MSGID") {
-                    result.attributes << qMakePair<QByteArray, QVariant>("X-GM-MSGID", *it);
-                } else if (str == "BODYSTRUCTURE") {
+                    shouldParseMessage = true;
+                    result.message->setHead(value);
+                }
+            } else { // full payload
+                if (str == "BODY[]") {
                     if (!result.message) {
                         result.message = MessagePtr(new KMime::Message);
                     }
-                    int pos = 0;
-                    d->parseBodyStructure(*it, pos, result.message.data());
-                    result.message->assemble();
-                } else if (str.startsWith("BODY[")) {     //krazy:exclude=strings
-                    if (!str.endsWith(']')) {     // BODY[ ... ] might have been split, skip until we find the ]
-                        while (it != content.constEnd() && !(*it).endsWith(']')) {
-                            ++it;
-                        }
-                    }
-
-                    int index;
-                    if ((index = str.indexOf("HEADER")) > 0 || (index = str.indexOf("MIME")) > 0) {           // headers
-                        if (str[index - 1] == '.') {
-                            QByteArray partId = str.mid(5, index - 6);
-                            if (!result.parts.contains(partId)) {
-                                result.parts[partId] = ContentPtr(new KMime::Content);
-                            }
-                            result.parts[partId]->setHead(*it);
-                            result.parts[partId]->parse();
-                        } else {
-                            if (!result.message) {
-                                result.message = MessagePtr(new KMime::Message);
-                            }
-                            shouldParseMessage = true;
-                            result.message->setHead(*it);
-                        }
-                    } else { // full payload
-                        if (str == "BODY[]") {
-                            if (!result.message) {
-                                result.message = MessagePtr(new KMime::Message);
-                            }
-                            shouldParseMessage = true;
-                            result.message->setContent(KMime::CRLFtoLF(*it));
-                        } else {
-                            QByteArray partId = str.mid(5, str.size() - 6);
-                            if (!result.parts.contains(partId)) {
-                                result.parts[partId] = ContentPtr(new KMime::Content);
-                            }
-                            result.parts[partId]->setBody(*it);
-                            result.parts[partId]->parse();
-                        }
+                    shouldParseMessage = true;
+                    result.message->setContent(KMime::CRLFtoLF(value));
+                } else {
+                    QByteArray partId = str.mid(5, str.size() - 6);
+                    if (!result.parts.contains(partId)) {
+                        result.parts[partId] = ContentPtr(new KMime::Content);
                     }
+                    result.parts[partId]->setBody(value);
+                    result.parts[partId]->parse();
                 }
             }
-
-            if (result.message && shouldParseMessage && !d->avoidParsing) {
-                result.message->parse();
-            }
-            emit resultReceived(result);
         }
     }
+
+    if (result.message && shouldParseMessage && !avoidParsing) {
+        result.message->parse();
+    }
+    return true;
 }
 
-void FetchJobPrivate::parseBodyStructure(const QByteArray &structure, int &pos, KMime::Content *content)
+void FetchJob::handleResponse(const Message &response)
 {
-    skipLeadingSpaces(structure, pos);
+    Q_D(FetchJob);
 
-    if (structure[pos] != '(') {
+    //A chunk completed, the next one may have to wait for a job of higher priority
+    if (!d->remaining.isEmpty() && response.content.size() >= 2
+            && d->tags.contains(response.content[0].toString()) && response.content[1].toString() == "OK") {
+        d->tags.removeAll(response.content[0].toString());
+        if (!d->sessionInternal()->pauseForPriorityJob(this)) {
+            d->sendNextChunk();
+        }
         return;
     }
 
-    pos++;
-
-    if (structure[pos] != '(') {   // simple part
-        pos--;
-        parsePart(structure, pos, content);
-    } else { // multi part
-        content->contentType()->setMimeType("MULTIPART/MIXED");
-        while (pos < structure.size() && structure[pos] == '(') {
-            KMime::Content *child = new KMime::Content;
-            content->addContent(child);
-            parseBodyStructure(structure, pos, child);
-            child->assemble();
-        }
-
-        QByteArray subType = parseString(structure, pos);
-        content->contentType()->setMimeType("MULTIPART/" + subType);
-
-        QByteArray parameters = parseSentence(structure, pos);   // FIXME: Read the charset
-        if (parameters.contains("BOUNDARY")) {
-            content->contentType()->setBoundary(parameters.remove(0, parameters.indexOf("BOUNDARY") + 11).split('\"')[0]);
+    if (handleErrorReplies(response) == NotHandled) {
+        Result result;
+        if (d->parseResult(response, result)) {
+            emit resultReceived(result);
+            emit resultsReceived(QVector<Result>() << result);
         }
+    }
+}
 
-        QByteArray disposition = parseSentence(structure, pos);
-        if (disposition.contains("INLINE")) {
-            content->contentDisposition()->setDisposition(KMime::Headers::CDinline);
-        } else if (disposition.contains("ATTACHMENT")) {
-            content->contentDisposition()->setDisposition(KMime::Headers::CDattachment);
+void FetchJobPrivate::handleResponses(const MessageRange &responses)
+{
+    //Untagged responses can't be error replies, so we can go straight to the results
+    QVector<FetchJob::Result> results;
+    results.reserve(responses.size());
+    for (const Message &response : responses) {
+        FetchJob::Result result;
+        if (parseResult(response, result)) {
+            results << result;
         }
-
-        parseSentence(structure, pos);   // Ditch the body language
     }
-
-    // Consume what's left
-    while (pos < structure.size() && structure[pos] != ')') {
-        skipLeadingSpaces(structure, pos);
-        parseSentence(structure, pos);
-        skipLeadingSpaces(structure, pos);
+    if (results.isEmpty()) {
+        return;
     }
-
-    pos++;
+    for (const FetchJob::Result &result : results) {
+        emit q->resultReceived(result);
+    }
+    emit q->resultsReceived(results);
 }
 
-void FetchJobPrivate::parsePart(const QByteArray &structure, int &pos, KMime::Content *content)
+// Strings in a body structure are either quoted or NIL
+static QByteArray structureString(const Message::Part &part)
 {
-    if (structure[pos] != '(') {
-        return;
+    if (part.type() != Message::Part::String) {
+        return QByteArray();
     }
-
-    pos++;
-
-    QByteArray mainType = parseString(structure, pos);
-    QByteArray subType = parseString(structure, pos);
-
-    content->contentType()->setMimeType(mainType + '/' + subType);
-
-    parseSentence(structure, pos);   // Ditch the parameters... FIXME: Read it to get charset and name
-    parseString(structure, pos);   // ... and the id
-
-    content->contentDescription()->from7BitString(parseString(structure, pos));
-
-    parseString(structure, pos);   // Ditch the encoding too
-    parseString(structure, pos);   // ... and the size
-    parseString(structure, pos);   // ... and the line count
-
-    QByteArray disposition = parseSentence(structure, pos);
-    if (disposition.contains("INLINE")) {
-        content->contentDisposition()->setDisposition(KMime::Headers::CDinline);
-    } else if (disposition.contains("ATTACHMENT")) {
-        content->contentDisposition()->setDisposition(KMime::Headers::CDattachment);
+    QByteArray result = part.toString();
+    if (result == "NIL") {
+        return QByteArray();
     }
-    if ((content->contentDisposition()->disposition() == KMime::Headers::CDattachment ||
-            content->contentDisposition()->disposition() == KMime::Headers::CDinline) &&
-            disposition.contains("FILENAME")) {
-        QByteArray filename = disposition.remove(0, disposition.indexOf("FILENAME") + 11).split('\"')[0];
-        content->contentDisposition()->setFilename(QLatin1String(filename));
+    // simplify slashes
+    if (result.contains('\\')) {
+        result.replace("\\\"", "\"");
+        result.replace("\\\\", "\\");
     }
+    return result;
+}
+
+static bool structureKeyEquals(const Message::Part &part, const char *key)
+{
+    const Message::Slice &string = part.stringSlice();
+    return part.type() == Message::Part::String &&
+           string.size() == int(qstrlen(key)) &&
+           !qstrnicmp(string.constData(), key, string.size());
+}
 
-    // Consume what's left
-    while (pos < structure.size() && structure[pos] != ')') {
-        skipLeadingSpaces(structure, pos);
-        parseSentence(structure, pos);
-        skipLeadingSpaces(structure, pos);
+// Looks up a value in a list of attribute/value pairs, e.g. ("CHARSET" "ISO-8859-1" "NAME" "foo")
+static QByteArray structureParameter(const Message::Part &parameters, const char *name)
+{
+    const Message::PartRange items = parameters.children();
+    for (int i = 0; i + 1 < items.size(); i += 2) {
+        if (structureKeyEquals(items.at(i), name)) {
+            return structureString(items.at(i + 1));
+        }
     }
+    return QByteArray();
 }
 
-QByteArray FetchJobPrivate::parseSentence(const QByteArray &structure, int &pos)
+void FetchJobPrivate::parseBodyStructure(const Message::Part &structure, KMime::Content *content)
 {
-    QByteArray result;
-    int stack = 0;
+    const Message::PartRange items = structure.children();
+    if (structure.type() != Message::Part::List || items.isEmpty()) {
+        return;
+    }
 
-    skipLeadingSpaces(structure, pos);
+    if (items.first().type() == Message::Part::String) {   // simple part
+        parsePart(structure, content);
+        return;
+    }
 
-    if (structure[pos] != '(') {
-        return parseString(structure, pos);
+    // multi part
+    content->contentType()->setMimeType("MULTIPART/MIXED");
+    int i = 0;
+    for (; i < items.size() && items.at(i).type() == Message::Part::List; i++) {
+        KMime::Content *child = new KMime::Content;
+        content->addContent(child);
+        parseBodyStructure(items.at(i), child);
+        child->assemble();
     }
 
-    int start = pos;
+    const QByteArray subType = i < items.size() ? structureString(items.at(i++)) : QByteArray();
+    content->contentType()->setMimeType("MULTIPART/" + subType);
 
-    do {
-        switch (structure[pos]) {
-        case '(':
-            pos++;
-            stack++;
-            break;
-        case ')':
-            pos++;
-            stack--;
-            break;
-        case '[':
-            pos++;
-            stack++;
-            break;
-        case ']':
-            pos++;
-            stack--;
-            break;
-        default:
-            skipLeadingSpaces(structure, pos);
-            parseString(structure, pos);
-            skipLeadingSpaces(structure, pos);
-            break;
+    if (i < items.size()) {
+        // FIXME: Read the charset
+        const QByteArray boundary = structureParameter(items.at(i++), "BOUNDARY");
+        if (!boundary.isEmpty()) {
+            content->contentType()->setBoundary(boundary);
         }
-    } while (pos < structure.size() && stack != 0);
+    }
 
-    result = structure.mid(start, pos - start);
+    if (i < items.size()) {
+        parseDisposition(items.at(i++), content);
+    }
 
-    return result;
+    // Ditch the body language and whatever extension data follows
 }
 
-QByteArray FetchJobPrivate::parseString(const QByteArray &structure, int &pos)
+void FetchJobPrivate::parsePart(const Message::Part &structure, KMime::Content *content)
 {
-    QByteArray result;
-
-    skipLeadingSpaces(structure, pos);
+    const Message::PartRange items = structure.children();
 
-    int start = pos;
-    bool foundSlash = false;
-
-    // quoted string
-    if (structure[pos] == '"') {
-        pos++;
-        Q_FOREVER {
-        if (structure[pos] == '\\')
-            {
-                pos += 2;
-                foundSlash = true;
-                continue;
-            }
-            if (structure[pos] == '"')
-            {
-                result = structure.mid(start + 1, pos - start - 1);
-                pos++;
-                break;
-            }
-            pos++;
-        }
-    } else { // unquoted string
-        Q_FOREVER {
-        if (structure[pos] == ' ' ||
-            structure[pos] == '(' ||
-            structure[pos] == ')' ||
-            structure[pos] == '[' ||
-            structure[pos] == ']' ||
-            structure[pos] == '\n' ||
-            structure[pos] == '\r' ||
-            structure[pos] == '"')
-            {
-                break;
-            }
-            if (structure[pos] == '\\')
-            {
-                foundSlash = true;
-            }
-            pos++;
-        }
-
-        result = structure.mid(start, pos - start);
+    const QByteArray mainType = items.size() > 0 ? structureString(items.at(0)) : QByteArray();
+    const QByteArray subType = items.size() > 1 ? structureString(items.at(1)) : QByteArray();
+    content->contentType()->setMimeType(mainType + '/' + subType);
 
-        // transform unquoted NIL
-        if (result == "NIL") {
-            result.clear();
-        }
+    // Ditch the parameters... FIXME: Read it to get charset and name
+    // ... and the id
+    if (items.size() > 4) {
+        content->contentDescription()->from7BitString(structureString(items.at(4)));
     }
 
-    // simplify slashes
-    if (foundSlash) {
-        while (result.contains("\\\"")) {
-            result.replace("\\\"", "\"");
-        }
-        while (result.contains("\\\\")) {
-            result.replace("\\\\", "\\");
-        }
+    // Ditch the encoding and the size too.
+    // Text parts are followed by their line count, message/rfc822 parts by the envelope,
+    // body structure and line count of the enclosed message, before the extension data
+    // starts with the MD5 sum and the disposition.
+    int md5Index = 7;
+    if (!qstricmp(mainType.constData(), "TEXT")) {
+        md5Index += 1;
+    } else if (!qstricmp(mainType.constData(), "MESSAGE") && !qstricmp(subType.constData(), "RFC822")) {
+        md5Index += 3;
+    }
+    if (md5Index + 1 < items.size()) {
+        parseDisposition(items.at(md5Index + 1), content);
     }
-
-    return result;
 }
 
-void FetchJobPrivate::skipLeadingSpaces(const QByteArray &structure, int &pos)
+void FetchJobPrivate::parseDisposition(const Message::Part &disposition, KMime::Content *content)
 {
-    while (pos < structure.size() && structure[pos] == ' ') {
-        pos++;
+    const Message::PartRange items = disposition.children();
+    if (disposition.type() != Message::Part::List || items.isEmpty()) {
+        return;
+    }
+
+    if (structureKeyEquals(items.first(), "INLINE")) {
+        content->contentDisposition()->setDisposition(KMime::Headers::CDinline);
+    } else if (structureKeyEquals(items.first(), "ATTACHMENT")) {
+        content->contentDisposition()->setDisposition(KMime::Headers::CDattachment);
+    } else {
+        return;
+    }
+
+    if (items.size() > 1) {
+        const QByteArray filename = structureParameter(items.at(1), "FILENAME");
+        if (!filename.isEmpty()) {
+            content->contentDisposition()->setFilename(QLatin1String(filename));
+        }
     }
 }
 
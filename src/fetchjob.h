@@ -29,6 +29,12 @@
 #include <kmime/kmime_content.h>
 #include <kmime/kmime_message.h>
 
+#include <QtCore/QVector>
+
+#include <functional>
+
+class QIODevice;
+
 namespace KIMAP2
 {
 
@@ -193,6 +199,12 @@ public:
         KIMAP2::MessagePtr message;
         KIMAP2::MessageParts parts;
         KIMAP2::MessageAttributes attributes;
+        /**
+         * Devices that received streamed content, by part id (empty for BODY[]).
+         *
+         * @see FetchJob::setContentDevice()
+         */
+        QMap<QByteArray, QIODevice *> streamedParts;
     };
 
     explicit FetchJob(Session *session);
@@ -248,8 +260,34 @@ public:
      */
     void setAvoidParsing(bool);
 
+    /**
+     * Stream message content larger than @p threshold bytes to a device instead of keeping it in memory.
+     *
+     * @p createDevice is called for every such BODY[] section before its data arrives, with the
+     * sequence number of the message, the part id (empty for BODY[]) and the size of the content.
+     * It returns the (open) device the data is written to, the job does not take ownership of it.
+     * If no device is returned the content is dropped and the job fails.
+     * A session with Session::WorkerThreadIo can't stream content, the job fails right away.
+     * Streamed content is not parsed, the device is reported in Result::streamedParts instead.
+     */
+    void setContentDevice(qint64 threshold, std::function<QIODevice *(qint64 sequenceNumber, const QByteArray &partId, qint64 size)> createDevice);
+
+    /**
+     * Fetch at most @p count messages per command, 0 (the default) fetches the whole set at once.
+     *
+     * Between two chunks the session may run a job of higher priority first, see Job::setPriority().
+     * An interval that is open to the end (e.g. "100:*") is fetched as one chunk, since its size is not known.
+     */
+    void setChunkSize(int count);
+
 Q_SIGNALS:
     void resultReceived(const Result &);
+    /**
+     * All results that arrived with one read from the socket.
+     *
+     * Emitted after resultReceived() has been emitted for each of them.
+     */
+    void resultsReceived(const QVector<Result> &);
 
 protected:
     void doStart() Q_DECL_OVERRIDE;
@@ -141,10 +141,10 @@ void GetMetaDataJob::handleResponse(const Message &response)
                 int i = 3;
                 while (i < response.content.size() - 1) {
                     QByteArray entry = response.content[i].toString();
-                    QList<QByteArray> attributes = response.content[i + 1].toList();
+                    const Message::PartRange attributes = response.content[i + 1].children();
                     int j = 0;
                     while (j < attributes.size() - 1) {
-                        d->metadata[mailBox][entry][attributes[j]] = attributes[j + 1];
+                        d->metadata[mailBox][entry][attributes[j].toString()] = attributes[j + 1].toString();
                         j += 2;
                     }
                     i += 2;
@@ -152,11 +152,11 @@ void GetMetaDataJob::handleResponse(const Message &response)
             } else if (d->serverCapability == Metadata && response.content[1].toString() == "METADATA") {
                 QString mailBox = QString::fromUtf8(KIMAP2::decodeImapFolderName(response.content[2].toString()));
 
-                const QList<QByteArray> &entries = response.content[3].toList();
+                const Message::PartRange entries = response.content[3].children();
                 int i = 0;
                 while (i < entries.size() - 1) {
-                    const QByteArray &value = entries[i + 1];
-                    QByteArray &targetValue = d->metadata[mailBox][entries[i]][""];
+                    const QByteArray value = entries[i + 1].toString();
+                    QByteArray &targetValue = d->metadata[mailBox][entries[i].toString()][""];
                     if (value != "NIL") {   //This just indicates no value
                         targetValue = value;
                     }
@@ -34,7 +34,8 @@ public:
         : JobPrivate(session, name), q(job),
           messageCount(-1), recentCount(-1),
           lastMessageCount(-1), lastRecentCount(-1),
-          originalSocketTimeout(-1) { }
+          originalSocketTimeout(-1),
+          idling(false), stopRequested(false) { }
     ~IdleJobPrivate() { }
 
     void emitStats()
@@ -67,6 +68,10 @@ public:
     int lastRecentCount;
 
     int originalSocketTimeout;
+
+    //DONE can only be sent once the server accepted the IDLE command
+    bool idling;
+    bool stopRequested;
 };
 }
 
@@ -90,8 +95,14 @@ IdleJob::~IdleJob()
 void KIMAP2::IdleJob::stop()
 {
     Q_D(IdleJob);
+    if (d->stopRequested) {
+        return;
+    }
+    d->stopRequested = true;
     d->sessionInternal()->setSocketTimeout(d->originalSocketTimeout);
-    d->sessionInternal()->sendData("DONE");
+    if (d->idling) {
+        d->sessionInternal()->sendData(this, "DONE");
+    }
 }
 
 void IdleJob::doStart()
@@ -119,6 +130,10 @@ void IdleJob::handleResponse(const Message &response)
     if (handleErrorReplies(response) == NotHandled) {
         if (response.content.size() > 0 && response.content[0].toString() == "+") {
             // Got the continuation all is fine
+            d->idling = true;
+            if (d->stopRequested) {
+                d->sessionInternal()->sendData(this, "DONE");
+            }
             return;
 
         } else if (response.content.size() > 2) {
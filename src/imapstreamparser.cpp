@@ -24,12 +24,325 @@
 */
 
 #include "imapstreamparser.h"
+#include "deflatestream.h"
+#include "delimiterscanner_p.h"
 
 #include <QIODevice>
 #include <QDebug>
 
 using namespace KIMAP2;
 
+/**
+ * Assembles a Message from the token events of the parser.
+ */
+class ImapStreamParser::MessageBuilder
+{
+public:
+    MessageBuilder(ImapStreamParser *parser, std::function<void(const Message &)> responseReceived,
+                   std::function<void(const MessageRange &)> responsesReceived)
+        : m_parser(parser),
+        m_responseReceived(responseReceived),
+        m_responsesReceived(responsesReceived),
+        m_batchSize(0),
+        m_responseStart(0),
+        m_hasMessage(false),
+        m_currentPayload(nullptr),
+        m_depth(0),
+        m_sublistArenaStart(0),
+        m_literalSize(0)
+    {
+    }
+
+    void string(const char *data, int size)
+    {
+        addToken(m_parser->slice(data, size));
+    }
+
+    void listStart()
+    {
+        if (m_depth == m_lists.size()) {
+            m_lists.append(QVector<Message::Part>());
+        } else {
+            m_lists[m_depth].clear();
+        }
+        m_depth++;
+        if (m_depth == 2) {
+            m_sublistArenaStart = m_message.arena ? m_message.arena->parts.size() : 0;
+        }
+    }
+
+    void listEnd()
+    {
+        ensureMessage();
+        Q_ASSERT(m_depth > 0);
+        m_depth--;
+        //The items of a list are only complete once it is closed, so that's when they move to the arena
+        if (!m_message.arena) {
+            m_message.arena = new Message::Arena;
+        }
+        QVector<Message::Part> &parts = m_message.arena->parts;
+        const QVector<Message::Part> &items = m_lists.at(m_depth);
+        const int first = parts.size();
+        parts += items;
+        if (m_depth == 0) {
+            *m_currentPayload << Message::Part(m_message.arena.data(), first, items.size());
+        } else {
+            const Message::Slice text = m_parser->sublistText();
+            m_lists[m_depth - 1] << Message::Part(m_message.arena.data(), first, items.size(), text);
+            if (m_depth == 1 && !m_parser->m_zeroCopy) {
+                //The lists inside of this one were stored after it opened, they get their text from this copy
+                for (int i = m_sublistArenaStart; i < parts.size(); i++) {
+                    parts[i].resolveText(text);
+                }
+            }
+        }
+    }
+
+    void responseCodeStart()
+    {
+        ensureMessage();
+        m_currentPayload = &m_message.responseCode;
+    }
+
+    void responseCodeEnd()
+    {
+        ensureMessage();
+        m_currentPayload = &m_message.content;
+    }
+
+    void literalStart(qint64 size)
+    {
+        m_literalSize = size;
+        m_literalData.clear();
+        m_literalToken = Message::Slice();
+        m_literalSink = nullptr;
+        if (m_parser->m_literalThreshold > 0 && size > m_parser->m_literalThreshold && m_parser->m_createLiteralSink) {
+            m_literalSink = m_parser->m_createLiteralSink(m_message, precedingToken(), size);
+        }
+    }
+
+    void literalPart(const char *data, int size)
+    {
+        if (m_literalSink) {
+            m_literalSink(data, size);
+        } else if (m_literalData.isEmpty() && size == m_literalSize) {
+            //The complete literal is in the receive buffer, so it can be handed out like any other token
+            m_literalToken = m_parser->slice(data, size);
+        } else {
+            if (m_literalData.isEmpty()) {
+                m_literalData.reserve(m_literalSize);
+            }
+            m_literalData.append(data, size);
+        }
+    }
+
+    void literalEnd()
+    {
+        if (m_literalSink) {
+            //The data went to the sink, the message only gets a placeholder
+            m_literalSink = nullptr;
+            addToken(Message::Slice());
+        } else if (!m_literalToken.isNull()) {
+            addToken(m_literalToken);
+            m_literalToken = Message::Slice();
+        } else {
+            //The literal has been collected in its own buffer, so we can hand it over as it is.
+            //An empty literal must not be confused with the placeholder of a streamed one.
+            addToken(Message::Slice(m_literalData.isNull() ? QByteArray("") : m_literalData));
+        }
+        m_literalData = QByteArray();
+    }
+
+    void lineEnd()
+    {
+        //Don't let a broken list leak into the next response
+        m_depth = 0;
+        clearLists();
+        //The parser is at the LF that ends the response
+        const qint64 responseEnd = m_parser->m_discardedBytes + m_parser->m_position + 1;
+        if (m_hasMessage) {
+            m_hasMessage = false;
+            m_message.size = responseEnd - m_responseStart;
+            if (m_responsesReceived) {
+                //Park the message in the batch, and continue with the storage of one delivered earlier
+                if (m_batchSize == m_batch.size()) {
+                    m_batch.append(Message());
+                }
+                qSwap(m_batch[m_batchSize], m_message);
+                m_batchSize++;
+            } else {
+                m_responseReceived(m_message);
+            }
+            recycle(m_message);
+        }
+        m_currentPayload = nullptr;
+        m_responseStart = responseEnd;
+    }
+
+    /**
+     * Delivers the responses that have been completed since the last call, if batching.
+     */
+    void flush()
+    {
+        if (!m_batchSize) {
+            return;
+        }
+        const int size = m_batchSize;
+        m_batchSize = 0;
+        m_responsesReceived(MessageRange(m_batch.constData(), size));
+        for (int i = 0; i < size; i++) {
+            recycle(m_batch[i]);
+        }
+    }
+
+private:
+    void ensureMessage()
+    {
+        if (!m_hasMessage) {
+            //We just assume that we always get a string first
+            m_hasMessage = true;
+            m_currentPayload = &m_message.content;
+        }
+    }
+
+    /**
+     * Prepares a delivered message for the next response.
+     *
+     * Unless the consumer kept a copy, the storage of the message is reused,
+     * so that parsing a response typically doesn't allocate at all.
+     */
+    void recycle(Message &message)
+    {
+        //Messages are also recycled between reads, when the lists of the next response may already be open
+        if (m_depth == 0) {
+            clearLists();
+        }
+        //QVector::clear() keeps the capacity
+        if (message.content.isDetached()) {
+            message.content.clear();
+        } else {
+            message.content = QVector<Message::Part>();
+        }
+        if (message.responseCode.isDetached()) {
+            message.responseCode.clear();
+        } else {
+            message.responseCode = QVector<Message::Part>();
+        }
+        if (message.arena) {
+            if (message.arena->ref.load() == 1) {
+                message.arena->parts.clear();
+            } else {
+                message.arena.reset();
+            }
+        }
+        message.size = 0;
+    }
+
+    QByteArray precedingToken() const
+    {
+        const QVector<Message::Part> *tokens = m_depth > 0 ? &m_lists.at(m_depth - 1) : m_currentPayload;
+        if (!tokens || tokens->isEmpty() || tokens->last().type() != Message::Part::String) {
+            return QByteArray();
+        }
+        return tokens->last().toString();
+    }
+
+    /**
+     * Drops the items of the lists, which may refer to the receive buffer, but keeps their capacity.
+     */
+    void clearLists()
+    {
+        for (int i = 0; i < m_lists.size(); i++) {
+            m_lists[i].clear();
+        }
+    }
+
+    void addToken(const Message::Slice &token)
+    {
+        ensureMessage();
+        if (m_depth > 0) {
+            m_lists[m_depth - 1] << Message::Part(token);
+        } else {
+            *m_currentPayload << Message::Part(token);
+        }
+    }
+
+    ImapStreamParser *const m_parser;
+    std::function<void(const Message &)> m_responseReceived;
+    std::function<void(const MessageRange &)> m_responsesReceived;
+    //Completed responses waiting for flush(), followed by recycled ones
+    QVector<Message> m_batch;
+    int m_batchSize;
+    //Where the current response starts, counted from the beginning of the stream
+    qint64 m_responseStart;
+    //Reused for every response
+    Message m_message;
+    bool m_hasMessage;
+    QVector<Message::Part> *m_currentPayload;
+    //The items of the lists that are currently open, the innermost one at m_depth - 1.
+    //Kept across responses so their capacity can be reused.
+    QVector<QVector<Message::Part> > m_lists;
+    int m_depth;
+    //The size of the arena when the outermost nested list opened
+    int m_sublistArenaStart;
+    qint64 m_literalSize;
+    QByteArray m_literalData;
+    Message::Slice m_literalToken;
+    LiteralSink m_literalSink;
+};
+
+/**
+ * Dispatches the events to the handlers that have been set at runtime.
+ */
+class ImapStreamParser::EventHandler
+{
+public:
+    explicit EventHandler(ImapStreamParser *parser)
+        : m_parser(parser)
+    {
+    }
+
+    inline void string(const char *data, int size)
+    {
+        m_parser->string(data, size);
+    }
+    inline void listStart()
+    {
+        m_parser->listStart();
+    }
+    inline void listEnd()
+    {
+        m_parser->listEnd();
+    }
+    inline void responseCodeStart()
+    {
+        m_parser->responseCodeStart();
+    }
+    inline void responseCodeEnd()
+    {
+        m_parser->responseCodeEnd();
+    }
+    inline void literalStart(qint64 size)
+    {
+        m_parser->literalStart(size);
+    }
+    inline void literalPart(const char *data, int size)
+    {
+        m_parser->literalPart(data, size);
+    }
+    inline void literalEnd()
+    {
+        m_parser->literalEnd();
+    }
+    inline void lineEnd()
+    {
+        m_parser->lineEnd();
+    }
+
+private:
+    ImapStreamParser *const m_parser;
+};
+
 ImapStreamParser::ImapStreamParser(QIODevice *socket, bool serverModeEnabled)
     : m_socket(socket),
     m_isServerModeEnabled(serverModeEnabled),
@@ -37,18 +350,44 @@ ImapStreamParser::ImapStreamParser(QIODevice *socket, bool serverModeEnabled)
     m_position(0),
     m_readPosition(0),
     m_literalSize(0),
-    m_bufferSize(16000),
+    m_bufferSize(s_initialBufferSize),
     m_currentState(InitState),
     m_listCounter(0),
-    m_stringStartPos(0),
+    m_stringStartPos(-1),
+    m_commandStartPos(serverModeEnabled ? 0 : -1),
     m_readingLiteral(false),
+    m_nonSynchronizingLiteral(false),
     m_error(false),
-    m_list(nullptr)
+    m_zeroCopy(false),
+    m_builderHandlesEvents(false),
+    m_staticDispatchEnabled(true),
+    m_literalThreshold(0),
+    m_trimCount(0),
+    m_trimmedBytes(0),
+    m_bufferAllocations(0),
+    m_discardedBytes(0),
+    m_parseTimingEnabled(false),
+    m_parseTime(0),
+    m_inflatedPos(0)
 {
     m_data1.resize(m_bufferSize);
     m_data2.resize(m_bufferSize);
     m_current = &m_data1;
-    setupCallbacks();
+
+    //Events nobody is interested in are simply dropped
+    onString([](const char *, int) {});
+    onListStart([]() {});
+    onListEnd([]() {});
+    onResponseCodeStart([]() {});
+    onResponseCodeEnd([]() {});
+    onLiteralStart([](qint64) {});
+    onLiteralPart([](const char *, int) {});
+    onLiteralEnd([]() {});
+    onLineEnd([]() {});
+}
+
+ImapStreamParser::~ImapStreamParser()
+{
 }
 
 QByteArray &ImapStreamParser::buffer()
@@ -66,6 +405,37 @@ char ImapStreamParser::at(int pos) const
     return m_current->constData()[pos];
 }
 
+char *ImapStreamParser::writePosition()
+{
+    //We only ever write behind m_readPosition, which is never part of a token that has been handed out,
+    //so we can write to the buffer without detaching it from the slices that still refer to it.
+    return const_cast<char *>(buffer().constData()) + m_readPosition;
+}
+
+Message::Slice ImapStreamParser::slice(const char *data, int size) const
+{
+    if (m_zeroCopy) {
+        const quintptr begin = quintptr(buffer().constData());
+        const quintptr start = quintptr(data);
+        if (start >= begin && start + size <= begin + buffer().size()) {
+            return Message::Slice(buffer(), start - begin, size);
+        }
+    }
+    return Message::Slice(QByteArray(data, size));
+}
+
+Message::Slice ImapStreamParser::sublistText() const
+{
+    Q_ASSERT(!m_sublistStarts.isEmpty());
+    const int start = m_sublistStarts.last();
+    //Without zero-copy only the outermost nested list is copied, so that deep nesting doesn't copy
+    //the same text over and over. The lists inside it get a placeholder relative to its start.
+    if (!m_zeroCopy && m_sublistStarts.size() > 1) {
+        return Message::Slice::placeholder(start - m_sublistStarts.first(), m_position - start + 1);
+    }
+    return slice(buffer().constData() + start, m_position - start + 1);
+}
+
 QByteArray ImapStreamParser::mid(int start, int len)  const
 {
     return buffer().mid(start, len);
@@ -83,122 +453,168 @@ int ImapStreamParser::length() const
 
 int ImapStreamParser::readFromSocket()
 {
-    if (m_readingLiteral && !m_isServerModeEnabled) {
-        Q_ASSERT(m_currentState == LiteralStringState);
-        Q_ASSERT(m_literalSize > 0);
-        const auto amountToRead = qMin(m_socket->bytesAvailable(), m_literalSize);
-        Q_ASSERT(amountToRead > 0);
-        auto pos = m_literalData.size();
-        m_literalData.resize(m_literalData.size() + amountToRead);
-        const auto readBytes = m_socket->read(m_literalData.data() + pos, amountToRead);
-        if (readBytes < 0) {
-            qWarning() << "Failed to read data";
-            return 0;
-        }
-        // qDebug() << "Read literal data: " << readBytes << m_literalSize;
-        m_literalSize -= readBytes;
-        Q_ASSERT(m_literalSize >= 0);
-        return readBytes;
-    } else {
-        if (m_readPosition == m_bufferSize) {
-            // qDebug() << "Buffer is full, trimming";
-            trimBuffer();
+    //Literals are read through the receive buffer as well, the consumer decides what to do with them.
+    if (m_readPosition == m_bufferSize) {
+        // qDebug() << "Buffer is full, trimming";
+        trimBuffer();
+    }
+    if (m_inflater) {
+        return readInflated();
+    }
+    const auto amountToRead = qMin(m_socket->bytesAvailable(), qint64(m_bufferSize - m_readPosition));
+    Q_ASSERT(amountToRead > 0);
+    const auto readBytes = m_socket->read(writePosition(), amountToRead);
+    if (readBytes < 0) {
+        qWarning() << "Failed to read data";
+        return 0;
+    }
+    if (m_dataRead) {
+        m_dataRead(writePosition(), readBytes);
+    }
+    m_readPosition += readBytes;
+    // qDebug() << "Buffer: " << buffer().mid(0, m_readPosition);
+    // qDebug() << "Read data: " << readBytes;
+    return readBytes;
+}
+
+int ImapStreamParser::readInflated()
+{
+    if (m_inflatedPos == m_inflated.size()) {
+        const QByteArray compressed = m_socket->readAll();
+        if (m_dataRead) {
+            m_dataRead(compressed.constData(), compressed.size());
         }
-        const auto amountToRead = qMin(m_socket->bytesAvailable(), qint64(m_bufferSize - m_readPosition));
-        Q_ASSERT(amountToRead > 0);
-        const auto readBytes = m_socket->read(buffer().data() + m_readPosition, amountToRead);
-        if (readBytes < 0) {
-            qWarning() << "Failed to read data";
+        m_inflated = m_inflater->process(compressed);
+        m_inflatedPos = 0;
+        if (m_inflater->error()) {
+            qWarning() << "Failed to decompress data";
+            m_error = true;
             return 0;
         }
-        m_readPosition += readBytes;
-        // qDebug() << "Buffer: " << buffer().mid(0, m_readPosition);
-        // qDebug() << "Read data: " << readBytes;
-        return readBytes;
     }
+    //A chunk of compressed data doesn't necessarily decompress to anything yet
+    const int size = qMin(m_inflated.size() - m_inflatedPos, m_bufferSize - m_readPosition);
+    memcpy(writePosition(), m_inflated.constData() + m_inflatedPos, size);
+    m_inflatedPos += size;
+    m_readPosition += size;
+    return size;
 }
 
-void ImapStreamParser::setupCallbacks()
+qint64 ImapStreamParser::bytesAvailable() const
 {
-    onString([&](const char *data, const int size) {
-        if (!m_message) {
-            //We just assume that we always get a string first
-            m_message.reset(new Message);
-            m_currentPayload = &m_message->content;
-        }
-        if (m_list) {
-            *m_list << QByteArray(data, size);
-        } else {
-            *m_currentPayload << Message::Part(QByteArray(data, size));
-        }
-    });
+    return m_socket->bytesAvailable() + m_inflated.size() - m_inflatedPos;
+}
 
-    onListStart([&]() {
-        m_listCounter++;
-        if (m_listCounter > 1) {
-            //Parse sublists as string
-            setState(SublistString);
-            m_stringStartPos = m_position;
-        } else {
-            if (!m_list) {
-                m_list = new QList<QByteArray>;
-            }
-        }
-    });
+void ImapStreamParser::startCompression()
+{
+    startInflating(m_position);
+}
 
-    onListEnd([&]() {
-        if (m_listCounter <= 0) {
-            qWarning() << "Brackets are off";
+void ImapStreamParser::startInflating(int position)
+{
+    m_compressionTag.clear();
+    m_inflater.reset(new DeflateStream(DeflateStream::Decompress));
+    if (m_isServerModeEnabled) {
+        m_deflater.reset(new DeflateStream(DeflateStream::Compress));
+    } else {
+        m_commandStartPos = -1;
+    }
+    //What we have read but not parsed yet is compressed already
+    if (position < m_readPosition) {
+        m_inflated = m_inflater->process(buffer().constData() + position, m_readPosition - position);
+        m_inflatedPos = 0;
+        m_readPosition = position;
+        if (m_inflater->error()) {
+            qWarning() << "Failed to decompress data";
             m_error = true;
-            return;
         }
-        m_listCounter--;
-        if (m_listCounter == 0) {
-            Q_ASSERT(m_currentPayload);
-            Q_ASSERT(m_list);
-            *m_currentPayload << Message::Part(*m_list);
-            delete m_list;
-            m_list = nullptr;
+    }
+}
+
+void ImapStreamParser::startCompressionAfter(const QByteArray &tag)
+{
+    m_compressionTag = tag;
+    if (!m_isServerModeEnabled) {
+        //Keep track of where responses start, so we can check their tag
+        m_commandStartPos = m_position;
+    }
+}
+
+void ImapStreamParser::checkCompressionStart()
+{
+    //Called on the LF of the CRLF that terminates a response
+    const QByteArray response = midRef(m_commandStartPos, m_position - m_commandStartPos);
+    if (!response.startsWith(m_compressionTag + ' ')) {
+        return;
+    }
+    if (response.mid(m_compressionTag.size() + 1, 2).toUpper() == "OK") {
+        //The compressed data starts right after this response
+        startInflating(m_position + 1);
+    } else {
+        m_compressionTag.clear();
+        if (!m_isServerModeEnabled) {
+            m_commandStartPos = -1;
         }
-    });
+    }
+}
 
-    onResponseCodeStart([&]() {
-        m_currentPayload = &m_message->responseCode;
-    });
+void ImapStreamParser::onString(std::function<void(const char *data, int size)> f)
+{
+    string = f;
+    m_builderHandlesEvents = false;
+}
 
-    onResponseCodeEnd([&]() {
-        m_currentPayload = &m_message->content;
-    });
+void ImapStreamParser::onListStart(std::function<void()> f)
+{
+    listStart = f;
+    m_builderHandlesEvents = false;
+}
 
-    onLiteralStart([&](const int size) {
-        m_literalData.clear();
-        m_literalData.reserve(size);
-    });
+void ImapStreamParser::onListEnd(std::function<void()> f)
+{
+    listEnd = f;
+    m_builderHandlesEvents = false;
+}
 
-    onLiteralPart([&](const char *data, const int size) {
-        m_literalData.append(QByteArray::fromRawData(data, size));
-    });
+void ImapStreamParser::onResponseCodeStart(std::function<void()> f)
+{
+    responseCodeStart = f;
+    m_builderHandlesEvents = false;
+}
 
-    onLiteralEnd([&]() {
-        string(m_literalData.constData(), m_literalData.size());
-    });
+void ImapStreamParser::onResponseCodeEnd(std::function<void()> f)
+{
+    responseCodeEnd = f;
+    m_builderHandlesEvents = false;
+}
 
-    onLineEnd([&]() {
-        if (m_list || m_listCounter != 0) {
-            qWarning() << "List parsing in progress: " << m_listCounter;
-            m_error = true;
-        }
-        if (m_literalSize || m_readingLiteral) {
-            qWarning() << "Literal parsing in progress: " << m_literalSize;
-            m_error = true;
-        }
-        Q_ASSERT(responseReceived);
-        if (m_message) {
-            responseReceived(*m_message);
-            m_message.reset(nullptr);
-        }
-        m_currentPayload = nullptr;
-    });
+void ImapStreamParser::onLiteralStart(std::function<void(qint64 size)> f)
+{
+    literalStart = f;
+    m_builderHandlesEvents = false;
+}
+
+void ImapStreamParser::onLiteralPart(std::function<void(const char *data, int size)> f)
+{
+    literalPart = f;
+    m_builderHandlesEvents = false;
+}
+
+void ImapStreamParser::onLiteralEnd(std::function<void()> f)
+{
+    literalEnd = f;
+    m_builderHandlesEvents = false;
+}
+
+void ImapStreamParser::onLineEnd(std::function<void()> f)
+{
+    lineEnd = f;
+    m_builderHandlesEvents = false;
+}
+
+void ImapStreamParser::onDataRead(std::function<void(const char *data, int size)> f)
+{
+    m_dataRead = f;
 }
 
 void ImapStreamParser::setState(States state)
@@ -217,38 +633,92 @@ void ImapStreamParser::resetState()
     m_currentState = m_lastState;
 }
 
+static const DelimiterScanner::Delimiters s_stringDelimiters(" ()[]\r\"");
+static const DelimiterScanner::Delimiters s_quotedStringDelimiters("\"");
+static const DelimiterScanner::Delimiters s_angleBracketStringDelimiters("]");
+
+const DelimiterScanner::Delimiters *ImapStreamParser::delimiters(States state)
+{
+    switch (state) {
+        case StringState:
+            return &s_stringDelimiters;
+        case QuotedStringState:
+            return &s_quotedStringDelimiters;
+        case AngleBracketStringState:
+            return &s_angleBracketStringDelimiters;
+        default:
+            break;
+    }
+    return nullptr;
+}
+
 void ImapStreamParser::processBuffer()
+{
+    //With the message builder handling all events we can dispatch to it directly,
+    //which saves an indirect call per token.
+    if (m_builder && m_builderHandlesEvents && m_staticDispatchEnabled) {
+        processBuffer(*m_builder);
+    } else {
+        EventHandler handler(this);
+        processBuffer(handler);
+    }
+}
+
+template<typename Handler>
+void ImapStreamParser::processBuffer(Handler &handler)
 {
     if (m_error) {
         qWarning() << "An error occurred";
         return;
     }
     if (m_currentState == LiteralStringState && m_literalSize == 0 && m_readingLiteral) {
-        literalEnd();
+        handler.literalEnd();
         resetState();
         m_readingLiteral = false;
     }
 
     while (m_position < m_readPosition) {
+        //Inside of strings and sublists only a few characters are of interest, so we skip ahead to the next one.
+        if (const auto stateDelimiters = delimiters(m_currentState)) {
+            const char *data = buffer().constData();
+            m_position = DelimiterScanner::findFirstOf(data + m_position, data + m_readPosition, *stateDelimiters) - data;
+            if (m_position >= m_readPosition) {
+                break;
+            }
+        }
         Q_ASSERT(m_position < length());
-        const char c = buffer()[m_position];
+        const char c = at(m_position);
         // qDebug() << "Checking :" << c << m_position << m_readPosition << m_currentState << m_listCounter;
         switch (m_currentState) {
             case InitState:
                 if (c == '(') {
-                    listStart();
+                    m_listCounter++;
+                    if (m_listCounter > 1) {
+                        //Keep the text of nested lists around until they are complete
+                        m_sublistStarts.append(m_position);
+                    }
+                    handler.listStart();
                 } else if (c == ')') {
-                    listEnd();
+                    if (m_listCounter <= 0) {
+                        qWarning() << "Brackets are off";
+                        m_error = true;
+                    } else {
+                        handler.listEnd();
+                        if (m_listCounter > 1) {
+                            m_sublistStarts.removeLast();
+                        }
+                        m_listCounter--;
+                    }
                 } else if (c == '[') {
                     if (m_listCounter >= 1) {
                         //Inside lists angle brackets are parsed as strings
                         setState(AngleBracketStringState);
                         m_stringStartPos = m_position;
                     } else {
-                        responseCodeStart();
+                        handler.responseCodeStart();
                     }
                 } else if (c == ']') {
-                    responseCodeEnd();
+                    handler.responseCodeEnd();
                 } else if (c == ' ') {
                     //Skip whitespace
                     setState(WhitespaceState);
@@ -270,24 +740,25 @@ void ImapStreamParser::processBuffer()
                     //Unescaped quote
                     resetState();
                     const auto endPos = m_position;
-                    string(buffer().constData() + m_stringStartPos, endPos - m_stringStartPos);
-                    m_stringStartPos = 0;
+                    handler.string(buffer().constData() + m_stringStartPos, endPos - m_stringStartPos);
+                    m_stringStartPos = -1;
                 }
                 break;
             case LiteralStringState:
-                if (c == '}') {
+                if (!m_readingLiteral && c == '}') {
                     m_literalSize = strtol(buffer().constData() + m_stringStartPos, nullptr, 10);
+                    m_nonSynchronizingLiteral = (buffer().at(m_position - 1) == '+');
                     // qDebug() << "Found literal size: " << m_literalSize;
-                    literalStart(m_literalSize);
+                    handler.literalStart(m_literalSize);
                     m_readingLiteral = false;
-                    m_stringStartPos = 0;
+                    m_stringStartPos = -1;
                     break;
                 }
                 if (!m_readingLiteral) {
                     //Skip CRLF after literal size
                     if (c == '\n') {
                         m_readingLiteral = true;
-                        if (m_isServerModeEnabled && m_literalSize > 0) {
+                        if (m_isServerModeEnabled && m_literalSize > 0 && !m_nonSynchronizingLiteral) {
                             sendContinuationResponse(m_literalSize);
                         }
                     }
@@ -299,13 +770,13 @@ void ImapStreamParser::processBuffer()
                             //If the literal is not complete we take what is available
                             size = length() - m_position;
                         }
-                        literalPart(buffer().constData() + m_position, size);
+                        handler.literalPart(buffer().constData() + m_position, size);
                         m_position += size;
                         m_literalSize -= size;
                     }
                     if (m_literalSize <= 0) {
                         Q_ASSERT(m_literalSize == 0);
-                        literalEnd();
+                        handler.literalEnd();
                         resetState();
                         m_readingLiteral = false;
                     }
@@ -322,8 +793,8 @@ void ImapStreamParser::processBuffer()
                     c == '\r' || //CRLF
                     c == '\"') {
                     resetState();
-                    string(buffer().constData() + m_stringStartPos, m_position - m_stringStartPos);
-                    m_stringStartPos = 0;
+                    handler.string(buffer().constData() + m_stringStartPos, m_position - m_stringStartPos);
+                    m_stringStartPos = -1;
                     continue;
                 }
                 //Inside lists we want to parse the angle brackets as part of the string.
@@ -338,20 +809,8 @@ void ImapStreamParser::processBuffer()
             case AngleBracketStringState:
                 if (c == ']') {
                     resetState();
-                    string(buffer().constData() + m_stringStartPos, m_position - m_stringStartPos + 1);
-                    m_stringStartPos = 0;
-                }
-                break;
-            case SublistString:
-                if (c == '(') {
-                    m_listCounter++;
-                } else if (c == ')') {
-                    m_listCounter--;
-                    if (m_listCounter <= 1) {
-                        resetState();
-                        string(buffer().constData() + m_stringStartPos, m_position - m_stringStartPos + 1);
-                        m_stringStartPos = 0;
-                    }
+                    handler.string(buffer().constData() + m_stringStartPos, m_position - m_stringStartPos + 1);
+                    m_stringStartPos = -1;
                 }
                 break;
             case WhitespaceState:
@@ -363,8 +822,24 @@ void ImapStreamParser::processBuffer()
                 break;
             case CRLFState:
                 if (c == '\n') {
-                    lineEnd();
+                    if (m_listCounter != 0) {
+                        qWarning() << "List parsing in progress: " << m_listCounter;
+                        m_error = true;
+                        m_listCounter = 0;
+                        m_sublistStarts.clear();
+                    }
+                    if (m_literalSize || m_readingLiteral) {
+                        qWarning() << "Literal parsing in progress: " << m_literalSize;
+                        m_error = true;
+                    }
+                    handler.lineEnd();
                     resetState();
+                    if (!m_compressionTag.isEmpty()) {
+                        checkCompressionStart();
+                    }
+                    if (m_commandStartPos >= 0) {
+                        m_commandStartPos = m_position + 1;
+                    }
                 } else {
                     //Skip over the \r that isn't part of the CRLF
                     resetState();
@@ -386,8 +861,16 @@ void ImapStreamParser::parseStream()
         return;
     }
     m_processing = true;
-    while (m_socket->bytesAvailable()) {
-        if (readFromSocket() <= 0) {
+    while (bytesAvailable()) {
+        const int readBytes = readFromSocket();
+        if (m_error) {
+            break;
+        }
+        if (readBytes <= 0 && m_inflater) {
+            //Wait for more compressed data
+            continue;
+        }
+        if (readBytes <= 0) {
             //If we're not making progress we could loop forever,
             //and given that we check beforehand if there is data,
             //this should never happen.
@@ -396,79 +879,240 @@ void ImapStreamParser::parseStream()
             Q_ASSERT(false);
             return;
         };
+        if (m_parseTimingEnabled) {
+            m_parseTimer.start();
+        }
         processBuffer();
+        if (m_parseTimingEnabled) {
+            m_parseTime += m_parseTimer.nsecsElapsed();
+        }
+        if (m_builder) {
+            m_builder->flush();
+        }
     }
     m_processing = false;
 }
 
 void ImapStreamParser::trimBuffer()
 {
+    //Keep the token and the nested lists we are in the middle of
     int offset = m_position;
-    if (m_stringStartPos) {
-        offset = qMin(m_stringStartPos, m_position);
+    if (m_stringStartPos >= 0) {
+        offset = qMin(m_stringStartPos, offset);
+    }
+    //In server mode we also keep the command we are in the middle of
+    if (m_commandStartPos >= 0) {
+        offset = qMin(m_commandStartPos, offset);
+    }
+    if (!m_sublistStarts.isEmpty()) {
+        offset = qMin(m_sublistStarts.first(), offset);
     }
 
     auto remainderSize = m_readPosition - offset;
     Q_ASSERT( remainderSize >= 0);
+
+    //If what we have to keep would fill more than half of the buffer we are in the middle of a large token
+    //(or a burst of data), so we grow instead of copying the same data over and over again.
+    //Once the data we keep fits comfortably into the initial size again we shrink back.
+    int newSize = m_bufferSize;
+    if (remainderSize > m_bufferSize / 2) {
+        newSize = m_bufferSize * 2;
+    } else if (m_bufferSize > s_initialBufferSize && remainderSize < s_initialBufferSize / 2) {
+        newSize = s_initialBufferSize;
+    }
+
     QByteArray *otherBuffer;
     if (m_current == &m_data1) {
         otherBuffer = &m_data2;
     } else {
         otherBuffer = &m_data1;
     }
+    if (otherBuffer->size() != newSize || (m_zeroCopy && !otherBuffer->isDetached())) {
+        //The buffer is either of the wrong size or still referenced by tokens we handed out,
+        //in which case we leave it to them and start a new one.
+        *otherBuffer = QByteArray(newSize, Qt::Uninitialized);
+        m_bufferAllocations++;
+    }
     if (remainderSize) {
         otherBuffer->replace(0, remainderSize, buffer().constData() + offset, remainderSize);
     }
+    if (newSize != m_bufferSize) {
+        //Don't hold on to a buffer of the old size, it would be replaced on the next trim anyways
+        *m_current = QByteArray();
+        m_bufferSize = newSize;
+    }
     m_current = otherBuffer;
     m_readPosition = remainderSize;
     m_position -= offset;
-    if (m_stringStartPos) {
+    if (m_stringStartPos >= 0) {
         m_stringStartPos -= offset;
     }
+    if (m_commandStartPos >= 0) {
+        m_commandStartPos -= offset;
+    }
+    for (int i = 0; i < m_sublistStarts.size(); i++) {
+        m_sublistStarts[i] -= offset;
+    }
+    m_trimCount++;
+    m_trimmedBytes += remainderSize;
+    m_discardedBytes += offset;
     // qDebug() << "Buffer after trim: " << mid(0, m_readPosition);
 }
 
+int ImapStreamParser::bufferSize() const
+{
+    return m_bufferSize;
+}
+
+int ImapStreamParser::trimCount() const
+{
+    return m_trimCount;
+}
+
+qint64 ImapStreamParser::trimmedBytes() const
+{
+    return m_trimmedBytes;
+}
+
+int ImapStreamParser::bufferAllocations() const
+{
+    return m_bufferAllocations;
+}
+
+void ImapStreamParser::setParseTimingEnabled(bool enabled)
+{
+    m_parseTimingEnabled = enabled;
+}
+
+qint64 ImapStreamParser::parseTime() const
+{
+    return m_parseTime;
+}
+
 int ImapStreamParser::availableDataSize() const
 {
-    return m_socket->bytesAvailable() + length() - m_position;
+    return bytesAvailable() + length() - m_position;
 }
 
 QByteArray ImapStreamParser::readUntilCommandEnd()
 {
-    QByteArray result;
-    auto startPos = m_position;
-    onLineEnd([&result, this, startPos]() {
-        result = mid(startPos, m_position - startPos - 1);
-    });
-    Q_FOREVER {
-        if (!m_socket->bytesAvailable()) {
-            if (!m_socket->waitForReadyRead(10000)) {
-                qWarning() << "No data available";
-                return result;
+    Q_ASSERT(m_isServerModeEnabled);
+    if (m_pendingCommands.isEmpty()) {
+        const auto previousLineEnd = lineEnd;
+        //A single read may contain several commands, we keep the ones we don't return yet for the next call
+        onLineEnd([this]() {
+            m_pendingCommands << command();
+        });
+        while (m_pendingCommands.isEmpty()) {
+            if (!bytesAvailable()) {
+                if (!m_socket->waitForReadyRead(10000)) {
+                    qWarning() << "No data available";
+                    break;
+                }
+            }
+            parseStream();
+            //Continuation requests are only queued while parsing
+            if (m_socket->bytesToWrite() > 0) {
+                m_socket->waitForBytesWritten(30000);
+            }
+            if (m_error) {
+                break;
             }
         }
-        parseStream();
-        if (!result.isEmpty() && m_currentState == InitState) {
-            // qDebug() << "Got a result: " << m_readingLiteral;
-            // result.append(m_literalData);
-            break;
-        }
+        onLineEnd(previousLineEnd);
     }
+    if (m_pendingCommands.isEmpty()) {
+        return QByteArray();
+    }
+    const QByteArray result = m_pendingCommands.takeFirst();
     qDebug() << "Read until command end: " << result;
     return result;
 }
 
+void ImapStreamParser::onCommandReceived(std::function<void(const QByteArray &command)> f)
+{
+    Q_ASSERT(m_isServerModeEnabled);
+    onLineEnd([this, f]() {
+        f(command());
+    });
+}
+
+QByteArray ImapStreamParser::command() const
+{
+    //Called on the LF of the CRLF that terminates the command
+    return mid(m_commandStartPos, m_position - m_commandStartPos - 1);
+}
+
 void ImapStreamParser::sendContinuationResponse(qint64 size)
 {
     QByteArray block = "+ Ready for literal data (expecting " +
                        QByteArray::number(size) + " bytes)\r\n";
-    m_socket->write(block);
-    m_socket->waitForBytesWritten(30000);
+    //The socket sends it once we're back in the event loop, or readUntilCommandEnd() flushes it
+    m_socket->write(m_deflater ? m_deflater->process(block) : block);
 }
 
 void ImapStreamParser::onResponseReceived(std::function<void(const Message &)> f)
 {
-    responseReceived = f;
+    installBuilder(new MessageBuilder(this, f, nullptr));
+}
+
+void ImapStreamParser::onResponsesReceived(std::function<void(const MessageRange &)> f)
+{
+    installBuilder(new MessageBuilder(this, nullptr, f));
+}
+
+void ImapStreamParser::installBuilder(MessageBuilder *builder)
+{
+    m_builder.reset(builder);
+    onString([builder](const char *data, int size) {
+        builder->string(data, size);
+    });
+    onListStart([builder]() {
+        builder->listStart();
+    });
+    onListEnd([builder]() {
+        builder->listEnd();
+    });
+    onResponseCodeStart([builder]() {
+        builder->responseCodeStart();
+    });
+    onResponseCodeEnd([builder]() {
+        builder->responseCodeEnd();
+    });
+    onLiteralStart([builder](qint64 size) {
+        builder->literalStart(size);
+    });
+    onLiteralPart([builder](const char *data, int size) {
+        builder->literalPart(data, size);
+    });
+    onLiteralEnd([builder]() {
+        builder->literalEnd();
+    });
+    onLineEnd([builder]() {
+        builder->lineEnd();
+    });
+    m_builderHandlesEvents = true;
+}
+
+void ImapStreamParser::setStaticDispatchEnabled(bool enabled)
+{
+    m_staticDispatchEnabled = enabled;
+}
+
+void ImapStreamParser::setZeroCopyEnabled(bool enabled)
+{
+    m_zeroCopy = enabled;
+}
+
+bool ImapStreamParser::isZeroCopyEnabled() const
+{
+    return m_zeroCopy;
+}
+
+void ImapStreamParser::setLiteralSink(qint64 threshold, std::function<LiteralSink(const Message &response, const QByteArray &item, qint64 size)> createSink)
+{
+    m_literalThreshold = threshold;
+    m_createLiteralSink = createSink;
 }
 
 bool ImapStreamParser::error() const
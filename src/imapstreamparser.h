@@ -25,7 +25,9 @@
 #include "kimap2_export.h"
 
 #include <QtCore/QByteArray>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QList>
+#include <QtCore/QVector>
 #include <QtCore/QScopedPointer>
 #include <functional>
 #include <message_p.h>
@@ -35,8 +37,18 @@ class QIODevice;
 namespace KIMAP2
 {
 
+namespace DelimiterScanner
+{
+class Delimiters;
+}
+class DeflateStream;
+
 /**
   Parser for IMAP messages that operates on a local socket stream.
+
+  The parser tokenizes the stream in a single pass and emits an event for every token it encounters.
+  Consumers can either handle these events themselves (see onString() and friends), which avoids building
+  any intermediate structures, or let the parser assemble complete messages (see onResponseReceived()).
 */
 class KIMAP2_EXPORT ImapStreamParser
 {
@@ -48,24 +60,158 @@ public:
      * continuation message automatically)
      */
     explicit ImapStreamParser(QIODevice *socket, bool serverModeEnabled = false);
+    ~ImapStreamParser();
 
     /**
      * Return everything that remained from the command.
+     *
+     * Blocks until a complete command has been received. Server mode only.
      * @return the remaining command data
      */
     QByteArray readUntilCommandEnd();
 
+    /**
+     * Pass every complete client command to @p f, without blocking. Server mode only.
+     *
+     * Data is parsed as it is passed to parseStream(), e.g. whenever the socket emits readyRead(),
+     * and continuation requests for literals are written without waiting for them to be sent.
+     * The command includes its literals, but not the terminating CRLF.
+     *
+     * This installs the lineEnd handler, replacing any that was set before.
+     */
+    void onCommandReceived(std::function<void(const QByteArray &command)> f);
+
     int availableDataSize() const;
 
     void parseStream();
 
-    void onResponseReceived(std::function<void(const Message &)>);
+    /**
+     * Assemble a Message for every response and pass it to @p f.
+     *
+     * This installs handlers for all token events, replacing any that were set before.
+     */
+    void onResponseReceived(std::function<void(const Message &)> f);
+
+    /**
+     * Assemble a Message for every response, and pass all responses parsed from one read
+     * of the socket to @p f at once.
+     *
+     * This installs handlers for all token events, replacing any that were set before.
+     * The messages are reused for subsequent responses once @p f returns, consumers that
+     * keep a message around have to copy it.
+     */
+    void onResponsesReceived(std::function<void(const MessageRange &)> f);
+
+    /**
+     * Messages are assembled by calling into the builder directly, rather than through
+     * the event handlers. Disabling this is only useful to measure the difference.
+     */
+    void setStaticDispatchEnabled(bool enabled);
+
+    /**
+     * Token events.
+     *
+     * The data passed to the string and literal events points into the receive buffer and is only
+     * valid for the duration of the call. Nested lists are reported with a listStart/listEnd pair
+     * of their own.
+     */
+    void onString(std::function<void(const char *data, int size)> f);
+    void onListStart(std::function<void()> f);
+    void onListEnd(std::function<void()> f);
+    void onResponseCodeStart(std::function<void()> f);
+    void onResponseCodeEnd(std::function<void()> f);
+    void onLiteralStart(std::function<void(qint64 size)> f);
+    void onLiteralPart(std::function<void(const char *data, int size)> f);
+    void onLiteralEnd(std::function<void()> f);
+    void onLineEnd(std::function<void()> f);
+
+    /**
+     * Pass all data read from the socket to @p f, as it was received (i.e. still compressed).
+     */
+    void onDataRead(std::function<void(const char *data, int size)> f);
 
     bool error() const;
 
     QByteArray currentBuffer() const;
 
+    /**
+     * Hand out tokens as slices of the receive buffer instead of copying each of them.
+     *
+     * The parts of a received message then share the receive buffer they were parsed from,
+     * which is only released once no message refers to it anymore.
+     * Consumers that keep messages around should call Message::detach().
+     */
+    void setZeroCopyEnabled(bool enabled);
+    bool isZeroCopyEnabled() const;
+
+    /**
+     * Receives the data of a streamed literal in chunks, as it arrives.
+     */
+    typedef std::function<void(const char *data, int size)> LiteralSink;
+
+    /**
+     * Stream literals larger than @p threshold bytes instead of collecting them in memory.
+     *
+     * @p createSink is called for every such literal with the tokens of the response received so far,
+     * the token that precedes the literal (e.g. the FETCH data item, empty if there is none) and
+     * the size of the literal. It returns the sink that receives the data, or an empty function
+     * to collect the literal in memory after all.
+     * The parsed message only contains a null token as placeholder for a streamed literal.
+     * Pass a threshold of 0 to collect all literals in memory again.
+     */
+    void setLiteralSink(qint64 threshold, std::function<LiteralSink(const Message &response, const QByteArray &item, qint64 size)> createSink);
+
+    /**
+     * Decompress all data that has not been parsed yet (COMPRESS=DEFLATE, RFC 4978).
+     *
+     * In server mode the continuation requests we send are compressed as well.
+     */
+    void startCompression();
+
+    /**
+     * Call startCompression() once the command tagged @p tag completes successfully.
+     *
+     * The server compresses everything that follows its OK response, which may arrive
+     * in the same read as the response itself.
+     */
+    void startCompressionAfter(const QByteArray &tag);
+
+    /**
+     * The current size of the receive buffer.
+     *
+     * The buffer grows when a token doesn't fit and shrinks back once the burst is over.
+     */
+    int bufferSize() const;
+
+    /**
+     * How often the receive buffer was trimmed to make room for new data.
+     */
+    int trimCount() const;
+
+    /**
+     * The number of bytes that were copied while trimming the receive buffer.
+     */
+    qint64 trimmedBytes() const;
+
+    /**
+     * How often a new receive buffer had to be allocated while trimming,
+     * because of a size change or because tokens handed out in zero-copy mode still referred to the old one.
+     */
+    int bufferAllocations() const;
+
+    /**
+     * Measure how long parsing takes, without the time spent in the callbacks for complete responses.
+     */
+    void setParseTimingEnabled(bool enabled);
+
+    /**
+     * The nanoseconds spent parsing since parse timing was enabled.
+     */
+    qint64 parseTime() const;
+
 private:
+    class MessageBuilder;
+    class EventHandler;
 
     /**
      * Remove already read data from the internal buffer if necessary.
@@ -79,7 +225,21 @@ private:
 
 
     int readFromSocket();
+    int readInflated();
+    qint64 bytesAvailable() const;
+    void startInflating(int position);
+    void checkCompressionStart();
     void processBuffer();
+    /**
+     * The actual parser, with the events going to @p handler.
+     *
+     * Instantiated for the message builder, so the events can be inlined when building messages,
+     * and for the handlers that have been set at runtime.
+     */
+    template<typename Handler>
+    void processBuffer(Handler &handler);
+    void installBuilder(MessageBuilder *builder);
+    QByteArray command() const;
 
     char at(int pos) const;
     QByteArray mid(int start, int end = -1)  const;
@@ -88,9 +248,9 @@ private:
 
     QByteArray &buffer();
     const QByteArray &buffer() const;
-
-    QScopedPointer<Message> m_message;
-    QList<Message::Part> *m_currentPayload;
+    char *writePosition();
+    Message::Slice slice(const char *data, int size) const;
+    Message::Slice sublistText() const;
 
     QIODevice *m_socket;
     bool m_isServerModeEnabled;
@@ -102,6 +262,7 @@ private:
     QByteArray m_data2;
     QByteArray *m_current;
     int m_bufferSize;
+    static const int s_initialBufferSize = 16000;
 
     enum States {
         InitState,
@@ -110,82 +271,65 @@ private:
         StringState,
         WhitespaceState,
         AngleBracketStringState,
-        SublistString,
         CRLFState
     };
     States m_currentState;
     States m_lastState;
 
+    static const DelimiterScanner::Delimiters *delimiters(States state);
+
     void setState(States state);
     void forwardToState(States state);
     void resetState();
 
     int m_listCounter;
+    //Where the currently open nested lists start in the buffer, the innermost one last
+    QVector<int> m_sublistStarts;
     int m_stringStartPos;
+    //Where the command that is currently received starts, in server mode and while waiting for the
+    //completion of COMPRESS (then it is the start of the current response)
+    int m_commandStartPos;
+    //Commands that have been received, but not yet returned by readUntilCommandEnd()
+    QList<QByteArray> m_pendingCommands;
     bool m_readingLiteral;
+    //A {size+} literal, the sender doesn't wait for a continuation (RFC 7888)
+    bool m_nonSynchronizingLiteral;
     bool m_error;
+    bool m_zeroCopy;
+    //Whether all events go to m_builder, so we can skip the std::function handlers
+    bool m_builderHandlesEvents;
+    bool m_staticDispatchEnabled;
 
-    std::function<void(const char *data, const int size)> string;
+    std::function<void(const char *data, int size)> string;
     std::function<void()> listStart;
     std::function<void()> listEnd;
     std::function<void()> responseCodeStart;
     std::function<void()> responseCodeEnd;
-    std::function<void(int size)> literalStart;
-    std::function<void(const char *data, const int size)> literalPart;
+    std::function<void(qint64 size)> literalStart;
+    std::function<void(const char *data, int size)> literalPart;
     std::function<void()> literalEnd;
     std::function<void()> lineEnd;
-
-    void onString(std::function<void(const char *data, const int size)> f)
-    {
-        string = f;
-    }
-
-    void onListStart(std::function<void()> f)
-    {
-        listStart = f;
-    }
-
-    void onListEnd(std::function<void()> f)
-    {
-        listEnd = f;
-    }
-
-    void onResponseCodeStart(std::function<void()> f)
-    {
-        responseCodeStart = f;
-    }
-
-    void onResponseCodeEnd(std::function<void()> f)
-    {
-        responseCodeEnd = f;
-    }
-
-    void onLiteralStart(std::function<void(int size)> f)
-    {
-        literalStart = f;
-    }
-
-    void onLiteralPart(std::function<void(const char *data, const int size)> f)
-    {
-        literalPart = f;
-    }
-
-    void onLiteralEnd(std::function<void()> f)
-    {
-        literalEnd = f;
-    }
-
-    void onLineEnd(std::function<void()> f)
-    {
-        lineEnd = f;
-    }
-
-    std::function<void(const Message &)> responseReceived;
-
-    void setupCallbacks();
-
-    QList<QByteArray> *m_list;
-    QByteArray m_literalData;
+    std::function<void(const char *data, int size)> m_dataRead;
+
+    QScopedPointer<MessageBuilder> m_builder;
+    qint64 m_literalThreshold;
+    std::function<LiteralSink(const Message &response, const QByteArray &item, qint64 size)> m_createLiteralSink;
+    int m_trimCount;
+    qint64 m_trimmedBytes;
+    int m_bufferAllocations;
+    //The bytes that have been trimmed off the front of the buffer so far, to tell the size of each response
+    qint64 m_discardedBytes;
+
+    bool m_parseTimingEnabled;
+    qint64 m_parseTime;
+    QElapsedTimer m_parseTimer;
+
+    QByteArray m_compressionTag;
+    QScopedPointer<DeflateStream> m_inflater;
+    QScopedPointer<DeflateStream> m_deflater;
+    //Decompressed data, from m_inflatedPos on it didn't fit into the receive buffer yet
+    QByteArray m_inflated;
+    int m_inflatedPos;
 };
 
 }
@@ -28,18 +28,27 @@ using namespace KIMAP2;
 
 void JobPrivate::sendCommand(const QByteArray &command, const QByteArray &args)
 {
-    tags << sessionInternal()->sendCommand(command, args);
+    tags << sessionInternal()->sendCommand(q_ptr, command, args);
     m_currentCommand = command + "" + args;
 }
 
+void JobPrivate::handleResponses(const MessageRange &responses)
+{
+    for (const Message &response : responses) {
+        q_ptr->handleResponse(response);
+    }
+}
+
 Job::Job(Session *session)
     : KJob(session), d_ptr(new JobPrivate(session, "Job"))
 {
+    d_ptr->q_ptr = this;
 }
 
 Job::Job(JobPrivate &dd)
     : KJob(dd.m_session), d_ptr(&dd)
 {
+    d_ptr->q_ptr = this;
 }
 
 Job::~Job()
@@ -53,6 +62,18 @@ Session *Job::session() const
     return d->m_session;
 }
 
+void Job::setPriority(Priority priority)
+{
+    Q_D(Job);
+    d->priority = priority;
+}
+
+Job::Priority Job::priority() const
+{
+    Q_D(const Job);
+    return d->priority;
+}
+
 void Job::start()
 {
     Q_D(Job);
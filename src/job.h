@@ -51,10 +51,30 @@ class KIMAP2_EXPORT Job : public KJob
     friend class SessionPrivate;
 
 public:
+    /**
+     * The order in which the session starts the queued jobs.
+     */
+    enum Priority {
+        Interactive = 0, ///< Something the user is waiting for, e.g. the message that was opened
+        Normal,          ///< The default
+        Background       ///< Only when nothing else is waiting, e.g. a synchronization
+    };
+
     virtual ~Job();
 
     Session *session() const;
 
+    /**
+     * Let the job start before queued jobs of a lower priority.
+     *
+     * Jobs of the same priority start in the order they were queued. Jobs that change the session state
+     * (e.g. SelectJob or LoginJob) are never reordered, and no job is started before one of them that was
+     * queued earlier. Only jobs that could also be pipelined (e.g. FetchJob or StatusJob) jump the queue.
+     * See Session::setStarvationLimit() for how long a job of lower priority is passed over.
+     */
+    void setPriority(Priority priority);
+    Priority priority() const;
+
     void start() Q_DECL_OVERRIDE;
 
 private:
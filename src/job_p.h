@@ -20,18 +20,23 @@
 #ifndef KIMAP2_JOB_P_H
 #define KIMAP2_JOB_P_H
 
+#include "job.h"
 #include "session.h"
+#include <QtCore/QElapsedTimer>
 #include <QtNetwork/QAbstractSocket>
 
 namespace KIMAP2
 {
 
 class SessionPrivate;
+class Job;
+class MessageRange;
 
 class JobPrivate
 {
 public:
-    JobPrivate(Session *session, const QString &name) : m_session(session), m_socketError(QAbstractSocket::UnknownSocketError)
+    JobPrivate(Session *session, const QString &name) : m_session(session), m_socketError(QAbstractSocket::UnknownSocketError), q_ptr(Q_NULLPTR),
+        priority(Job::Normal), bypassCount(0)
     {
         m_name = name;
     }
@@ -48,6 +53,14 @@ public:
     }
 
     void sendCommand(const QByteArray &command, const QByteArray &args);
+    /**
+     * Handles consecutive untagged responses for the job, as parsed from one read of the socket.
+     *
+     * Tagged replies and continuation requests are always passed to Job::handleResponse().
+     * The default implementation calls Job::handleResponse() for every response.
+     * Lives here rather than in Job to keep the vtable of the exported class as it is.
+     */
+    virtual void handleResponses(const MessageRange &responses);
 
     QList<QByteArray> tags;
     Session *m_session;
@@ -55,6 +68,21 @@ public:
     QString m_errorMessage;
     QString m_currentCommand;
     QAbstractSocket::SocketError m_socketError;
+    Job *q_ptr;
+
+    /**
+     * The kinds of untagged responses the job consumes, e.g. "FETCH".
+     *
+     * With pipelining enabled a job that sets these can run alongside jobs that consume other kinds,
+     * the responses are then routed by kind. All other jobs run on their own.
+     */
+    QList<QByteArray> pipelineResponses;
+
+    Job::Priority priority;
+    //How often a job queued after this one was started first
+    int bypassCount;
+    //Since the job was queued, or put back into the queue between two commands
+    QElapsedTimer queuedTime;
 };
 
 }
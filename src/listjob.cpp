@@ -31,7 +31,10 @@ namespace KIMAP2
 class ListJobPrivate : public JobPrivate
 {
 public:
-    ListJobPrivate(ListJob *job, Session *session, const QString &name) : JobPrivate(session, name), q(job), option(ListJob::NoOption) { }
+    ListJobPrivate(ListJob *job, Session *session, const QString &name) : JobPrivate(session, name), q(job), option(ListJob::NoOption)
+    {
+        pipelineResponses << "LIST" << "XLIST" << "LSUB";
+    }
     ~ListJobPrivate() { }
 
     ListJob *const q;
@@ -72,6 +72,7 @@ public:
     void saveServerGreeting(const Message &response);
     void login();
     void retrieveCapabilities();
+    void authenticate();
 
     LoginJob *q;
 
@@ -292,6 +293,23 @@ void LoginJobPrivate::sslResponse(bool response)
 
 void LoginJobPrivate::retrieveCapabilities()
 {
+    //A valid snapshot has the capabilities of the same setup. Those of the greeting are only good without STARTTLS,
+    //since the capabilities may change once the connection is encrypted.
+    QStringList knownCapabilities;
+    if (const SessionSnapshot *snapshot = sessionInternal()->restoredSnapshot()) {
+        knownCapabilities = snapshot->capabilities;
+    }
+    if (knownCapabilities.isEmpty() && !startTls) {
+        knownCapabilities = sessionInternal()->greetingCapabilities();
+    }
+    if (!knownCapabilities.isEmpty()) {
+        qCDebug(KIMAP2_LOG) << "Capabilities are known, not retrieving them: " << knownCapabilities;
+        capabilities = knownCapabilities;
+        plainLoginDisabled = capabilities.contains(QStringLiteral("LOGINDISABLED"));
+        authenticate();
+        return;
+    }
+
     qCDebug(KIMAP2_LOG) << "Retrieving capabilities.";
     authState = LoginJobPrivate::Capability;
     sendCommand("CAPABILITY", {});
@@ -363,7 +381,7 @@ void LoginJob::handleResponse(const Message &response)
     case UNTAGGED:
         // The only untagged response interesting for us here is CAPABILITY
         if (response.content[1].toString() == "CAPABILITY") {
-            QList<Message::Part>::const_iterator p = response.content.begin() + 2;
+            QVector<Message::Part>::const_iterator p = response.content.begin() + 2;
             while (p != response.content.end()) {
                 QString capability = QLatin1String(p->toString());
                 d->capabilities << capability;
@@ -397,7 +415,7 @@ void LoginJob::handleResponse(const Message &response)
             challengeResponse += '\0';
             challengeResponse += d->password.toUtf8();
             challengeResponse = challengeResponse.toBase64();
-            d->sessionInternal()->sendData(challengeResponse);
+            d->sessionInternal()->sendData(this, challengeResponse);
         } else if (response.content.size() >= 2) {
             if (!d->answerChallenge(QByteArray::fromBase64(response.content[1].toString()))) {
                 emitResult(); //error, we're done
@@ -415,38 +433,7 @@ void LoginJob::handleResponse(const Message &response)
             d->sessionInternal()->startSsl(d->encryptionMode);
             break;
         case LoginJobPrivate::Capability:
-            //cleartext login, if enabled
-            if (d->authMode.isEmpty()) {
-                if (d->plainLoginDisabled) {
-                    setError(LoginFailed);
-                    setErrorText(QString("Login failed, plain login is disabled by the server."));
-                    emitResult();
-                } else {
-                    d->sendPlainLogin();
-                }
-            } else {
-                bool authModeSupported = false;
-                //PLAIN is always supported as defined in the standard. We should also get an AUTH= capability, but in case a server doesn't properly announce it we'll just accept it anyways.
-                if (d->authMode == "PLAIN") {
-                    authModeSupported = true;
-                }
-                //find the selected SASL authentication method
-                Q_FOREACH (const QString &capability, d->capabilities) {
-                    if (capability.startsWith(QLatin1String("AUTH="))) {
-                        if (capability.mid(5) == d->authMode) {
-                            authModeSupported = true;
-                            break;
-                        }
-                    }
-                }
-                if (!authModeSupported) {
-                    setError(LoginFailed);
-                    setErrorText(QString("Login failed, authentication mode %1 is not supported by the server.").arg(d->authMode));
-                    emitResult();
-                } else if (!d->startAuthentication()) {
-                    emitResult(); //problem, we're done
-                }
-            }
+            d->authenticate();
             break;
 
         case LoginJobPrivate::Authenticate:
@@ -454,6 +441,15 @@ void LoginJob::handleResponse(const Message &response)
         // Fall through
         case LoginJobPrivate::Login:
             d->saveServerGreeting(response);
+            d->sessionInternal()->loggedIn(d->userName, d->authMode, d->capabilities);
+            //Servers may announce the capabilities of the authenticated state right away
+            if (!response.responseCode.isEmpty() && response.responseCode[0].toString() == "CAPABILITY") {
+                QStringList authenticatedCapabilities;
+                for (int i = 1; i < response.responseCode.size(); ++i) {
+                    authenticatedCapabilities << QLatin1String(response.responseCode[i].toString().toUpper());
+                }
+                d->sessionInternal()->capabilitiesReceived(authenticatedCapabilities);
+            }
             emitResult(); //got an OK, command done
             break;
 
@@ -467,6 +463,42 @@ void LoginJob::handleResponse(const Message &response)
     }
 }
 
+void LoginJobPrivate::authenticate()
+{
+    //cleartext login, if enabled
+    if (authMode.isEmpty()) {
+        if (plainLoginDisabled) {
+            q->setError(LoginJob::LoginFailed);
+            q->setErrorText(QString("Login failed, plain login is disabled by the server."));
+            q->emitResult();
+        } else {
+            sendPlainLogin();
+        }
+    } else {
+        bool authModeSupported = false;
+        //PLAIN is always supported as defined in the standard. We should also get an AUTH= capability, but in case a server doesn't properly announce it we'll just accept it anyways.
+        if (authMode == "PLAIN") {
+            authModeSupported = true;
+        }
+        //find the selected SASL authentication method
+        Q_FOREACH (const QString &capability, capabilities) {
+            if (capability.startsWith(QLatin1String("AUTH="))) {
+                if (capability.mid(5) == authMode) {
+                    authModeSupported = true;
+                    break;
+                }
+            }
+        }
+        if (!authModeSupported) {
+            q->setError(LoginJob::LoginFailed);
+            q->setErrorText(QString("Login failed, authentication mode %1 is not supported by the server.").arg(authMode));
+            q->emitResult();
+        } else if (!startAuthentication()) {
+            q->emitResult(); //problem, we're done
+        }
+    }
+}
+
 bool LoginJobPrivate::startAuthentication()
 {
     //SASL authentication
@@ -565,7 +597,7 @@ bool LoginJobPrivate::answerChallenge(const QByteArray &data)
     QByteArray tmp = QByteArray::fromRawData(out, outlen);
     challenge = tmp.toBase64();
 
-    sessionInternal()->sendData(challenge);
+    sessionInternal()->sendData(q, challenge);
 
     return true;
 }
@@ -0,0 +1,92 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_MAILBOXEVENT_H
+#define KIMAP2_MAILBOXEVENT_H
+
+#include "kimap2_export.h"
+#include "imapset.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QFlags>
+#include <QtCore/QList>
+#include <QtCore/QString>
+
+namespace KIMAP2
+{
+
+/**
+ * A change of the selected mailbox the server reported with an untagged response.
+ *
+ * @see Session::subscribe()
+ */
+struct KIMAP2_EXPORT MailBoxEvent
+{
+    enum Type {
+        Exists = 0x01,   ///< "* 23 EXISTS", the number of messages in the mailbox
+        Recent = 0x02,   ///< "* 5 RECENT", the number of recent messages
+        Expunge = 0x04,  ///< "* 12 EXPUNGE", the sequence number of a removed message
+        Vanished = 0x08, ///< "* VANISHED 100:110", the UIDs of removed messages (QRESYNC)
+        Flags = 0x10     ///< "* 7 FETCH (FLAGS (\Seen) UID 42)", the flags of a message changed
+    };
+    Q_DECLARE_FLAGS(Types, Type)
+
+    MailBoxEvent()
+        : type(Exists),
+          number(0),
+          uid(-1),
+          modSequence(0),
+          earlier(false)
+    {
+    }
+
+    Type type;
+    /**
+     * The mailbox that was selected when the response arrived.
+     */
+    QString mailBox;
+    /**
+     * The count for Exists and Recent, the sequence number for Expunge and Flags.
+     */
+    qint64 number;
+    /**
+     * The UID for Flags, if the server sent it. -1 otherwise.
+     */
+    qint64 uid;
+    QList<QByteArray> flags;
+    /**
+     * The MODSEQ for Flags, if the server sent it (CONDSTORE). 0 otherwise.
+     */
+    quint64 modSequence;
+    /**
+     * The UIDs for Vanished.
+     */
+    ImapSet uids;
+    /**
+     * For Vanished, true if it reports messages removed before the mailbox was selected (VANISHED (EARLIER)).
+     */
+    bool earlier;
+};
+
+}
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(KIMAP2::MailBoxEvent::Types)
+
+#endif
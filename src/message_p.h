@@ -23,40 +23,297 @@
 #include <QtCore/QByteArray>
 #include <QtCore/QList>
 #include <QtCore/QMetaType>
+#include <QtCore/QSharedData>
+#include <QtCore/QVector>
+
+#include <string.h>
 
 namespace KIMAP2
 {
 
 struct Message {
+    /**
+     * A range of bytes inside a shared, immutable buffer.
+     *
+     * A slice keeps the buffer it refers to alive, so tokens can be handed out
+     * without copying them out of the receive buffer. The data is only copied
+     * once a consumer asks for a QByteArray covering part of the buffer.
+     */
+    class Slice
+    {
+    public:
+        Slice()
+            : m_offset(0), m_size(0) { }
+        explicit Slice(const QByteArray &data)
+            : m_data(data), m_offset(0), m_size(data.size()) { }
+        Slice(const QByteArray &chunk, int offset, int size)
+            : m_data(chunk), m_offset(offset), m_size(size) { }
+
+        inline const char *constData() const
+        {
+            return m_data.constData() + m_offset;
+        }
+        inline int size() const
+        {
+            return m_size;
+        }
+        inline bool isEmpty() const
+        {
+            return m_size == 0;
+        }
+        inline bool isNull() const
+        {
+            return m_data.isNull();
+        }
+        /**
+         * Returns true if the slice refers to a part of a larger buffer.
+         */
+        inline bool isView() const
+        {
+            return m_offset != 0 || m_size != m_data.size();
+        }
+        inline QByteArray toByteArray() const
+        {
+            if (!isView()) {
+                return m_data;
+            }
+            return QByteArray(constData(), m_size);
+        }
+        inline bool operator==(const QByteArray &other) const
+        {
+            return m_size == other.size() && !memcmp(constData(), other.constData(), m_size);
+        }
+        inline bool operator!=(const QByteArray &other) const
+        {
+            return !operator==(other);
+        }
+        inline bool operator==(const char *other) const
+        {
+            return m_size == int(qstrlen(other)) && !memcmp(constData(), other, m_size);
+        }
+        inline bool operator!=(const char *other) const
+        {
+            return !operator==(other);
+        }
+
+        /**
+         * A range of @p size bytes at @p offset of a buffer that isn't known yet, see within().
+         */
+        static inline Slice placeholder(int offset, int size)
+        {
+            return Slice(QByteArray(), offset, size);
+        }
+        /**
+         * The range of a placeholder inside of @p enclosing.
+         */
+        inline Slice within(const Slice &enclosing) const
+        {
+            Q_ASSERT(m_offset + m_size <= enclosing.m_size);
+            return Slice(enclosing.m_data, enclosing.m_offset + m_offset, m_size);
+        }
+
+    private:
+        QByteArray m_data;
+        int m_offset;
+        int m_size;
+    };
+
+    class Part;
+
+    /**
+     * The items of a list.
+     *
+     * Refers to the storage of the message the list belongs to.
+     */
+    class PartRange
+    {
+    public:
+        typedef const Part *const_iterator;
+        typedef const_iterator iterator;
+
+        PartRange()
+            : m_begin(nullptr), m_size(0) { }
+        PartRange(const Part *begin, int size)
+            : m_begin(begin), m_size(size) { }
+
+        inline const Part *begin() const
+        {
+            return m_begin;
+        }
+        inline const Part *end() const
+        {
+            return m_begin + m_size;
+        }
+        inline const Part *constBegin() const
+        {
+            return begin();
+        }
+        inline const Part *constEnd() const
+        {
+            return end();
+        }
+        inline int size() const
+        {
+            return m_size;
+        }
+        inline bool isEmpty() const
+        {
+            return m_size == 0;
+        }
+        inline const Part &at(int i) const
+        {
+            Q_ASSERT(i >= 0 && i < m_size);
+            return m_begin[i];
+        }
+        inline const Part &operator[](int i) const
+        {
+            return at(i);
+        }
+        inline const Part &first() const
+        {
+            return at(0);
+        }
+        inline const Part &last() const
+        {
+            return at(m_size - 1);
+        }
+
+    private:
+        const Part *m_begin;
+        int m_size;
+    };
+
+    /**
+     * Storage for the items of all lists of a message.
+     *
+     * The items of each list are stored next to each other, so parsing a response
+     * doesn't need an allocation per list. The parser reuses the arena for the next
+     * response unless a consumer kept a copy of the message.
+     */
+    class Arena : public QSharedData
+    {
+    public:
+        QVector<Part> parts;
+    };
+
+    /**
+     * A string or a list of a response.
+     *
+     * The items of a list live in the arena of the message, which the part doesn't keep
+     * alive on its own. A list part is thus only valid as long as its message, so whoever
+     * keeps a part across responses has to keep a copy of the message as well.
+     */
     class Part
     {
     public:
         enum Type { String = 0, List };
 
         explicit Part(const QByteArray &string)
-            : m_type(String), m_string(string) { }
-        explicit Part(const QList<QByteArray> &list)
-            : m_type(List), m_list(list) { }
+            : m_type(String), m_string(string), m_arena(nullptr), m_first(0), m_count(0) { }
+        explicit Part(const Slice &string)
+            : m_type(String), m_string(string), m_arena(nullptr), m_first(0), m_count(0) { }
+        /**
+         * A list of the @p count items starting at @p first in @p arena.
+         *
+         * For lists nested in another list @p text is the list as it appeared in the response,
+         * including the parentheses.
+         */
+        Part(const Arena *arena, int first, int count, const Slice &text = Slice())
+            : m_type(List), m_string(text), m_arena(arena), m_first(first), m_count(count) { }
 
         inline Type type() const
         {
             return m_type;
         }
+        /**
+         * The string, or the text of a nested list.
+         */
         inline QByteArray toString() const
         {
-            return m_string;
+            return m_string.toByteArray();
         }
+        /**
+         * The items of the list, where nested lists are represented by their text.
+         */
         inline QList<QByteArray> toList() const
         {
-            return m_list;
+            QList<QByteArray> list;
+            const PartRange items = children();
+            list.reserve(items.size());
+            for (const Part &item : items) {
+                list << item.toString();
+            }
+            return list;
+        }
+        /**
+         * The items of the list, with nested lists as parts of their own.
+         *
+         * Only valid as long as the message the list belongs to.
+         */
+        inline PartRange children() const
+        {
+            if (!m_count) {
+                return PartRange();
+            }
+            //Fails for parts that outlived their message, once its arena is reused
+            Q_ASSERT(m_first + m_count <= m_arena->parts.size());
+            return PartRange(m_arena->parts.constData() + m_first, m_count);
+        }
+
+        /**
+         * Turns the placeholder for the text of a nested list into a part of @p enclosing,
+         * the text of the list it is nested in.
+         */
+        inline void resolveText(const Slice &enclosing)
+        {
+            if (m_type == List && m_string.isNull() && m_string.size()) {
+                m_string = m_string.within(enclosing);
+            }
+        }
+
+        /**
+         * Access to the string without copying it out of the receive buffer.
+         */
+        inline const Slice &stringSlice() const
+        {
+            return m_string;
         }
 
     private:
+        friend struct Message;
+
         Type m_type;
-        QByteArray m_string;
-        QList<QByteArray> m_list;
+        Slice m_string;
+        const Arena *m_arena;
+        int m_first;
+        int m_count;
     };
 
+    /**
+     * Copies all data that is still shared with the parser.
+     *
+     * Only necessary for consumers that keep the message around after it has been delivered,
+     * as the tokens otherwise keep the complete receive buffer they originate from alive,
+     * and the parser can't reuse the storage of the message for the next response.
+     */
+    inline void detach()
+    {
+        if (arena) {
+            Arena *copy = new Arena;
+            copy->parts = arena->parts;
+            arena = copy;
+            for (int i = 0; i < arena->parts.size(); i++) {
+                detach(arena->parts[i]);
+            }
+        }
+        for (int i = 0; i < content.size(); i++) {
+            detach(content[i]);
+        }
+        for (int i = 0; i < responseCode.size(); i++) {
+            detach(responseCode[i]);
+        }
+    }
+
     inline QByteArray toString() const
     {
         QByteArray result;
@@ -94,8 +351,77 @@ struct Message {
         return result;
     }
 
-    QList<Part> content;
-    QList<Part> responseCode;
+    QVector<Part> content;
+    QVector<Part> responseCode;
+    QExplicitlySharedDataPointer<Arena> arena;
+    //The number of bytes the response took on the wire, after decompression
+    qint64 size = 0;
+
+private:
+    inline void detach(Part &part)
+    {
+        if (part.m_string.isView()) {
+            part.m_string = Slice(part.m_string.toByteArray());
+        }
+        if (part.m_arena) {
+            part.m_arena = arena.data();
+        }
+    }
+};
+
+/**
+ * Consecutive responses, as delivered in a batch.
+ *
+ * Refers to storage owned by the parser, which is only valid during the callback.
+ */
+class MessageRange
+{
+public:
+    typedef const Message *const_iterator;
+    typedef const_iterator iterator;
+
+    MessageRange()
+        : m_begin(nullptr), m_size(0) { }
+    MessageRange(const Message *begin, int size)
+        : m_begin(begin), m_size(size) { }
+
+    inline const Message *begin() const
+    {
+        return m_begin;
+    }
+    inline const Message *end() const
+    {
+        return m_begin + m_size;
+    }
+    inline int size() const
+    {
+        return m_size;
+    }
+    inline bool isEmpty() const
+    {
+        return m_size == 0;
+    }
+    inline const Message &at(int i) const
+    {
+        Q_ASSERT(i >= 0 && i < m_size);
+        return m_begin[i];
+    }
+    inline const Message &operator[](int i) const
+    {
+        return at(i);
+    }
+    /**
+     * The @p size responses starting at @p pos.
+     */
+    inline MessageRange mid(int pos, int size) const
+    {
+        Q_ASSERT(pos >= 0 && size >= 0 && pos + size <= m_size);
+        return MessageRange(m_begin + pos, size);
+    }
+
+private:
+    const Message *m_begin;
+    int m_size;
 };
 
 }
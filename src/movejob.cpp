@@ -121,7 +121,7 @@ void MoveJob::handleResponse(const Message &response)
 {
     Q_D(MoveJob);
 
-    for (QList<Message::Part>::ConstIterator it = response.responseCode.begin();
+    for (QVector<Message::Part>::ConstIterator it = response.responseCode.begin();
             it != response.responseCode.end(); ++it) {
         if (it->toString() == "COPYUID") {
             it = it + 3;
@@ -0,0 +1,280 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "multiappendjob.h"
+
+#include <QtCore/QLocale>
+#include <QtCore/QQueue>
+
+#include "job_p.h"
+#include "message_p.h"
+#include "session_p.h"
+#include "rfccodecs.h"
+
+namespace KIMAP2
+{
+class MultiAppendJobPrivate : public JobPrivate
+{
+public:
+    MultiAppendJobPrivate(MultiAppendJob *job, Session *session, const QString &name)
+        : JobPrivate(session, name), q(job),
+          maxCount(100), maxBytes(10 * 1024 * 1024),
+          multiAppend(false), uidValidity(-1), appendedCount(0),
+          nextContent(0), waitingForContinuation(false), batchAppendedCount(0) { }
+    ~MultiAppendJobPrivate() { }
+
+    bool hasMoreMessages();
+    QByteArray announce(const MultiAppendJob::Item &item);
+    void sendBatch();
+    void sendContents();
+    void appendUidReceived(const Message &response);
+
+    MultiAppendJob *const q;
+
+    QString mailBox;
+    QQueue<MultiAppendJob::Item> pending;
+    std::function<bool(MultiAppendJob::Item &)> source;
+    int maxCount;
+    qint64 maxBytes;
+
+    bool multiAppend;
+    qint64 uidValidity;
+    QList<ImapSet> uids;
+    qint64 appendedCount;
+
+    //The batch that is being sent, and the message whose content goes out next
+    QList<MultiAppendJob::Item> batch;
+    int nextContent;
+    bool waitingForContinuation;
+    //The messages of the batch that were appended so far, and their UIDs
+    int batchAppendedCount;
+    ImapSet batchUids;
+};
+}
+
+using namespace KIMAP2;
+
+bool MultiAppendJobPrivate::hasMoreMessages()
+{
+    if (pending.isEmpty() && source) {
+        MultiAppendJob::Item item;
+        if (source(item)) {
+            pending.enqueue(item);
+        } else {
+            source = nullptr;
+        }
+    }
+    return !pending.isEmpty();
+}
+
+// The flags, date and literal size of a message, as they go in front of its content.
+QByteArray MultiAppendJobPrivate::announce(const MultiAppendJob::Item &item)
+{
+    QByteArray parameters;
+    if (!item.flags.isEmpty()) {
+        parameters += '(';
+        foreach (const QByteArray &flag, item.flags) {
+            parameters += flag + ' ';
+        }
+        parameters.chop(1);
+        parameters += ") ";
+    }
+
+    if (!item.internalDate.isNull()) {
+        const QDateTime utcDateTime = item.internalDate.toUTC();
+        parameters += '\"' + QLocale::c().toString(utcDateTime, QStringLiteral("dd-MMM-yyyy hh:mm:ss")).toLatin1() + " +0000" + "\" ";
+    }
+
+    waitingForContinuation = !sessionInternal()->canSendNonSynchronizingLiteral(item.content.size());
+    parameters += '{' + QByteArray::number(item.content.size()) + (waitingForContinuation ? "}" : "+}");
+    return parameters;
+}
+
+void MultiAppendJobPrivate::sendBatch()
+{
+    batch.clear();
+    batchUids = ImapSet();
+    batchAppendedCount = 0;
+    nextContent = 0;
+
+    qint64 bytes = 0;
+    while (batch.size() < maxCount && hasMoreMessages()) {
+        const qint64 size = pending.head().content.size();
+        if (!batch.isEmpty() && bytes + size > maxBytes) {
+            break;
+        }
+        bytes += size;
+        batch << pending.dequeue();
+    }
+
+    sendCommand("APPEND", '\"' + KIMAP2::encodeImapFolderName(mailBox.toUtf8()) + "\" " + announce(batch.first()));
+    sendContents();
+}
+
+// Sends the contents of the batch, up to the next literal we have to wait for the continuation for.
+void MultiAppendJobPrivate::sendContents()
+{
+    const QByteArray mailBoxName = '\"' + KIMAP2::encodeImapFolderName(mailBox.toUtf8()) + '\"';
+    while (!waitingForContinuation && nextContent < batch.size()) {
+        //Only needed until it is sent
+        QByteArray content;
+        qSwap(content, batch[nextContent].content);
+        nextContent++;
+
+        if (nextContent == batch.size()) {
+            sessionInternal()->sendData(q, content);
+        } else if (multiAppend) {
+            sessionInternal()->sendData(q, content + ' ' + announce(batch[nextContent]));
+        } else {
+            sessionInternal()->sendData(q, content);
+            sendCommand("APPEND", mailBoxName + ' ' + announce(batch[nextContent]));
+        }
+    }
+}
+
+void MultiAppendJobPrivate::appendUidReceived(const Message &response)
+{
+    // [APPENDUID 38505 3955:3964]
+    for (QVector<Message::Part>::ConstIterator it = response.responseCode.begin();
+            it != response.responseCode.end(); ++it) {
+        if (it->toString() == "APPENDUID") {
+            if (response.responseCode.end() - it > 2) {
+                uidValidity = (it + 1)->toString().toLongLong();
+                foreach (const ImapInterval &interval, ImapSet::fromImapSequenceSet((it + 2)->toString()).intervals()) {
+                    batchUids.add(interval);
+                }
+            }
+            break;
+        }
+    }
+}
+
+MultiAppendJob::MultiAppendJob(Session *session)
+    : Job(*new MultiAppendJobPrivate(this, session, "MultiAppend"))
+{
+}
+
+MultiAppendJob::~MultiAppendJob()
+{
+}
+
+void MultiAppendJob::setMailBox(const QString &mailBox)
+{
+    Q_D(MultiAppendJob);
+    d->mailBox = mailBox;
+}
+
+QString MultiAppendJob::mailBox() const
+{
+    Q_D(const MultiAppendJob);
+    return d->mailBox;
+}
+
+void MultiAppendJob::addMessage(const QByteArray &content, const QList<QByteArray> &flags, const QDateTime &internalDate)
+{
+    Q_D(MultiAppendJob);
+    const Item item = { content, flags, internalDate };
+    d->pending.enqueue(item);
+}
+
+void MultiAppendJob::setMessageSource(std::function<bool(Item &item)> source)
+{
+    Q_D(MultiAppendJob);
+    d->source = source;
+}
+
+void MultiAppendJob::setBatchLimits(int count, qint64 bytes)
+{
+    Q_D(MultiAppendJob);
+    d->maxCount = qMax(1, count);
+    d->maxBytes = bytes;
+}
+
+qint64 MultiAppendJob::uidValidity() const
+{
+    Q_D(const MultiAppendJob);
+    return d->uidValidity;
+}
+
+QList<ImapSet> MultiAppendJob::uids() const
+{
+    Q_D(const MultiAppendJob);
+    return d->uids;
+}
+
+qint64 MultiAppendJob::appendedCount() const
+{
+    Q_D(const MultiAppendJob);
+    return d->appendedCount;
+}
+
+void MultiAppendJob::doStart()
+{
+    Q_D(MultiAppendJob);
+    if (!d->hasMoreMessages()) {
+        emitResult();
+        return;
+    }
+    d->multiAppend = d->sessionInternal()->knownCapabilities().contains(QStringLiteral("MULTIAPPEND"), Qt::CaseInsensitive);
+    d->sendBatch();
+}
+
+void MultiAppendJob::handleResponse(const Message &response)
+{
+    Q_D(MultiAppendJob);
+
+    if (!response.content.isEmpty() && response.content[0].toString() == "+") {
+        if (d->waitingForContinuation) {
+            d->waitingForContinuation = false;
+            d->sendContents();
+        }
+        return;
+    }
+
+    if (response.content.size() < 2 || !d->tags.contains(response.content[0].toString())) {
+        handleErrorReplies(response);
+        return;
+    }
+
+    const bool ok = response.content[1].toString() == "OK";
+    if (ok) {
+        //Without MULTIAPPEND every message has its own command, which may succeed even if another one failed
+        d->appendUidReceived(response);
+        d->batchAppendedCount += d->multiAppend ? d->batch.size() : 1;
+    }
+
+    //The last command of the batch
+    if (d->tags.size() == 1) {
+        if (d->batchAppendedCount > 0) {
+            d->batchUids.optimize();
+            d->uids << d->batchUids;
+            d->appendedCount += d->batchAppendedCount;
+            emit batchAppended(d->batchUids, d->batchAppendedCount);
+        }
+
+        if (ok && !error() && d->nextContent == d->batch.size() && d->hasMoreMessages()) {
+            d->tags.clear();
+            d->sendBatch();
+            return;
+        }
+    }
+
+    handleErrorReplies(response);
+}
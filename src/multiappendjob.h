@@ -0,0 +1,133 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_MULTIAPPENDJOB_H
+#define KIMAP2_MULTIAPPENDJOB_H
+
+#include "kimap2_export.h"
+
+#include "imapset.h"
+#include "job.h"
+
+#include <QDateTime>
+
+#include <functional>
+
+namespace KIMAP2
+{
+
+class Session;
+struct Message;
+class MultiAppendJobPrivate;
+
+/**
+ * Appends many messages to a mailbox.
+ *
+ * The messages are sent in batches, each batch with a single MULTIAPPEND command
+ * (<a href="http://tools.ietf.org/html/rfc3502">RFC 3502</a>) if the server announced
+ * the capability, and with one APPEND command per message that go out without waiting
+ * for each other otherwise. A batch of MULTIAPPEND is appended as a whole or not at all,
+ * with separate APPEND commands every message whose command succeeded is appended.
+ *
+ * The job stops at the first batch that fails.
+ *
+ * This job can only be run when the session is in the
+ * authenticated (or selected) state.
+ */
+class KIMAP2_EXPORT MultiAppendJob : public Job
+{
+    Q_OBJECT
+    Q_DECLARE_PRIVATE(MultiAppendJob)
+
+public:
+    /**
+     * A message to append, see AppendJob for the meaning of the fields.
+     */
+    struct Item {
+        QByteArray content;
+        QList<QByteArray> flags;
+        QDateTime internalDate;
+    };
+
+    explicit MultiAppendJob(Session *session);
+    virtual ~MultiAppendJob();
+
+    /**
+     * Set the mailbox to append the messages to.
+     *
+     * @param mailBox  the (unquoted) name of the mailbox
+     */
+    void setMailBox(const QString &mailBox);
+    QString mailBox() const;
+
+    /**
+     * Add a message to append.
+     */
+    void addMessage(const QByteArray &content, const QList<QByteArray> &flags = QList<QByteArray>(),
+                    const QDateTime &internalDate = QDateTime());
+
+    /**
+     * Pull the messages to append from @p source once the messages added with addMessage() are sent.
+     *
+     * The source is called for the next message whenever a batch is put together, so only one batch
+     * has to be in memory at a time. It fills in the item and returns true, or returns false once there
+     * are no more messages.
+     */
+    void setMessageSource(std::function<bool(Item &item)> source);
+
+    /**
+     * Limit a batch to @p count messages and @p bytes of content. A batch contains at least one message,
+     * even if it is larger. The defaults are 100 messages and 10 MiB.
+     */
+    void setBatchLimits(int count, qint64 bytes);
+
+    /**
+     * Returns the UIDVALIDITY of the mailbox, as reported with the UIDs, or -1 if the server didn't.
+     */
+    qint64 uidValidity() const;
+
+    /**
+     * Returns the UIDs of the appended messages, one set per batch in the order the batches were sent.
+     *
+     * A set is empty if the server doesn't report UIDs (UIDPLUS, RFC 4315).
+     */
+    QList<ImapSet> uids() const;
+
+    /**
+     * Returns the number of messages that were appended.
+     */
+    qint64 appendedCount() const;
+
+Q_SIGNALS:
+    /**
+     * Emitted once a batch is done, with the @p count messages of it that were appended.
+     *
+     * @param uids  the UIDs of the messages, empty if the server doesn't report them
+     */
+    void batchAppended(const KIMAP2::ImapSet &uids, int count);
+
+protected:
+    void doStart() Q_DECL_OVERRIDE;
+    void handleResponse(const Message &response) Q_DECL_OVERRIDE;
+};
+
+}
+
+#endif
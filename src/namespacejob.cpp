@@ -27,32 +27,6 @@
 #include "rfccodecs.h"
 #include "session_p.h"
 
-static QList<QByteArray> parseParenthesizedList(const QByteArray &data)
-{
-    QList<QByteArray> result;
-    if (data.isEmpty()) {
-        return result;
-    }
-    if (data.at(0) != '(') {
-        return result;
-    }
-    bool parsingString = false;
-    int start = 0;
-    for (int pos = 1; pos < data.size(); pos++) {
-        //Match unescaped quotes
-        if (data.at(pos) == '\"' && data.at(pos - 1) != '\\') {
-            if (parsingString) {
-                parsingString = false;
-                result << data.mid(start, pos - start);
-            } else {
-                parsingString = true;
-                start = pos + 1;
-            }
-        }
-    }
-    return result;
-}
-
 namespace KIMAP2
 {
 class NamespaceJobPrivate : public JobPrivate
@@ -61,19 +35,19 @@ public:
     NamespaceJobPrivate(Session *session,  const QString &name) : JobPrivate(session, name) { }
     ~NamespaceJobPrivate() { }
 
-    QList<MailBoxDescriptor> processNamespaceList(const QList<QByteArray> &namespaceList)
+    QList<MailBoxDescriptor> processNamespaceList(const Message::Part &namespaceList)
     {
         QList<MailBoxDescriptor> result;
 
-        foreach (const QByteArray &namespaceItem, namespaceList) {
-            QList<QByteArray> parts = parseParenthesizedList(namespaceItem);
-            if (parts.size() < 2) {
-                qWarning() << "Not enough parts in namespace item " << namespaceItem;
+        foreach (const Message::Part &namespaceItem, namespaceList.children()) {
+            const Message::PartRange parts = namespaceItem.children();
+            if (parts.size() < 2 || parts[1].toString() == "NIL") {
+                qWarning() << "Not enough parts in namespace item " << namespaceItem.toString();
                 continue;
             }
             MailBoxDescriptor descriptor;
-            descriptor.name = QString::fromUtf8(decodeImapFolderName(parts[0]));
-            descriptor.separator = QLatin1Char(parts[1][0]);
+            descriptor.name = QString::fromUtf8(decodeImapFolderName(parts[0].toString()));
+            descriptor.separator = QLatin1Char(parts[1].toString()[0]);
 
             result << descriptor;
         }
@@ -135,6 +109,15 @@ bool NamespaceJob::containsEmptyNamespace() const
 void NamespaceJob::doStart()
 {
     Q_D(NamespaceJob);
+    const SessionSnapshot *snapshot = d->sessionInternal()->restoredSnapshotForUser();
+    if (snapshot && snapshot->namespacesKnown) {
+        d->personalNamespaces = snapshot->personalNamespaces;
+        d->userNamespaces = snapshot->userNamespaces;
+        d->sharedNamespaces = snapshot->sharedNamespaces;
+        d->sessionInternal()->namespacesReceived(d->personalNamespaces, d->userNamespaces, d->sharedNamespaces);
+        emitResult();
+        return;
+    }
     d->sendCommand("NAMESPACE", {});
 }
 
@@ -145,13 +128,15 @@ void NamespaceJob::handleResponse(const Message &response)
         if (response.content.size() >= 5 &&
                 response.content[1].toString() == "NAMESPACE") {
             // Personal namespaces
-            d->personalNamespaces = d->processNamespaceList(response.content[2].toList());
+            d->personalNamespaces = d->processNamespaceList(response.content[2]);
 
             // User namespaces
-            d->userNamespaces = d->processNamespaceList(response.content[3].toList());
+            d->userNamespaces = d->processNamespaceList(response.content[3]);
 
             // Shared namespaces
-            d->sharedNamespaces = d->processNamespaceList(response.content[4].toList());
+            d->sharedNamespaces = d->processNamespaceList(response.content[4]);
+
+            d->sessionInternal()->namespacesReceived(d->personalNamespaces, d->userNamespaces, d->sharedNamespaces);
         }
     }
 }
@@ -27,13 +27,13 @@ using namespace KIMAP2;
 QMap<QByteArray, QPair<qint64, qint64> > QuotaJobBasePrivate::readQuota(const Message::Part &content)
 {
     QMap<QByteArray, QPair<qint64, qint64> > quotaMap;
-    QList<QByteArray> quotas = content.toList();
+    const Message::PartRange quotas = content.children();
 
     int i = 0;
     while (i < quotas.size() - 2) {
-        QByteArray resource = quotas[i].toUpper();
-        qint64 usage = quotas[i + 1].toInt();
-        qint64 limit = quotas[i + 2].toInt();
+        QByteArray resource = quotas[i].toString().toUpper();
+        qint64 usage = quotas[i + 1].toString().toInt();
+        qint64 limit = quotas[i + 2].toString().toInt();
         quotaMap[resource] = qMakePair(usage, limit);
         i += 3;
     }
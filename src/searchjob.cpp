@@ -325,6 +325,8 @@ public:
     }
     ~SearchJobPrivate() { }
 
+    void handleResponses(const MessageRange &responses) Q_DECL_OVERRIDE;
+
     QByteArray charset;
     QList<QByteArray> criterias;
     QMap<SearchJob::SearchCriteria, QByteArray > criteriaMap;
@@ -414,7 +416,7 @@ void SearchJob::handleResponse(const Message &response)
     if (handleErrorReplies(response) == NotHandled) {
         if (response.content.size() >= 1 && response.content[0].toString() == "+") {
             if (d->term.isNull()) {
-                d->sessionInternal()->sendData(d->contents[d->nextContent]);
+                d->sessionInternal()->sendData(this, d->contents[d->nextContent]);
             } else {
                 qCWarning(KIMAP2_LOG) << "The term API only supports inline strings.";
             }
@@ -427,6 +429,17 @@ void SearchJob::handleResponse(const Message &response)
     }
 }
 
+void SearchJobPrivate::handleResponses(const MessageRange &responses)
+{
+    for (const Message &response : responses) {
+        if (response.content.size() >= 2 && response.content[1].stringSlice() == "SEARCH") {
+            for (int i = 2; i < response.content.size(); i++) {
+                results.append(response.content[i].toString().toInt());
+            }
+        }
+    }
+}
+
 void SearchJob::setCharset(const QByteArray &charset)
 {
     Q_D(SearchJob);
@@ -169,6 +169,12 @@ void SelectJob::handleResponse(const Message &response)
 {
     Q_D(SelectJob);
 
+    //Record the selected mailbox before the result is emitted
+    if (response.content.size() >= 2 && d->tags.contains(response.content[0].toString())
+            && response.content[1].toString() == "OK") {
+        d->sessionInternal()->mailBoxSelected(d->mailBox, d->uidValidity, d->highestmodseq);
+    }
+
     if (handleErrorReplies(response) == NotHandled) {
         if (response.content.size() >= 2) {
             QByteArray code = response.content[1].toString();
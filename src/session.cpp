@@ -24,29 +24,58 @@
 #include "session.h"
 #include "session_p.h"
 
+#include <QCoreApplication>
 #include <QDebug>
+#include <QSslConfiguration>
 
 #include "kimap_debug.h"
 
+#include "deflatestream.h"
+#include "idlejob.h"
 #include "job.h"
+#include "job_p.h"
 #include "message_p.h"
 #include "sessionlogger_p.h"
+#include "sessionthread_p.h"
+#include "tlssessioncache.h"
+#include "trafficcapture.h"
 #include "rfccodecs.h"
 #include "imapstreamparser.h"
 
 Q_DECLARE_METATYPE(QSsl::SslProtocol)
 Q_DECLARE_METATYPE(QSslSocket::SslMode)
 static const int _kimap_sslVersionId = qRegisterMetaType<QSsl::SslProtocol>();
+//Needed to deliver the socket signals across threads
+static const int _kimap_socketStateId = qRegisterMetaType<QAbstractSocket::SocketState>();
+static const int _kimap_socketErrorId = qRegisterMetaType<QAbstractSocket::SocketError>();
+static const int _kimap_sslErrorsId = qRegisterMetaType<QList<QSslError> >();
 
 using namespace KIMAP2;
 
 Session::Session(const QString &hostName, quint16 port, QObject *parent)
+    : Session(hostName, port, SameThreadIo, parent)
+{
+}
+
+Session::Session(const QString &hostName, quint16 port, IoMode ioMode, QObject *parent)
     : QObject(parent), d(new SessionPrivate(this))
 {
     if (!qEnvironmentVariableIsEmpty("KIMAP2_LOGFILE")) {
         d->logger.reset(new SessionLogger);
         qCInfo(KIMAP2_LOG) << "Logging traffic to: " << QLatin1String(qgetenv("KIMAP2_LOGFILE"));
     }
+    if (!qEnvironmentVariableIsEmpty("KIMAP2_CAPTURE")) {
+        static qint64 nextId = 0;
+        const QString fileName = QString::fromLocal8Bit(qgetenv("KIMAP2_CAPTURE"))
+                                 + QLatin1Char('.') + QString::number(QCoreApplication::applicationPid())
+                                 + QLatin1Char('.') + QString::number(++nextId);
+        d->capture.reset(new TrafficCapture(fileName));
+        TrafficCapture *capture = d->capture.data();
+        d->stream->onDataRead([capture](const char *data, int size) {
+            capture->record(TrafficCapture::Received, data, size);
+        });
+        qCInfo(KIMAP2_LOG) << "Capturing traffic to: " << fileName;
+    }
     if (qEnvironmentVariableIsSet("KIMAP2_TRAFFIC")) {
         d->dumpTraffic = true;
         qCInfo(KIMAP2_LOG) << "Dumping traffic.";
@@ -61,12 +90,34 @@ Session::Session(const QString &hostName, quint16 port, QObject *parent)
     d->hostName = hostName;
     d->port = port;
 
-    connect(d->socket.data(), &QIODevice::readyRead, d, &SessionPrivate::readMessage);
+    if (ioMode == WorkerThreadIo) {
+        d->ioThread.reset(new SessionThread(d->socket.data(), d->stream.data()));
+        connect(d->ioThread.data(), &SessionThread::responsesReceived,
+                d, &SessionPrivate::responsesParsed);
+        connect(d->ioThread.data(), &SessionThread::sessionTicketReceived,
+                d, &SessionPrivate::sessionTicketReceived);
+        connect(d->ioThread.data(), &SessionThread::bytesWritten,
+                d, &SessionPrivate::socketBytesWritten);
+    } else {
+        connect(d->socket.data(), &QIODevice::readyRead, d, &SessionPrivate::readMessage);
+        connect(d->socket.data(), &QIODevice::bytesWritten, d, &SessionPrivate::socketBytesWritten);
+        connect(d->socket.data(), &QSslSocket::encrypted, d, &SessionPrivate::exportTlsSession);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+        //With TLS 1.3 the tickets only arrive after the handshake
+        connect(d->socket.data(), &QSslSocket::newSessionTicketReceived, d, &SessionPrivate::exportTlsSession);
+#endif
+    }
 
     connect(d->socket.data(), &QSslSocket::connected,
             d, &SessionPrivate::socketConnected);
+    //Errors can only be ignored while the socket waits for the handler
     connect(d->socket.data(), static_cast<void (QSslSocket::*)(const QList<QSslError>&)>(&QSslSocket::sslErrors),
-            d, &SessionPrivate::handleSslErrors);
+            d, &SessionPrivate::handleSslErrors, d->ioThread ? Qt::BlockingQueuedConnection : Qt::AutoConnection);
+    if (d->ioThread) {
+        //Hands the errors the handler ignored to the socket, on the thread it lives in
+        connect(d->socket.data(), static_cast<void (QSslSocket::*)(const QList<QSslError>&)>(&QSslSocket::sslErrors),
+                d->ioThread.data(), &SessionThread::applyIgnoredSslErrors, Qt::DirectConnection);
+    }
     connect(d->socket.data(), static_cast<void (QSslSocket::*)(QAbstractSocket::SocketError)>(&QSslSocket::error),
             d, &SessionPrivate::socketError);
 
@@ -76,8 +127,9 @@ Session::Session(const QString &hostName, quint16 port, QObject *parent)
             d, &SessionPrivate::socketActivity);
     connect(d->socket.data(), &QIODevice::readyRead,
             d, &SessionPrivate::socketActivity);
-    connect(d->socket.data(), &QAbstractSocket::stateChanged, [this](QAbstractSocket::SocketState state) {
+    connect(d->socket.data(), &QAbstractSocket::stateChanged, d, [this](QAbstractSocket::SocketState state) {
         qCDebug(KIMAP2_LOG) << "Socket state changed: " << state;
+        d->lastSocketState = state;
         //The disconnected signal will not fire if we fail to lookup the host, but this will.
         if (state == QAbstractSocket::UnconnectedState) {
             d->socketDisconnected();
@@ -93,13 +145,29 @@ Session::Session(const QString &hostName, quint16 port, QObject *parent)
     connect(&d->socketTimer, &QTimer::timeout,
             d, &SessionPrivate::onSocketTimeout);
 
+    d->writeTimer.setSingleShot(true);
+    connect(&d->writeTimer, &QTimer::timeout,
+            d, &SessionPrivate::writeDataQueue);
+
+    d->autoIdleTimer.setSingleShot(true);
+    d->autoIdleTimer.setInterval(1000);
+    connect(&d->autoIdleTimer, &QTimer::timeout,
+            d, &SessionPrivate::startAutoIdle);
+
     d->socketProgressTimer.setSingleShot(false);
     connect(&d->socketProgressTimer, &QTimer::timeout,
             d, &SessionPrivate::onSocketProgressTimeout);
 
     d->startSocketTimer();
     qCDebug(KIMAP2_LOG) << "Connecting to: " << hostName << port;
-    d->socket->connectToHost(hostName, port);
+    if (d->ioThread) {
+        //Don't let jobs fail for lack of a connection before the I/O thread got to it
+        d->lastSocketState = QAbstractSocket::HostLookupState;
+        QMetaObject::invokeMethod(d->ioThread.data(), "connectToHost", Qt::QueuedConnection,
+                                  Q_ARG(QString, hostName), Q_ARG(quint16, port));
+    } else {
+        d->socket->connectToHost(hostName, port);
+    }
 }
 
 Session::~Session()
@@ -141,7 +209,164 @@ QByteArray Session::serverGreeting() const
 
 int Session::jobQueueSize() const
 {
-    return d->queue.size() + (d->jobRunning ? 1 : 0);
+    const int size = d->queue.size() + (d->jobRunning ? 1 + d->pipeline.size() : 0);
+    return d->autoIdleJob ? size - 1 : size;
+}
+
+void Session::setPipeliningEnabled(bool enabled)
+{
+    d->pipeliningEnabled = enabled;
+    if (enabled) {
+        d->startNext();
+    }
+}
+
+bool Session::isPipeliningEnabled() const
+{
+    return d->pipeliningEnabled;
+}
+
+void Session::setStarvationLimit(int count)
+{
+    d->starvationLimit = count;
+}
+
+int Session::starvationLimit() const
+{
+    return d->starvationLimit;
+}
+
+void Session::setAutoIdleEnabled(bool enabled)
+{
+    d->setAutoIdleEnabled(enabled);
+}
+
+bool Session::isAutoIdleEnabled() const
+{
+    return d->autoIdleEnabled;
+}
+
+void Session::setAutoIdleDelay(int delay)
+{
+    d->autoIdleTimer.setInterval(delay);
+}
+
+int Session::autoIdleDelay() const
+{
+    return d->autoIdleTimer.interval();
+}
+
+void Session::setWriteCoalescing(int threshold, int latency)
+{
+    d->setWriteCoalescing(threshold, latency);
+}
+
+qint64 Session::bytesWritten() const
+{
+    return d->bytesWritten;
+}
+
+qint64 Session::writeCount() const
+{
+    return d->writeCount;
+}
+
+void Session::setMetricsEnabled(bool enabled)
+{
+    if (enabled == isMetricsEnabled()) {
+        return;
+    }
+    if (enabled) {
+        d->tracker.reset(new CommandTracker);
+    } else {
+        d->tracker.reset();
+    }
+    if (d->ioThread) {
+        QMetaObject::invokeMethod(d->ioThread.data(), "setParseTimingEnabled", Qt::QueuedConnection, Q_ARG(bool, enabled));
+    } else {
+        d->stream->setParseTimingEnabled(enabled);
+    }
+}
+
+bool Session::isMetricsEnabled() const
+{
+    return !d->tracker.isNull();
+}
+
+void Session::onCommandCompleted(std::function<void(const CommandMetrics &)> callback)
+{
+    d->commandCompleted = callback;
+}
+
+int Session::subscribe(MailBoxEvent::Types types, std::function<void(const QVector<MailBoxEvent> &)> callback)
+{
+    const SessionPrivate::Subscription subscription = { d->nextSubscriptionId++, types, callback };
+    d->subscriptions << subscription;
+    d->subscribedTypes |= types;
+    return subscription.id;
+}
+
+void Session::unsubscribe(int id)
+{
+    d->subscribedTypes = MailBoxEvent::Types();
+    for (int i = d->subscriptions.size() - 1; i >= 0; i--) {
+        if (d->subscriptions[i].id == id) {
+            d->subscriptions.removeAt(i);
+        } else {
+            d->subscribedTypes |= d->subscriptions[i].types;
+        }
+    }
+}
+
+QHash<QByteArray, CommandStatistics> Session::commandStatistics() const
+{
+    return d->commandStatistics;
+}
+
+void Session::resetCommandStatistics()
+{
+    d->commandStatistics.clear();
+    d->queueWaitTimes.fill(Histogram());
+    d->idleExitTimes = Histogram();
+}
+
+Histogram Session::queueWaitTime(Job::Priority priority) const
+{
+    return d->queueWaitTimes.value(priority);
+}
+
+Histogram Session::idleExitTime() const
+{
+    return d->idleExitTimes;
+}
+
+SessionSnapshot Session::snapshot() const
+{
+    return d->snapshot;
+}
+
+void Session::restoreSnapshot(const SessionSnapshot &snapshot)
+{
+    if (d->state != Disconnected) {
+        qCWarning(KIMAP2_LOG) << "A snapshot can only be restored before the server greeting arrived";
+        return;
+    }
+    d->restored = snapshot;
+}
+
+bool Session::isSnapshotValid() const
+{
+    return d->snapshotValid;
+}
+
+void Session::setTlsSessionCache(const QSharedPointer<TlsSessionCache> &cache)
+{
+    d->tlsSessionCache = cache;
+}
+
+QSharedPointer<TlsSessionCache> Session::tlsSessionCache() const
+{
+    return d->tlsSessionCache;
 }
 
 void Session::close()
@@ -151,6 +376,11 @@ void Session::close()
 
 void Session::ignoreErrors(const QList<QSslError> &errors)
 {
+    //The socket belongs to the internal thread
+    if (d->ioThread) {
+        d->ioThread->ignoreSslErrors(errors);
+        return;
+    }
     d->socket->ignoreSslErrors(errors);
 }
 
@@ -177,11 +407,29 @@ SessionPrivate::SessionPrivate(Session *session)
       hostLookupInProgress(false),
       logger(Q_NULLPTR),
       currentJob(Q_NULLPTR),
+      pipeliningEnabled(false),
+      literalSinkOwner(Q_NULLPTR),
+      starvationLimit(16),
+      autoIdleEnabled(false),
+      autoIdleSupported(true),
+      autoIdleJob(Q_NULLPTR),
       tagCount(0),
       socketTimerInterval(30000),   // By default timeouts on 30s
       socketProgressInterval(3000),   // mention we're still alive every 3s
       socket(new QSslSocket),
       stream(new ImapStreamParser(socket.data())),
+      lastSocketState(QAbstractSocket::UnconnectedState),
+      writeFlushThreshold(16384),   // One TLS record
+      writeFlushLatency(0),
+      bytesWritten(0),
+      writeCount(0),
+      pendingSocketBytes(0),
+      streamOwner(Q_NULLPTR),
+      streamRemaining(0),
+      queueWaitTimes(Job::Background + 1),
+      lastParseTime(0),
+      snapshotValid(false),
+      nextSubscriptionId(1),
       accumulatedWaitTime(0),
       accumulatedProcessingTime(0),
       trackTime(false),
@@ -189,8 +437,14 @@ SessionPrivate::SessionPrivate(Session *session)
 {
     //For windows this needs to be set before connecting according to the docs
     socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
-    stream->onResponseReceived([this](const Message &message) {
-        responseReceived(message);
+    //Reserving keeps the capacity of the buffer when it is emptied after a write
+    writeBuffer.reserve(writeFlushThreshold);
+    //Jobs only look at responses while handling them, so there is no need to copy every token.
+    stream->setZeroCopyEnabled(true);
+    stream->onResponsesReceived([this](const MessageRange &messages) {
+        const qint64 parseTime = stream->parseTime();
+        responsesReceived(messages, parseTime - lastParseTime);
+        lastParseTime = parseTime;
     });
 }
 
@@ -205,8 +459,15 @@ void SessionPrivate::handleSslErrors(const QList<QSslError> &errors)
 
 void SessionPrivate::addJob(Job *job)
 {
+    if (job != autoIdleJob) {
+        stopAutoIdle();
+    }
     queue.append(job);
+    job->d_ptr->queuedTime.start();
     emit q->jobQueueSizeChanged(q->jobQueueSize());
+    if (tracker) {
+        tracker->jobQueued(job);
+    }
 
     QObject::connect(job, &KJob::result, this, &SessionPrivate::jobDone);
     QObject::connect(job, &QObject::destroyed, this, &SessionPrivate::jobDestroyed);
@@ -222,18 +483,33 @@ void SessionPrivate::doStartNext()
 {
     //Wait until we are ready to process
     if (queue.isEmpty()
-        || jobRunning
-        || socket->state() == QSslSocket::ConnectingState
-        || socket->state() == QSslSocket::HostLookupState) {
+        || socketState() == QSslSocket::ConnectingState
+        || socketState() == QSslSocket::HostLookupState) {
+        return;
+    }
+    const int index = nextJobIndex();
+    if (jobRunning && !canPipeline(queue.at(index))) {
         return;
     }
 
-    currentJob = queue.dequeue();
+    Job *job = queue.takeAt(index);
+    job->d_ptr->bypassCount = 0;
+    for (int i = 0; i < index; ++i) {
+        queue.at(i)->d_ptr->bypassCount++;
+    }
+    if (tracker) {
+        queueWaitTimes[job->d_ptr->priority].add(job->d_ptr->queuedTime.nsecsElapsed() / 1000);
+    }
+    if (currentJob) {
+        pipeline << job;
+    } else {
+        currentJob = job;
+    }
 
     //Since we aren't connecting we may never get back. Cancel the job
-    if (socket->state() == QSslSocket::UnconnectedState) {
-        qCDebug(KIMAP2_LOG) << "Cancelling job due to lack of connection: " << currentJob->metaObject()->className();
-        currentJob->connectionLost();
+    if (socketState() == QSslSocket::UnconnectedState) {
+        qCDebug(KIMAP2_LOG) << "Cancelling job due to lack of connection: " << job->metaObject()->className();
+        job->connectionLost();
         return;
     }
 
@@ -242,32 +518,209 @@ void SessionPrivate::doStartNext()
     }
     restartSocketTimer();
     jobRunning = true;
-    currentJob->doStart();
+    job->doStart();
+
+    //The next job may be able to go out right away as well
+    if (pipeliningEnabled) {
+        startNext();
+    }
+}
+
+// Jobs can only run alongside each other if it is clear which of them an untagged response belongs to.
+bool SessionPrivate::canPipeline(Job *job) const
+{
+    if (!pipeliningEnabled || !currentJob) {
+        return false;
+    }
+    const QList<QByteArray> &responses = job->d_ptr->pipelineResponses;
+    if (responses.isEmpty()) {
+        return false;
+    }
+    const QList<Job *> running = QList<Job *>() << currentJob << pipeline;
+    foreach (Job *runningJob, running) {
+        const QList<QByteArray> &runningResponses = runningJob->d_ptr->pipelineResponses;
+        if (runningResponses.isEmpty()) {
+            return false;
+        }
+        foreach (const QByteArray &response, responses) {
+            if (runningResponses.contains(response)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// The first queued job of the highest priority, but no job goes before a state changing one that was queued earlier.
+int SessionPrivate::nextJobIndex() const
+{
+    int next = 0;
+    for (int i = 0; i < queue.size(); ++i) {
+        const JobPrivate *job = queue.at(i)->d_ptr;
+        if (job->pipelineResponses.isEmpty()) {
+            return i == 0 ? i : next;
+        }
+        if (starvationLimit >= 0 && job->bypassCount >= starvationLimit) {
+            return i;
+        }
+        if (job->priority < queue.at(next)->d_ptr->priority) {
+            next = i;
+        }
+    }
+    return next;
+}
+
+bool SessionPrivate::pauseForPriorityJob(Job *job)
+{
+    if (queue.isEmpty()) {
+        return false;
+    }
+    //The remaining commands rely on the current state, so only jobs that don't change it may go in between
+    const JobPrivate *next = queue.at(nextJobIndex())->d_ptr;
+    if (next->pipelineResponses.isEmpty() || next->priority >= job->d_ptr->priority) {
+        return false;
+    }
+
+    qCDebug(KIMAP2_LOG) << "Pausing job for a job of higher priority: " << job->metaObject()->className();
+    removeRunningJob(job);
+    jobRunning = (currentJob != Q_NULLPTR);
+    //It was queued before everything that is still waiting
+    queue.prepend(job);
+    job->d_ptr->queuedTime.start();
+    if (tracker) {
+        tracker->jobQueued(job);
+    }
+    startNext();
+    return true;
+}
+
+void SessionPrivate::removeRunningJob(Job *job)
+{
+    if (tracker) {
+        tracker->jobDone(job);
+    }
+    //Literal sinks are installed per job and must not outlive it
+    if (literalSinkOwner == job) {
+        stream->setLiteralSink(0, nullptr);
+        literalSinkOwner = Q_NULLPTR;
+    }
+    for (auto it = tagOwners.begin(); it != tagOwners.end();) {
+        if (it.value() == job) {
+            it = tagOwners.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if (currentJob == job) {
+        currentJob = pipeline.isEmpty() ? Q_NULLPTR : pipeline.takeFirst();
+    } else {
+        pipeline.removeAll(job);
+    }
+    if (streamOwner == job) {
+        qCWarning(KIMAP2_LOG) << "Job stopped while streaming data, closing the connection.";
+        abortStream();
+    }
 }
 
 void SessionPrivate::jobDone(KJob *job)
 {
-    Q_UNUSED(job);
-    Q_ASSERT(job == currentJob);
     qCDebug(KIMAP2_LOG) << "Job done: " << job->metaObject()->className();
 
-    stopSocketTimer();
+    removeRunningJob(static_cast<KIMAP2::Job *>(job));
+    if (currentJob) {
+        restartSocketTimer();
+    } else {
+        stopSocketTimer();
+    }
+
+    if (job == autoIdleJob) {
+        if (autoIdleExitTime.isValid()) {
+            const qint64 exitTime = autoIdleExitTime.nsecsElapsed() / 1000;
+            qCDebug(KIMAP2_LOG) << "Left IDLE after" << exitTime << "us";
+            if (tracker) {
+                idleExitTimes.add(exitTime);
+            }
+        }
+        if (job->error() == CommandFailed) {
+            qCWarning(KIMAP2_LOG) << "The server rejected IDLE, not entering it again:" << job->errorString();
+            autoIdleSupported = false;
+        }
+        autoIdleJob = Q_NULLPTR;
+    }
 
-    jobRunning = false;
-    currentJob = Q_NULLPTR;
+    jobRunning = (currentJob != Q_NULLPTR);
     emit q->jobQueueSizeChanged(q->jobQueueSize());
     startNext();
+    scheduleAutoIdle();
 }
 
 void SessionPrivate::jobDestroyed(QObject *job)
 {
     queue.removeAll(static_cast<KIMAP2::Job *>(job));
-    if (currentJob == job) {
-        currentJob = Q_NULLPTR;
+    removeRunningJob(static_cast<KIMAP2::Job *>(job));
+    if (job == autoIdleJob) {
+        autoIdleJob = Q_NULLPTR;
     }
 }
 
-void SessionPrivate::responseReceived(const Message &response)
+void SessionPrivate::setAutoIdleEnabled(bool enabled)
+{
+    autoIdleEnabled = enabled;
+    if (enabled) {
+        scheduleAutoIdle();
+    } else {
+        stopAutoIdle();
+    }
+}
+
+// IDLE only tells about the selected mailbox, and it has to end for anything else to go out.
+void SessionPrivate::scheduleAutoIdle()
+{
+    if (!autoIdleEnabled || !autoIdleSupported || autoIdleJob ||
+            state != Session::Selected || currentJob || !queue.isEmpty()) {
+        autoIdleTimer.stop();
+        return;
+    }
+    if (snapshot.authenticatedCapabilities.isEmpty() ||
+            snapshot.authenticatedCapabilities.contains(QStringLiteral("IDLE"))) {
+        autoIdleTimer.start();
+    }
+}
+
+void SessionPrivate::startAutoIdle()
+{
+    //Something may have come up in the meantime
+    if (!autoIdleEnabled || !autoIdleSupported || autoIdleJob ||
+            state != Session::Selected || currentJob || !queue.isEmpty()) {
+        return;
+    }
+    qCDebug(KIMAP2_LOG) << "Entering IDLE";
+    autoIdleExitTime.invalidate();
+    autoIdleJob = new IdleJob(q);
+    autoIdleJob->setPriority(Job::Background);
+    autoIdleJob->start();
+}
+
+void SessionPrivate::stopAutoIdle()
+{
+    autoIdleTimer.stop();
+    if (!autoIdleJob) {
+        return;
+    }
+    if (queue.contains(autoIdleJob)) {
+        //Never sent, so there is nothing to end
+        IdleJob *job = autoIdleJob;
+        autoIdleJob = Q_NULLPTR;
+        queue.removeAll(job);
+        job->disconnect(this);
+        job->deleteLater();
+    } else if (!autoIdleExitTime.isValid()) {
+        autoIdleExitTime.start();
+        autoIdleJob->stop();
+    }
+}
+
+void SessionPrivate::logResponse(const Message &response)
 {
     if (dumpTraffic) {
         qCInfo(KIMAP2_LOG) << "S: " << QString::fromLatin1(response.toString());
@@ -275,6 +728,204 @@ void SessionPrivate::responseReceived(const Message &response)
     if (logger && q->isConnected()) {
         logger->dataReceived(response.toString());
     }
+}
+
+// Untagged data for a running job doesn't affect the session state, so it can be handed over in one go.
+// Returns the job the response belongs to, or null if the response needs to go through responseReceived().
+Job *SessionPrivate::untaggedResponseOwner(const Message &response) const
+{
+    if (!currentJob ||
+            state == Session::Disconnected ||
+            response.content.size() < 2 ||
+            response.content[0].stringSlice() != "*" ||
+            response.content[1].stringSlice() == "BYE") {
+        return Q_NULLPTR;
+    }
+    if (pipeline.isEmpty()) {
+        return currentJob;
+    }
+
+    // With several jobs running we go by the kind of response, e.g. "* STATUS ..." or "* 12 FETCH ..."
+    const Message::Slice &first = response.content[1].stringSlice();
+    const bool numbered = !first.isEmpty() && first.constData()[0] >= '0' && first.constData()[0] <= '9';
+    const Message::Slice &kind = (numbered && response.content.size() >= 3) ? response.content[2].stringSlice() : first;
+    const QList<Job *> running = QList<Job *>() << currentJob << pipeline;
+    foreach (Job *job, running) {
+        foreach (const QByteArray &consumed, job->d_ptr->pipelineResponses) {
+            if (kind == consumed) {
+                return job;
+            }
+        }
+    }
+    // Unsolicited responses go to the oldest job, like without pipelining
+    return currentJob;
+}
+
+void SessionPrivate::forwardResponses(Job *job, const MessageRange &responses)
+{
+    for (const Message &response : responses) {
+        logResponse(response);
+    }
+    restartSocketTimer();
+    job->d_ptr->handleResponses(responses);
+}
+
+void SessionPrivate::responsesReceived(const MessageRange &responses, qint64 parseTime)
+{
+    //Account the responses before they change which job they belong to
+    QVector<CommandMetrics> completed;
+    if (tracker) {
+        completed = tracker->responsesReceived(responses, parseTime, [this](const Message &response) {
+            return untaggedResponseOwner(response);
+        });
+    }
+
+    int runStart = 0;
+    Job *runOwner = Q_NULLPTR;
+    for (int i = 0; i < responses.size(); i++) {
+        Job *owner = untaggedResponseOwner(responses[i]);
+        const bool isEvent = subscribedTypes && collectMailBoxEvent(responses[i], owner);
+        if (owner != runOwner) {
+            if (runOwner) {
+                forwardResponses(runOwner, responses.mid(runStart, i - runStart));
+            }
+            runOwner = owner;
+            runStart = i;
+        }
+        if (!owner) {
+            if (isEvent && !currentJob) {
+                //Nobody else is interested, but it's no longer lost either
+                logResponse(responses[i]);
+            } else {
+                responseReceived(responses[i]);
+            }
+        }
+    }
+    if (runOwner) {
+        forwardResponses(runOwner, responses.mid(runStart, responses.size() - runStart));
+    }
+    deliverMailBoxEvents();
+    reportMetrics(completed);
+}
+
+// Records the response as a MailBoxEvent if it is one somebody subscribed to.
+// The owner is the job the response is forwarded to, if any.
+bool SessionPrivate::collectMailBoxEvent(const Message &response, Job *owner)
+{
+    // The responses to SELECT describe the mailbox that is being opened, that's for the SelectJob to report
+    if (state != Session::Selected ||
+            !selectTag.isEmpty() ||
+            response.content.size() < 3 ||
+            response.content[0].stringSlice() != "*") {
+        return false;
+    }
+
+    MailBoxEvent event;
+    event.mailBox = QString::fromUtf8(currentMailBox);
+    const Message::Slice &kind = response.content[2].stringSlice();
+    if (response.content[1].stringSlice() == "VANISHED") {
+        // * VANISHED (EARLIER) 41,43:116
+        event.type = MailBoxEvent::Vanished;
+        int index = 2;
+        if (response.content[index].type() == Message::Part::List) {
+            event.earlier = response.content[index].toList().contains("EARLIER");
+            index++;
+        }
+        if (index >= response.content.size()) {
+            return false;
+        }
+        event.uids = ImapSet::fromImapSequenceSet(response.content[index].toString());
+    } else if (kind == "EXISTS") {
+        event.type = MailBoxEvent::Exists;
+    } else if (kind == "RECENT") {
+        event.type = MailBoxEvent::Recent;
+    } else if (kind == "EXPUNGE") {
+        event.type = MailBoxEvent::Expunge;
+    } else if (kind == "FETCH") {
+        event.type = MailBoxEvent::Flags;
+        // A FetchJob or StoreJob may have asked for it, then it's theirs
+        if (owner && owner->d_ptr->pipelineResponses.contains("FETCH")) {
+            return false;
+        }
+    } else {
+        return false;
+    }
+    if (!(subscribedTypes & event.type)) {
+        return false;
+    }
+    if (event.type != MailBoxEvent::Vanished) {
+        event.number = response.content[1].toString().toLongLong();
+    }
+
+    if (event.type == MailBoxEvent::Flags) {
+        // * 7 FETCH (FLAGS (\Seen \Answered) UID 42 MODSEQ (12121))
+        if (response.content.size() != 4 || response.content[3].type() != Message::Part::List) {
+            return false;
+        }
+        const Message::PartRange content = response.content[3].children();
+        bool hasFlags = false;
+        for (int i = 0; i + 1 < content.size(); i += 2) {
+            const Message::Slice &name = content[i].stringSlice();
+            const Message::Part &value = content[i + 1];
+            if (name == "FLAGS") {
+                hasFlags = true;
+                if (value.type() == Message::Part::List) {
+                    event.flags = value.toList();
+                } else {
+                    event.flags << value.toString();
+                }
+            } else if (name == "UID") {
+                event.uid = value.toString().toLongLong();
+            } else if (name == "MODSEQ") {
+                event.modSequence = value.type() == Message::Part::List ? value.toList().value(0).toULongLong()
+                                                                        : value.toString().toULongLong();
+            }
+        }
+        if (!hasFlags) {
+            return false;
+        }
+    }
+
+    pendingEvents << event;
+    return true;
+}
+
+void SessionPrivate::deliverMailBoxEvents()
+{
+    if (pendingEvents.isEmpty()) {
+        return;
+    }
+    const QVector<MailBoxEvent> events = pendingEvents;
+    pendingEvents.clear();
+
+    //A callback may subscribe or unsubscribe
+    const QList<Subscription> current = subscriptions;
+    for (const Subscription &subscription : current) {
+        QVector<MailBoxEvent> matching;
+        for (const MailBoxEvent &event : events) {
+            if (subscription.types & event.type) {
+                matching << event;
+            }
+        }
+        if (!matching.isEmpty()) {
+            subscription.callback(matching);
+        }
+    }
+}
+
+void SessionPrivate::reportMetrics(const QVector<CommandMetrics> &metrics)
+{
+    for (const CommandMetrics &command : metrics) {
+        commandStatistics[command.command].add(command);
+        if (commandCompleted) {
+            commandCompleted(command);
+        }
+    }
+}
+
+void SessionPrivate::responseReceived(const Message &response)
+{
+    logResponse(response);
 
     QByteArray tag;
     QByteArray code;
@@ -303,16 +954,10 @@ void SessionPrivate::responseReceived(const Message &response)
     case Session::Disconnected:
         stopSocketTimer();
         if (code == "OK") {
-            Message simplified = response;
-            simplified.content.removeFirst(); // Strip the tag
-            simplified.content.removeFirst(); // Strip the code
-            greeting = simplified.toString().trimmed(); // Save the server greeting
+            greetingReceived(response);
             setState(Session::NotAuthenticated);
         } else if (code == "PREAUTH") {
-            Message simplified = response;
-            simplified.content.removeFirst(); // Strip the tag
-            simplified.content.removeFirst(); // Strip the code
-            greeting = simplified.toString().trimmed(); // Save the server greeting
+            greetingReceived(response);
             setState(Session::Authenticated);
         } else {
             //We have been rejected
@@ -350,11 +995,25 @@ void SessionPrivate::responseReceived(const Message &response)
     if (tag == closeTag) {
         closeTag.clear();
     }
+    if (tag == compressTag) {
+        if (code == "OK") {
+            deflater.reset(new DeflateStream(DeflateStream::Compress));
+        }
+        compressTag.clear();
+    }
 
-    // If a job is running forward it the response
-    if (currentJob) {
+    // If a job is running forward it the response, completions go to the job that sent the command
+    Job *job = currentJob;
+    if (tag == "*") {
+        if (Job *owner = untaggedResponseOwner(response)) {
+            job = owner;
+        }
+    } else if (tagOwners.contains(tag)) {
+        job = tagOwners.take(tag);
+    }
+    if (job) {
         restartSocketTimer();
-        currentJob->handleResponse(response);
+        job->handleResponse(response);
     } else {
         qCWarning(KIMAP2_LOG) << "A message was received from the server with no job to handle it:"
                              << response.toString()
@@ -362,6 +1021,104 @@ void SessionPrivate::responseReceived(const Message &response)
     }
 }
 
+void SessionPrivate::greetingReceived(const Message &response)
+{
+    Message simplified = response;
+    simplified.content.removeFirst(); // Strip the tag
+    simplified.content.removeFirst(); // Strip the code
+    greeting = simplified.toString().trimmed(); // Save the server greeting
+
+    snapshot.hostName = hostName;
+    snapshot.port = port;
+    snapshot.greeting = greeting;
+    if (!response.responseCode.isEmpty() && response.responseCode[0].toString() == "CAPABILITY") {
+        for (int i = 1; i < response.responseCode.size(); ++i) {
+            snapshot.greetingCapabilities << QLatin1String(response.responseCode[i].toString());
+        }
+    }
+
+    // The greeting usually changes with the server software or its configuration, and so do the capabilities
+    snapshotValid = !restored.isNull()
+                    && restored.hostName == hostName
+                    && restored.port == port
+                    && (restored.greeting == greeting
+                        || (!snapshot.greetingCapabilities.isEmpty() && restored.greetingCapabilities == snapshot.greetingCapabilities));
+    if (!restored.isNull() && !snapshotValid) {
+        qCInfo(KIMAP2_LOG) << "The server greeting changed, not using the restored snapshot";
+    }
+}
+
+const SessionSnapshot *SessionPrivate::restoredSnapshot() const
+{
+    return snapshotValid ? &restored : Q_NULLPTR;
+}
+
+const SessionSnapshot *SessionPrivate::restoredSnapshotForUser() const
+{
+    if (!snapshotValid || !q->isConnected() || restored.userName != userName) {
+        return Q_NULLPTR;
+    }
+    return &restored;
+}
+
+QStringList SessionPrivate::greetingCapabilities() const
+{
+    return snapshot.greetingCapabilities;
+}
+
+QStringList SessionPrivate::knownCapabilities() const
+{
+    if (!snapshot.authenticatedCapabilities.isEmpty()) {
+        return snapshot.authenticatedCapabilities;
+    }
+    if (!snapshot.capabilities.isEmpty()) {
+        return snapshot.capabilities;
+    }
+    return snapshot.greetingCapabilities;
+}
+
+bool SessionPrivate::canSendNonSynchronizingLiteral(qint64 size) const
+{
+    const QStringList capabilities = knownCapabilities();
+    //LITERAL- is limited to 4096 bytes
+    return capabilities.contains(QStringLiteral("LITERAL+"), Qt::CaseInsensitive) ||
+           (size <= 4096 && capabilities.contains(QStringLiteral("LITERAL-"), Qt::CaseInsensitive));
+}
+
+void SessionPrivate::loggedIn(const QString &name, const QString &authenticationMode, const QStringList &capabilities)
+{
+    userName = name;
+    snapshot.userName = name;
+    snapshot.authenticationMode = authenticationMode;
+    snapshot.capabilities = capabilities;
+}
+
+void SessionPrivate::capabilitiesReceived(const QStringList &capabilities)
+{
+    if (q->isConnected()) {
+        snapshot.authenticatedCapabilities = capabilities;
+    } else {
+        snapshot.capabilities = capabilities;
+    }
+}
+
+void SessionPrivate::namespacesReceived(const QList<MailBoxDescriptor> &personalNamespaces,
+                                        const QList<MailBoxDescriptor> &userNamespaces,
+                                        const QList<MailBoxDescriptor> &sharedNamespaces)
+{
+    snapshot.personalNamespaces = personalNamespaces;
+    snapshot.userNamespaces = userNamespaces;
+    snapshot.sharedNamespaces = sharedNamespaces;
+    snapshot.namespacesKnown = true;
+}
+
+void SessionPrivate::mailBoxSelected(const QString &mailBox, qint64 uidValidity, quint64 highestModSequence)
+{
+    snapshot.selectedMailBox = mailBox;
+    snapshot.uidValidity = uidValidity;
+    snapshot.highestModSequence = highestModSequence;
+}
+
 void SessionPrivate::setState(Session::State s)
 {
     if (s != state) {
@@ -371,16 +1128,21 @@ void SessionPrivate::setState(Session::State s)
     }
 }
 
-QByteArray SessionPrivate::sendCommand(const QByteArray &command, const QByteArray &args)
+QByteArray SessionPrivate::sendCommand(Job *job, const QByteArray &command, const QByteArray &args)
 {
     QByteArray tag = 'A' + QByteArray::number(++tagCount).rightJustified(6, '0');
+    tagOwners.insert(tag, job);
 
     QByteArray payload = tag + ' ' + command;
     if (!args.isEmpty()) {
         payload += ' ' + args;
     }
 
-    sendData(payload);
+    if (tracker) {
+        tracker->commandSent(job, tag, command);
+    }
+
+    sendData(job, payload);
 
     if (command == "LOGIN" || command == "AUTHENTICATE") {
         authTag = tag;
@@ -392,11 +1154,19 @@ QByteArray SessionPrivate::sendCommand(const QByteArray &command, const QByteArr
         upcomingMailBox = KIMAP2::decodeImapFolderName(upcomingMailBox);
     } else if (command == "CLOSE") {
         closeTag = tag;
+    } else if (command == "COMPRESS") {
+        compressTag = tag;
+        //The responses following the completion are compressed, possibly within the same read
+        if (ioThread) {
+            QMetaObject::invokeMethod(ioThread.data(), "startCompressionAfter", Qt::QueuedConnection, Q_ARG(QByteArray, tag));
+        } else {
+            stream->startCompressionAfter(tag);
+        }
     }
     return tag;
 }
 
-void SessionPrivate::sendData(const QByteArray &data)
+void SessionPrivate::sendData(Job *job, const QByteArray &data)
 {
     restartSocketTimer();
 
@@ -406,16 +1176,58 @@ void SessionPrivate::sendData(const QByteArray &data)
     if (logger && q->isConnected()) {
         logger->dataSent(data);
     }
+    if (tracker) {
+        tracker->dataSent(job, data.size() + 2);
+    }
 
-    dataQueue.enqueue(data + "\r\n");
-    QMetaObject::invokeMethod(this, "writeDataQueue");
+    if (streamOwner) {
+        //Held back until the streamed data is complete
+        writeBuffer.append(data);
+        writeBuffer.append("\r\n", 2);
+    } else if (!writeFlushThreshold) {
+        //Without coalescing the data goes out right away, in a single write
+        writeDataQueue();
+        writeToSocket(data + "\r\n");
+    } else if (data.size() >= writeFlushThreshold) {
+        //Large payloads like literals are not worth copying into the buffer,
+        //but the CRLF that completes them must not wait for the next flush either
+        writeDataQueue();
+        writeToSocket(data);
+        writeToSocket(QByteArray("\r\n", 2));
+    } else {
+        writeBuffer.append(data);
+        writeBuffer.append("\r\n", 2);
+        if (writeBuffer.size() >= writeFlushThreshold) {
+            writeDataQueue();
+        } else if (!writeTimer.isActive()) {
+            writeTimer.start(writeFlushLatency);
+        }
+    }
+}
+
+bool SessionPrivate::setLiteralSink(Job *job, qint64 threshold, std::function<std::function<void(const char *, int)>(const Message &, const QByteArray &, qint64)> createSink)
+{
+    //The sink would be called on the I/O thread
+    if (ioThread) {
+        qCWarning(KIMAP2_LOG) << "Literals can't be streamed with Session::WorkerThreadIo";
+        return false;
+    }
+    literalSinkOwner = job;
+    stream->setLiteralSink(threshold, createSink);
+    return true;
 }
 
 void SessionPrivate::socketConnected()
 {
     qCInfo(KIMAP2_LOG) << "Socket connected.";
     //Detect if the connection is no longer available
-    socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    if (ioThread) {
+        QMetaObject::invokeMethod(ioThread.data(), "enableKeepAlive", Qt::QueuedConnection);
+    } else {
+        socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+    }
+    //Reserving keeps the capacity of the buffer when it is emptied after a write
+    writeBuffer.reserve(writeFlushThreshold);
     startNext();
 }
 
@@ -423,10 +1235,17 @@ void SessionPrivate::socketDisconnected()
 {
     qCInfo(KIMAP2_LOG) << "Socket disconnected.";
     stopSocketTimer();
+    writeTimer.stop();
+    writeBuffer.resize(0);
+    stopStream();
+    pendingSocketBytes = 0;
 
     if (logger && q->isConnected()) {
         logger->disconnectionOccured();
     }
+    if (capture) {
+        capture->flush();
+    }
 
     if (state != Session::Disconnected) {
         setState(Session::Disconnected);
@@ -439,6 +1258,9 @@ void SessionPrivate::socketDisconnected()
         emit q->connectionFailed();
     }
 
+    if (tracker) {
+        reportMetrics(tracker->connectionLost());
+    }
     clearJobQueue();
 }
 
@@ -455,9 +1277,17 @@ void SessionPrivate::socketError(QAbstractSocket::SocketError error)
     qCDebug(KIMAP2_LOG) << "Socket error: " << error;
     stopSocketTimer();
 
+    //Don't offer the session again if it may have been the problem
+    if (error == QAbstractSocket::SslHandshakeFailedError && tlsSessionCache) {
+        tlsSessionCache->remove(hostName, port);
+    }
+
     if (currentJob) {
         qCWarning(KIMAP2_LOG) << "Socket error:" << error;
         currentJob->setSocketError(error);
+        foreach (Job *job, pipeline) {
+            job->setSocketError(error);
+        }
     } else if (!queue.isEmpty()) {
         qCWarning(KIMAP2_LOG) << "Socket error:" << error;
         currentJob = queue.takeFirst();
@@ -472,9 +1302,14 @@ void SessionPrivate::clearJobQueue()
     if (!currentJob && !queue.isEmpty()) {
         currentJob = queue.takeFirst();
     }
+    //Every job that is lost removes itself from the running jobs
+    const QList<Job *> pipelineCopy = pipeline;
     if (currentJob) {
         currentJob->connectionLost();
     }
+    foreach (Job *job, pipelineCopy) {
+        job->connectionLost();
+    }
 
     QQueue<Job *> queueCopy = queue; // copy because jobDestroyed calls removeAll
     qDeleteAll(queueCopy);
@@ -484,8 +1319,22 @@ void SessionPrivate::clearJobQueue()
 
 void SessionPrivate::startSsl(QSsl::SslProtocol protocol)
 {
-    socket->setProtocol(protocol);
     connect(socket.data(), &QSslSocket::encrypted, this, &SessionPrivate::sslConnected);
+    //Offer the session of the last connection, the server falls back to a full handshake if it can't resume it
+    QByteArray sessionTicket;
+    if (tlsSessionCache) {
+        sessionTicket = tlsSessionCache->handshakeStarted(hostName, port);
+        qCDebug(KIMAP2_LOG) << "Resuming a TLS session: " << !sessionTicket.isEmpty();
+    }
+    if (ioThread) {
+        QMetaObject::invokeMethod(ioThread.data(), "startSsl", Qt::QueuedConnection, Q_ARG(QSsl::SslProtocol, protocol),
+                                  Q_ARG(bool, !tlsSessionCache.isNull()), Q_ARG(QByteArray, sessionTicket));
+        return;
+    }
+    socket->setProtocol(protocol);
+    if (tlsSessionCache) {
+        TlsSessionCache::prepareResumption(socket.data(), sessionTicket);
+    }
     if (socket->state() == QAbstractSocket::ConnectedState) {
         qCDebug(KIMAP2_LOG) << "Starting client encryption";
         Q_ASSERT(socket->mode() == QSslSocket::UnencryptedMode);
@@ -501,6 +1350,21 @@ void SessionPrivate::sslConnected()
     emit encryptionNegotiationResult(true);
 }
 
+void SessionPrivate::exportTlsSession()
+{
+    const QSslConfiguration configuration = socket->sslConfiguration();
+    if (!configuration.testSslOption(QSsl::SslOptionDisableSessionPersistence)) {
+        sessionTicketReceived(configuration.sessionTicket());
+    }
+}
+
+void SessionPrivate::sessionTicketReceived(const QByteArray &sessionTicket)
+{
+    if (tlsSessionCache) {
+        tlsSessionCache->insert(hostName, port, sessionTicket);
+    }
+}
+
 void SessionPrivate::setSocketTimeout(int ms)
 {
     bool timerActive = socketTimer.isActive();
@@ -521,6 +1385,16 @@ int SessionPrivate::socketTimeout() const
     return socketTimerInterval;
 }
 
+void SessionPrivate::setWriteCoalescing(int threshold, int latency)
+{
+    writeFlushThreshold = qMax(threshold, 0);
+    writeFlushLatency = qMax(latency, 0);
+    writeBuffer.reserve(writeFlushThreshold);
+    if (writeBuffer.size() >= writeFlushThreshold) {
+        writeDataQueue();
+    }
+}
+
 void SessionPrivate::startSocketTimer()
 {
     if (socketTimerInterval < 0) {
@@ -553,8 +1427,15 @@ void SessionPrivate::onSocketTimeout()
     if (currentJob) {
         qCWarning(KIMAP2_LOG) << "Current job: " << currentJob->metaObject()->className();
         currentJob->setErrorMessage("Aborting on socket timeout. Interval " + QString::number(socketTimerInterval) + " ms");
+        foreach (Job *job, pipeline) {
+            job->setErrorMessage("Aborting on socket timeout. Interval " + QString::number(socketTimerInterval) + " ms");
+        }
+    }
+    if (ioThread) {
+        QMetaObject::invokeMethod(ioThread.data(), "abort", Qt::QueuedConnection);
+    } else {
+        socket->abort();
     }
-    socket->abort();
     socketProgressTimer.stop();
 }
 
@@ -580,19 +1461,121 @@ QString SessionPrivate::getStateName() const
 void SessionPrivate::onSocketProgressTimeout()
 {
     if (currentJob) {
-        qCDebug(KIMAP2_LOG) << "Processing job: " << currentJob->metaObject()->className() << "Current state: " << getStateName() << (socket ? socket->state() : QAbstractSocket::UnconnectedState);
+        qCDebug(KIMAP2_LOG) << "Processing job: " << currentJob->metaObject()->className() << "Current state: " << getStateName() << socketState();
     } else {
-        qCDebug(KIMAP2_LOG) << "Next job: " << (queue.isEmpty() ? "No job" : queue.head()->metaObject()->className()) << "Current state: " << getStateName() << (socket ? socket->state() : QAbstractSocket::UnconnectedState);
+        qCDebug(KIMAP2_LOG) << "Next job: " << (queue.isEmpty() ? "No job" : queue.head()->metaObject()->className()) << "Current state: " << getStateName() << socketState();
     }
 }
 
 void SessionPrivate::writeDataQueue()
 {
-    while (!dataQueue.isEmpty()) {
-        socket->write(dataQueue.dequeue());
+    writeTimer.stop();
+    //Held back until the streamed data is complete
+    if (writeBuffer.isEmpty() || streamOwner) {
+        return;
+    }
+    writeToSocket(writeBuffer);
+    writeBuffer.resize(0);
+}
+
+void SessionPrivate::writeToSocket(const QByteArray &data)
+{
+    const QByteArray payload = deflater ? deflater->process(data) : data;
+    if (capture) {
+        capture->record(TrafficCapture::Sent, payload.constData(), payload.size());
+    }
+    if (ioThread) {
+        QMetaObject::invokeMethod(ioThread.data(), "write", Qt::QueuedConnection, Q_ARG(QByteArray, payload));
+    } else {
+        socket->write(payload);
+    }
+    bytesWritten += payload.size();
+    writeCount++;
+    pendingSocketBytes += payload.size();
+}
+
+void SessionPrivate::socketBytesWritten(qint64 bytes)
+{
+    pendingSocketBytes = qMax(Q_INT64_C(0), pendingSocketBytes - bytes);
+    if (streamOwner) {
+        pumpStream();
+    }
+}
+
+void SessionPrivate::streamData(Job *job, qint64 size, std::function<QByteArray(qint64 maxSize)> produce)
+{
+    Q_ASSERT(!streamOwner);
+    //What was sent before goes first
+    writeDataQueue();
+    streamOwner = job;
+    streamRemaining = size;
+    streamProducer = produce;
+    pumpStream();
+}
+
+// Writes chunks of the streamed data until enough of it waits to be sent by the socket.
+void SessionPrivate::pumpStream()
+{
+    static const qint64 chunkSize = 64 * 1024;
+    static const qint64 highWatermark = 4 * chunkSize;
+
+    while (streamOwner && pendingSocketBytes < highWatermark) {
+        if (streamRemaining > 0) {
+            QByteArray chunk = streamProducer(qMin(streamRemaining, chunkSize));
+            if (chunk.isEmpty()) {
+                qCWarning(KIMAP2_LOG) << "The data to stream ended" << streamRemaining << "bytes early, closing the connection.";
+                abortStream();
+                return;
+            }
+            if (chunk.size() > streamRemaining) {
+                chunk.truncate(streamRemaining);
+            }
+            streamRemaining -= chunk.size();
+
+            restartSocketTimer();
+            if (dumpTraffic) {
+                qCInfo(KIMAP2_LOG) << "C: " << chunk.size() << "bytes of streamed data";
+            }
+            if (logger && q->isConnected()) {
+                logger->dataSent(chunk);
+            }
+            if (tracker) {
+                tracker->dataSent(streamOwner, chunk.size());
+            }
+            writeToSocket(chunk);
+        }
+        if (streamRemaining == 0) {
+            //Like sendData() the data ends with CRLF, followed by what was held back
+            if (tracker) {
+                tracker->dataSent(streamOwner, 2);
+            }
+            stopStream();
+            writeBuffer.prepend("\r\n", 2);
+            writeDataQueue();
+        }
     }
 }
 
+void SessionPrivate::stopStream()
+{
+    streamOwner = Q_NULLPTR;
+    streamRemaining = 0;
+    streamProducer = nullptr;
+}
+
+// The rest of the data would have been part of a command, so the connection can't be used anymore.
+void SessionPrivate::abortStream()
+{
+    stopStream();
+    writeBuffer.resize(0);
+    QMetaObject::invokeMethod(this, "closeSocket", Qt::QueuedConnection);
+}
+
+QAbstractSocket::SocketState SessionPrivate::socketState() const
+{
+    return ioThread ? lastSocketState : socket->state();
+}
+
 void SessionPrivate::readMessage()
 {
     if (trackTime) {
@@ -615,7 +1598,25 @@ void SessionPrivate::readMessage()
 void SessionPrivate::closeSocket()
 {
     qCDebug(KIMAP2_LOG) << "Closing socket.";
-    socket->close();
+    //Don't lose commands that are still waiting to be written
+    writeDataQueue();
+    if (ioThread) {
+        QMetaObject::invokeMethod(ioThread.data(), "close", Qt::QueuedConnection);
+    } else {
+        socket->close();
+    }
+}
+
+void SessionPrivate::responsesParsed(const QVector<Message> &responses, qint64 parseTime)
+{
+    if (trackTime) {
+        time.start();
+    }
+    responsesReceived(MessageRange(responses.constData(), responses.size()), parseTime);
+    if (trackTime) {
+        accumulatedProcessingTime += time.elapsed();
+        qCDebug(KIMAP2_LOG) << "Processing time: " << accumulatedProcessingTime;
+    }
 }
 
 #include "moc_session.cpp"
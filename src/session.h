@@ -22,16 +22,26 @@
 #define KIMAP2_SESSION_H
 
 #include "kimap2_export.h"
+#include "commandmetrics.h"
+#include "job.h"
+#include "mailboxevent.h"
+#include "sessionsnapshot.h"
 
+#include <QtCore/QHash>
 #include <QtCore/QObject>
+#include <QtCore/QSharedPointer>
+#include <QtCore/QVector>
 #include <QtNetwork/QSsl>
 #include <QtNetwork/QSslSocket>
 
+#include <functional>
+
 namespace KIMAP2
 {
 
 class SessionPrivate;
 class JobPrivate;
+class TlsSessionCache;
 struct Message;
 
 class KIMAP2_EXPORT Session : public QObject
@@ -44,7 +54,23 @@ class KIMAP2_EXPORT Session : public QObject
 public:
     enum State { Disconnected = 0, NotAuthenticated, Authenticated, Selected };
 
+    /**
+     * Where the socket is read and the responses are parsed.
+     */
+    enum IoMode {
+        SameThreadIo = 0, ///< In the thread the session lives in (the default)
+        WorkerThreadIo    ///< In an internal thread, jobs receive the parsed responses in batches
+    };
+
     Session(const QString &hostName, quint16 port, QObject *parent = Q_NULLPTR);
+    /**
+     * Creates a session that does its I/O as described by @p ioMode.
+     *
+     * With WorkerThreadIo the jobs still run in the thread of the session, only reading, parsing and
+     * writing moves to the internal thread. Literals can't be streamed to a job then, since the sink
+     * would have to run on the internal thread: a FetchJob with FetchJob::setContentDevice() fails.
+     */
+    Session(const QString &hostName, quint16 port, IoMode ioMode, QObject *parent = Q_NULLPTR);
     ~Session();
 
     QString hostName() const;
@@ -84,6 +110,135 @@ public:
 
     int jobQueueSize() const;
 
+    /**
+     * Send the commands of independent jobs without waiting for the previous ones to complete.
+     *
+     * Only jobs whose responses can be told apart run alongside each other (e.g. a FetchJob and a StatusJob),
+     * every other job waits until the running ones are done and runs on its own. This is a barrier for
+     * state changing commands like SELECT or LOGIN. Disabled by default.
+     */
+    void setPipeliningEnabled(bool enabled);
+    bool isPipeliningEnabled() const;
+
+    /**
+     * A queued job starts next once @p count jobs that were queued after it started first because of their
+     * priority, see Job::setPriority(). The default is 16, a negative value disables the limit.
+     *
+     * A job that was paused between two of its commands for a job of higher priority counts as queued.
+     */
+    void setStarvationLimit(int count);
+    int starvationLimit() const;
+
+    /**
+     * Enter IDLE once no job was queued for @p delay milliseconds while a mailbox is selected, so the server
+     * pushes changes instead of being polled. Use subscribe() to receive them. Disabled by default.
+     *
+     * Adding a job ends IDLE right away, and IDLE is entered again once the jobs are done. The IDLE itself
+     * doesn't count for jobQueueSize(). It is given up for the session if the server rejects the command.
+     */
+    void setAutoIdleEnabled(bool enabled);
+    bool isAutoIdleEnabled() const;
+    void setAutoIdleDelay(int delay);
+    int autoIdleDelay() const;
+
+    /**
+     * Configure how outgoing commands are collected before they are written to the socket.
+     *
+     * Commands are written in one go once @p threshold bytes are pending, or @p latency milliseconds
+     * after the first pending command. The defaults are 16384 bytes (one TLS record) and 0 ms, which
+     * writes everything sent within one event loop iteration at once. A threshold of 0 writes every
+     * command immediately.
+     */
+    void setWriteCoalescing(int threshold, int latency);
+
+    /**
+     * Returns the number of bytes written to the socket so far.
+     */
+    qint64 bytesWritten() const;
+
+    /**
+     * Returns the number of writes issued to the socket so far.
+     */
+    qint64 writeCount() const;
+
+    /**
+     * Record the CommandMetrics of every command that is sent. Disabled by default.
+     */
+    void setMetricsEnabled(bool enabled);
+    bool isMetricsEnabled() const;
+
+    /**
+     * Call @p callback with the metrics of every command once it completed, or the connection was lost.
+     */
+    void onCommandCompleted(std::function<void(const CommandMetrics &)> callback);
+
+    /**
+     * Returns the metrics of the completed commands by command name (e.g. "UID FETCH"),
+     * since metrics were enabled or resetCommandStatistics() was called.
+     */
+    QHash<QByteArray, CommandStatistics> commandStatistics() const;
+    void resetCommandStatistics();
+
+    /**
+     * Returns how long the jobs of @p priority waited in the queue until they started, in microseconds.
+     *
+     * A paused job waits again until it continues. Recorded while metrics are enabled,
+     * and reset by resetCommandStatistics().
+     */
+    Histogram queueWaitTime(Job::Priority priority) const;
+
+    /**
+     * Returns how long jobs waited for the server to end an automatic IDLE, in microseconds.
+     *
+     * The IDLE commands themselves are part of commandStatistics(). Recorded while metrics are enabled,
+     * and reset by resetCommandStatistics().
+     */
+    Histogram idleExitTime() const;
+
+    /**
+     * Returns what the session learned about the server so far, to start the next session from.
+     */
+    SessionSnapshot snapshot() const;
+
+    /**
+     * Start from a snapshot of an earlier session to the same server.
+     *
+     * Must be called before the server greeting arrives, i.e. right after creating the session. The snapshot
+     * is only used if the greeting proves it is still valid, see isSnapshotValid(). Jobs then skip the commands
+     * whose answer is already known: the LoginJob doesn't ask for the capabilities, and the NamespaceJob and
+     * CapabilitiesJob complete without a round trip once logged in as the same user.
+     */
+    void restoreSnapshot(const SessionSnapshot &snapshot);
+
+    /**
+     * Returns true if a snapshot was restored and the server greeting matched it.
+     */
+    bool isSnapshotValid() const;
+
+    /**
+     * Resume the TLS sessions stored in @p cache, and store the session of this connection in it.
+     *
+     * Must be set before the LoginJob starts encryption. Share the cache between all sessions, so a
+     * reconnect can do an abbreviated handshake.
+     */
+    void setTlsSessionCache(const QSharedPointer<TlsSessionCache> &cache);
+    QSharedPointer<TlsSessionCache> tlsSessionCache() const;
+
+    /**
+     * Call @p callback with the changes of the selected mailbox the server reports on its own, e.g. a new
+     * message with "* 24 EXISTS" or flags another client changed with "* 7 FETCH (FLAGS (\\Seen))".
+     *
+     * Without a subscription these responses are dropped if no job is running, or handed to whatever job
+     * runs at the time, which ignores them. Events are delivered in batches, one call for all events of
+     * @p types that were read from the socket in one go, between jobs as well as while unrelated jobs run.
+     * The responses to a SELECT or EXAMINE are reported by the SelectJob instead, and flags are only
+     * reported if no FetchJob or StoreJob runs that could have asked for them.
+     *
+     * Returns an id for unsubscribe().
+     */
+    int subscribe(MailBoxEvent::Types types, std::function<void(const QVector<MailBoxEvent> &)> callback);
+    void unsubscribe(int id);
+
     void close();
 
     /**
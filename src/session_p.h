@@ -22,14 +22,20 @@
 #define KIMAP2_SESSION_P_H
 
 #include "session.h"
+#include "commandtracker_p.h"
 
 #include <QtNetwork/QSslSocket>
 
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QHash>
 #include <QtCore/QObject>
 #include <QtCore/QQueue>
 #include <QtCore/QString>
 #include <QtCore/QTimer>
 #include <QtCore/QTime>
+#include <QtCore/QVector>
+
+#include <functional>
 
 class KJob;
 
@@ -37,9 +43,15 @@ namespace KIMAP2
 {
 
 class Job;
+class IdleJob;
 struct Message;
+class MessageRange;
 class SessionLogger;
 class ImapStreamParser;
+class DeflateStream;
+class SessionThread;
+class TrafficCapture;
+class TlsSessionCache;
 
 class KIMAP2_EXPORT SessionPrivate : public QObject
 {
@@ -52,13 +64,68 @@ public:
     virtual ~SessionPrivate();
 
     void addJob(Job *job);
-    QByteArray sendCommand(const QByteArray &command, const QByteArray &args = QByteArray());
+    QByteArray sendCommand(Job *job, const QByteArray &command, const QByteArray &args = QByteArray());
     void startSsl(QSsl::SslProtocol version);
-    void sendData(const QByteArray &data);
+    /**
+     * Send @p data followed by CRLF on behalf of @p job, e.g. a literal or a continuation.
+     */
+    void sendData(Job *job, const QByteArray &data);
+    /**
+     * Like sendData(), but for @p size bytes that @p produce returns in chunks of at most the requested size.
+     *
+     * The chunks are requested as the socket gets rid of the data, so only a few of them are in memory at
+     * a time. Everything else that is sent in the meantime is held back until the data is complete.
+     */
+    void streamData(Job *job, qint64 size, std::function<QByteArray(qint64 maxSize)> produce);
+    /**
+     * Stream the literals of the responses to @p job, see ImapStreamParser::setLiteralSink().
+     *
+     * Returns false with WorkerThreadIo, where the sink would have to run on the internal thread.
+     */
+    bool setLiteralSink(Job *job, qint64 threshold, std::function<std::function<void(const char *, int)>(const Message &, const QByteArray &, qint64)> createSink);
 
     void setSocketTimeout(int ms);
     int socketTimeout() const;
 
+    void setWriteCoalescing(int threshold, int latency);
+
+    /**
+     * Called by a job between two of its commands, if the rest of them can wait.
+     *
+     * Returns true if the job was put back into the queue for a job of higher priority,
+     * doStart() is then called again once it may continue.
+     */
+    bool pauseForPriorityJob(Job *job);
+
+    void setAutoIdleEnabled(bool enabled);
+
+    /**
+     * Returns the restored snapshot if the server greeting proved it valid, Q_NULLPTR otherwise.
+     */
+    const SessionSnapshot *restoredSnapshot() const;
+    /**
+     * Like restoredSnapshot(), but only once logged in as the user the snapshot was taken for.
+     */
+    const SessionSnapshot *restoredSnapshotForUser() const;
+    QStringList greetingCapabilities() const;
+    /**
+     * Returns the latest capabilities the session learned about, after authentication if known.
+     */
+    QStringList knownCapabilities() const;
+    /**
+     * Returns true if a literal of @p size bytes may be sent as "{size+}" without waiting for the
+     * continuation, as announced with LITERAL+ or LITERAL- (RFC 7888).
+     */
+    bool canSendNonSynchronizingLiteral(qint64 size) const;
+
+    //Jobs report what they learned here, for Session::snapshot()
+    void loggedIn(const QString &userName, const QString &authenticationMode, const QStringList &capabilities);
+    void capabilitiesReceived(const QStringList &capabilities);
+    void namespacesReceived(const QList<MailBoxDescriptor> &personalNamespaces,
+                            const QList<MailBoxDescriptor> &userNamespaces,
+                            const QList<MailBoxDescriptor> &sharedNamespaces);
+    void mailBoxSelected(const QString &mailBox, qint64 uidValidity, quint64 highestModSequence);
+
 Q_SIGNALS:
     void encryptionNegotiationResult(bool);
 
@@ -69,6 +136,7 @@ private Q_SLOTS:
     void doStartNext();
     void jobDone(KJob *);
     void jobDestroyed(QObject *);
+    void startAutoIdle();
 
     void socketConnected();
     void socketDisconnected();
@@ -78,13 +146,35 @@ private Q_SLOTS:
 
     void closeSocket();
     void readMessage();
+    void responsesParsed(const QVector<KIMAP2::Message> &responses, qint64 parseTime);
     void writeDataQueue();
     void sslConnected();
+    void exportTlsSession();
+    void sessionTicketReceived(const QByteArray &sessionTicket);
+    void socketBytesWritten(qint64 bytes);
 
 private:
     void responseReceived(const KIMAP2::Message &);
+    void greetingReceived(const KIMAP2::Message &);
+    void responsesReceived(const KIMAP2::MessageRange &, qint64 parseTime);
+    void reportMetrics(const QVector<CommandMetrics> &metrics);
+    void forwardResponses(Job *job, const KIMAP2::MessageRange &);
+    Job *untaggedResponseOwner(const KIMAP2::Message &) const;
+    bool collectMailBoxEvent(const KIMAP2::Message &, Job *owner);
+    void deliverMailBoxEvents();
+    void logResponse(const KIMAP2::Message &);
+    bool canPipeline(Job *job) const;
+    int nextJobIndex() const;
+    void writeToSocket(const QByteArray &data);
+    void pumpStream();
+    void stopStream();
+    void abortStream();
+    QAbstractSocket::SocketState socketState() const;
+    void removeRunningJob(Job *job);
     void startNext();
     void clearJobQueue();
+    void scheduleAutoIdle();
+    void stopAutoIdle();
     void setState(Session::State state);
 
     void startSocketTimer();
@@ -99,14 +189,34 @@ private:
     bool hostLookupInProgress;
 
     QScopedPointer<SessionLogger> logger;
+    QScopedPointer<TrafficCapture> capture;
 
     bool jobRunning;
+    //The oldest job that is running
     Job *currentJob;
     QQueue<Job *> queue;
 
+    bool pipeliningEnabled;
+    //Jobs that have been started while currentJob was running, oldest first
+    QList<Job *> pipeline;
+    //The job that sent the command with a given tag, until the command completes
+    QHash<QByteArray, Job *> tagOwners;
+    Job *literalSinkOwner;
+    int starvationLimit;
+
+    bool autoIdleEnabled;
+    //Turned off once the server rejected IDLE
+    bool autoIdleSupported;
+    QTimer autoIdleTimer;
+    //The IDLE we entered on our own, until it is done
+    IdleJob *autoIdleJob;
+    //Since DONE was sent
+    QElapsedTimer autoIdleExitTime;
+
     QByteArray authTag;
     QByteArray selectTag;
     QByteArray closeTag;
+    QByteArray compressTag;
 
     QString userName;
     QByteArray greeting;
@@ -124,8 +234,56 @@ private:
 
     QScopedPointer<QSslSocket> socket;
     QScopedPointer<ImapStreamParser> stream;
-
-    QQueue<QByteArray> dataQueue;
+    //Drives the socket and the parser on an I/O thread if enabled, must be destroyed before them
+    QScopedPointer<SessionThread> ioThread;
+    //The socket state as last reported, the socket can't be asked from this thread with an I/O thread
+    QAbstractSocket::SocketState lastSocketState;
+    //Shared with other sessions, the TLS sessions to resume
+    QSharedPointer<TlsSessionCache> tlsSessionCache;
+    //Compresses what we send once COMPRESS completed
+    QScopedPointer<DeflateStream> deflater;
+
+    //Outgoing data is collected here and written to the socket in one go
+    QByteArray writeBuffer;
+    QTimer writeTimer;
+    int writeFlushThreshold;
+    int writeFlushLatency;
+    qint64 bytesWritten;
+    qint64 writeCount;
+    //Written to the socket, but not yet sent by it
+    qint64 pendingSocketBytes;
+
+    //The data that is being streamed, see streamData()
+    Job *streamOwner;
+    qint64 streamRemaining;
+    std::function<QByteArray(qint64)> streamProducer;
+
+    //Only exists while metrics are enabled
+    QScopedPointer<CommandTracker> tracker;
+    std::function<void(const CommandMetrics &)> commandCompleted;
+    QHash<QByteArray, CommandStatistics> commandStatistics;
+    //By Job::Priority
+    QVector<Histogram> queueWaitTimes;
+    Histogram idleExitTimes;
+    qint64 lastParseTime;
+
+    struct Subscription {
+        int id;
+        MailBoxEvent::Types types;
+        std::function<void(const QVector<MailBoxEvent> &)> callback;
+    };
+    QList<Subscription> subscriptions;
+    int nextSubscriptionId;
+    //The types any subscription asked for, nothing is parsed if empty
+    MailBoxEvent::Types subscribedTypes;
+    //Collected while handling the responses of one read
+    QVector<MailBoxEvent> pendingEvents;
+
+    //What we learned about the server in this session
+    SessionSnapshot snapshot;
+    //What an earlier session learned, only used if snapshotValid
+    SessionSnapshot restored;
+    bool snapshotValid;
 
     QTime time;
     qint64 accumulatedWaitTime;
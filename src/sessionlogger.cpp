@@ -57,16 +57,16 @@ SessionLogger::~SessionLogger()
 void SessionLogger::dataSent(const QByteArray &data)
 {
     m_file.write("C: " + data.trimmed() + '\n');
-    m_file.flush();
 }
 
 void SessionLogger::dataReceived(const QByteArray &data)
 {
     m_file.write("S: " + data.trimmed() + '\n');
-    m_file.flush();
 }
 
 void SessionLogger::disconnectionOccured()
 {
     m_file.write("X\n");
+    //The lines are buffered by the file, make sure everything up to here made it to disk
+    m_file.flush();
 }
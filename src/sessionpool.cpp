@@ -0,0 +1,275 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "sessionpool.h"
+
+#include <QtCore/QQueue>
+#include <QtCore/QTimer>
+
+#include "kimap_debug.h"
+
+#include "job.h"
+#include "loginjob.h"
+#include "selectjob.h"
+#include "session.h"
+
+namespace KIMAP2
+{
+class SessionPoolPrivate
+{
+public:
+    enum ConnectionState {
+        Connecting,
+        Idle,
+        Busy
+    };
+
+    struct Connection {
+        Session *session;
+        ConnectionState state;
+    };
+
+    struct Task {
+        QString mailBox;
+        SessionPool::JobFactory createJob;
+    };
+
+    SessionPoolPrivate(SessionPool *pool) : q(pool), port(0), size(0), reconnectInterval(5000) { }
+
+    void addConnection();
+    void removeConnection(Session *session);
+    Connection *connection(Session *session);
+    Connection *idleConnection(const QString &mailBox);
+    void run(Connection *connection, const Task &task);
+    void dispatch();
+    int count(ConnectionState state) const;
+
+    SessionPool *const q;
+    QString hostName;
+    quint16 port;
+    int size;
+    int reconnectInterval;
+    std::function<void(LoginJob *)> configureLogin;
+    QList<Connection> connections;
+    QQueue<Task> queue;
+};
+}
+
+using namespace KIMAP2;
+
+void SessionPoolPrivate::addConnection()
+{
+    Session *session = new Session(hostName, port, q);
+    const Connection newConnection = { session, Connecting };
+    connections << newConnection;
+
+    QObject::connect(session, &Session::sslErrors, q, [this, session](const QList<QSslError> &errors) {
+        emit q->sslErrors(session, errors);
+    });
+    QObject::connect(session, &Session::stateChanged, q, [this, session](Session::State newState, Session::State) {
+        if (newState == Session::Disconnected) {
+            qCInfo(KIMAP2_LOG) << "Lost a session of the pool";
+            removeConnection(session);
+        }
+    });
+
+    LoginJob *login = new LoginJob(session);
+    if (configureLogin) {
+        configureLogin(login);
+    }
+    QObject::connect(login, &KJob::result, q, [this, session](KJob *job) {
+        Connection *c = connection(session);
+        if (!c) {
+            return;
+        }
+        //A preauthenticated session doesn't need the login
+        if (job->error() && session->state() != Session::Authenticated) {
+            qCWarning(KIMAP2_LOG) << "Failed to log in a session of the pool:" << job->errorString();
+            removeConnection(session);
+            return;
+        }
+        c->state = Idle;
+        dispatch();
+    });
+    login->start();
+}
+
+void SessionPoolPrivate::removeConnection(Session *session)
+{
+    for (int i = 0; i < connections.size(); i++) {
+        if (connections[i].session == session) {
+            connections.removeAt(i);
+            QObject::disconnect(session, Q_NULLPTR, q, Q_NULLPTR);
+            session->deleteLater();
+            //The server may just be restarting, so we try again after a while
+            QTimer::singleShot(reconnectInterval, q, [this]() {
+                if (connections.size() < size) {
+                    addConnection();
+                }
+            });
+            return;
+        }
+    }
+}
+
+SessionPoolPrivate::Connection *SessionPoolPrivate::connection(Session *session)
+{
+    for (int i = 0; i < connections.size(); i++) {
+        if (connections[i].session == session) {
+            return &connections[i];
+        }
+    }
+    return Q_NULLPTR;
+}
+
+SessionPoolPrivate::Connection *SessionPoolPrivate::idleConnection(const QString &mailBox)
+{
+    Connection *idle = Q_NULLPTR;
+    for (int i = 0; i < connections.size(); i++) {
+        Connection &c = connections[i];
+        if (c.state != Idle) {
+            continue;
+        }
+        //Avoid selecting the mailbox again if we can
+        if (!mailBox.isEmpty() && c.session->selectedMailBox() == mailBox) {
+            return &c;
+        }
+        if (!idle) {
+            idle = &c;
+        }
+    }
+    return idle;
+}
+
+void SessionPoolPrivate::run(Connection *connection, const Task &task)
+{
+    Session *session = connection->session;
+    //The session runs its jobs in order, so the job is started right away and runs once the SELECT completed
+    if (!task.mailBox.isEmpty() && session->selectedMailBox() != task.mailBox) {
+        SelectJob *select = new SelectJob(session);
+        select->setMailBox(task.mailBox);
+        select->start();
+    }
+    Job *job = task.createJob(session);
+    if (!job) {
+        return;
+    }
+    connection->state = Busy;
+    QObject::connect(job, &KJob::result, q, [this, session](KJob *) {
+        if (Connection *c = SessionPoolPrivate::connection(session)) {
+            c->state = Idle;
+        }
+        dispatch();
+    });
+    job->start();
+}
+
+void SessionPoolPrivate::dispatch()
+{
+    const int queueSize = queue.size();
+    while (!queue.isEmpty()) {
+        Connection *connection = idleConnection(queue.head().mailBox);
+        if (!connection) {
+            break;
+        }
+        run(connection, queue.dequeue());
+    }
+    if (queue.size() != queueSize) {
+        emit q->queueSizeChanged(queue.size());
+    }
+}
+
+int SessionPoolPrivate::count(ConnectionState state) const
+{
+    int result = 0;
+    foreach (const Connection &c, connections) {
+        if (c.state == state) {
+            result++;
+        }
+    }
+    return result;
+}
+
+SessionPool::SessionPool(const QString &hostName, quint16 port, int size,
+                         std::function<void(LoginJob *)> configureLogin, QObject *parent)
+    : QObject(parent), d(new SessionPoolPrivate(this))
+{
+    d->hostName = hostName;
+    d->port = port;
+    d->size = size;
+    d->configureLogin = configureLogin;
+    for (int i = 0; i < size; i++) {
+        d->addConnection();
+    }
+}
+
+SessionPool::~SessionPool()
+{
+    //Deleting the sessions aborts their jobs, which must not find their way back into the pool
+    QList<Session *> sessions;
+    foreach (const SessionPoolPrivate::Connection &c, d->connections) {
+        sessions << c.session;
+    }
+    d->connections.clear();
+    d->queue.clear();
+    qDeleteAll(sessions);
+    delete d;
+}
+
+void SessionPool::enqueue(const QString &mailBox, JobFactory createJob)
+{
+    const SessionPoolPrivate::Task task = { mailBox, createJob };
+    d->queue.enqueue(task);
+    emit queueSizeChanged(d->queue.size());
+    d->dispatch();
+}
+
+void SessionPool::setReconnectInterval(int ms)
+{
+    d->reconnectInterval = ms;
+}
+
+int SessionPool::reconnectInterval() const
+{
+    return d->reconnectInterval;
+}
+
+int SessionPool::queueSize() const
+{
+    return d->queue.size();
+}
+
+int SessionPool::sessionCount() const
+{
+    return d->count(SessionPoolPrivate::Idle) + d->count(SessionPoolPrivate::Busy);
+}
+
+int SessionPool::busySessionCount() const
+{
+    return d->count(SessionPoolPrivate::Busy);
+}
+
+qreal SessionPool::utilization() const
+{
+    const int sessions = sessionCount();
+    if (!sessions) {
+        return 0;
+    }
+    return qreal(busySessionCount()) / sessions;
+}
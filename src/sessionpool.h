@@ -0,0 +1,122 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef KIMAP2_SESSIONPOOL_H
+#define KIMAP2_SESSIONPOOL_H
+
+#include "kimap2_export.h"
+
+#include <QtCore/QObject>
+#include <QtNetwork/QSslError>
+
+#include <functional>
+
+namespace KIMAP2
+{
+
+class Job;
+class LoginJob;
+class Session;
+class SessionPoolPrivate;
+
+/**
+ * A set of sessions to the same server that run jobs in parallel.
+ *
+ * The pool opens the given number of sessions right away and logs every
+ * one of them in with a LoginJob. Jobs are queued with enqueue() and run
+ * on the next idle session, one job per session at a time. If a job works
+ * on a mailbox, a session that has it selected already is preferred,
+ * otherwise the mailbox is selected before the job runs.
+ *
+ * Sessions that lose their connection or fail to log in are replaced
+ * after the reconnect interval.
+ */
+class KIMAP2_EXPORT SessionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    /**
+     * Creates the job to run on @p session, the pool starts it.
+     */
+    typedef std::function<Job *(Session *session)> JobFactory;
+
+    /**
+     * @param size the number of sessions to open
+     * @param configureLogin called for every LoginJob the pool creates, to set the credentials and encryption
+     */
+    SessionPool(const QString &hostName, quint16 port, int size,
+                std::function<void(LoginJob *)> configureLogin, QObject *parent = Q_NULLPTR);
+    ~SessionPool();
+
+    /**
+     * Queue a job.
+     *
+     * @p createJob is called once a session is available. If @p mailBox is not empty it
+     * is selected on that session before the job runs. A failed SELECT leaves the session
+     * without a selected mailbox, so commands that need one fail in that case.
+     *
+     * Jobs that are still queued when the pool is destroyed are never created.
+     */
+    void enqueue(const QString &mailBox, JobFactory createJob);
+
+    /**
+     * Set how long to wait before replacing a session that was lost. The default is 5 seconds.
+     */
+    void setReconnectInterval(int ms);
+    int reconnectInterval() const;
+
+    /**
+     * The number of jobs waiting for a session.
+     */
+    int queueSize() const;
+
+    /**
+     * The number of sessions that are logged in.
+     */
+    int sessionCount() const;
+
+    /**
+     * The number of sessions that are running a job.
+     */
+    int busySessionCount() const;
+
+    /**
+     * The share of the logged in sessions that is running a job, between 0 and 1.
+     */
+    qreal utilization() const;
+
+Q_SIGNALS:
+    void queueSizeChanged(int queueSize);
+
+    /**
+     * Emitted when ssl errors occur on one of the sessions.
+     *
+     * @see Session::sslErrors()
+     */
+    void sslErrors(KIMAP2::Session *session, const QList<QSslError> &errors);
+
+private:
+    friend class SessionPoolPrivate;
+    SessionPoolPrivate *const d;
+};
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "sessionsnapshot.h"
+
+#include <QtCore/QDataStream>
+
+using namespace KIMAP2;
+
+static const quint8 snapshotVersion = 1;
+
+static void writeNamespaces(QDataStream &stream, const QList<MailBoxDescriptor> &namespaces)
+{
+    stream << qint32(namespaces.size());
+    foreach (const MailBoxDescriptor &descriptor, namespaces) {
+        stream << descriptor.name << descriptor.separator;
+    }
+}
+
+static QList<MailBoxDescriptor> readNamespaces(QDataStream &stream)
+{
+    QList<MailBoxDescriptor> namespaces;
+    qint32 count = 0;
+    stream >> count;
+    for (qint32 i = 0; i < count && stream.status() == QDataStream::Ok; ++i) {
+        MailBoxDescriptor descriptor;
+        stream >> descriptor.name >> descriptor.separator;
+        namespaces << descriptor;
+    }
+    return namespaces;
+}
+
+SessionSnapshot::SessionSnapshot()
+    : port(0),
+      namespacesKnown(false),
+      uidValidity(-1),
+      highestModSequence(0)
+{
+}
+
+bool SessionSnapshot::isNull() const
+{
+    return greeting.isEmpty();
+}
+
+QByteArray SessionSnapshot::toByteArray() const
+{
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    stream.setVersion(QDataStream::Qt_5_0);
+    stream << snapshotVersion
+           << hostName << port
+           << greeting << greetingCapabilities << capabilities << authenticatedCapabilities
+           << userName << authenticationMode
+           << namespacesKnown;
+    writeNamespaces(stream, personalNamespaces);
+    writeNamespaces(stream, userNamespaces);
+    writeNamespaces(stream, sharedNamespaces);
+    stream << selectedMailBox << uidValidity << highestModSequence;
+    return data;
+}
+
+SessionSnapshot SessionSnapshot::fromByteArray(const QByteArray &data)
+{
+    QDataStream stream(data);
+    stream.setVersion(QDataStream::Qt_5_0);
+    quint8 version = 0;
+    stream >> version;
+    if (version != snapshotVersion) {
+        return SessionSnapshot();
+    }
+
+    SessionSnapshot snapshot;
+    stream >> snapshot.hostName >> snapshot.port
+           >> snapshot.greeting >> snapshot.greetingCapabilities >> snapshot.capabilities >> snapshot.authenticatedCapabilities
+           >> snapshot.userName >> snapshot.authenticationMode
+           >> snapshot.namespacesKnown;
+    snapshot.personalNamespaces = readNamespaces(stream);
+    snapshot.userNamespaces = readNamespaces(stream);
+    snapshot.sharedNamespaces = readNamespaces(stream);
+    stream >> snapshot.selectedMailBox >> snapshot.uidValidity >> snapshot.highestModSequence;
+    if (stream.status() != QDataStream::Ok) {
+        return SessionSnapshot();
+    }
+    return snapshot;
+}
@@ -0,0 +1,99 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_SESSIONSNAPSHOT_H
+#define KIMAP2_SESSIONSNAPSHOT_H
+
+#include "kimap2_export.h"
+#include "listjob.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QList>
+#include <QtCore/QString>
+#include <QtCore/QStringList>
+
+namespace KIMAP2
+{
+
+/**
+ * What a Session learned about the server, so that the next session to it can start from there.
+ *
+ * Take it with Session::snapshot() and hand it to Session::restoreSnapshot() of a new session to the
+ * same server, with the same encryption settings. The new session trusts it once the server greeting
+ * is the same, or announces the same capabilities, and jobs then answer from it where a round trip
+ * would only tell them the same again.
+ */
+struct KIMAP2_EXPORT SessionSnapshot
+{
+    SessionSnapshot();
+
+    /**
+     * Returns true if nothing has been recorded, i.e. no greeting was received.
+     */
+    bool isNull() const;
+
+    QByteArray toByteArray() const;
+    /**
+     * Returns a null snapshot if @p data can't be read, e.g. if it was written by a newer version.
+     */
+    static SessionSnapshot fromByteArray(const QByteArray &data);
+
+    QString hostName;
+    quint16 port;
+
+    /**
+     * The server greeting, see Session::serverGreeting().
+     */
+    QByteArray greeting;
+    /**
+     * The capabilities announced in the greeting with a CAPABILITY response code, if any.
+     */
+    QStringList greetingCapabilities;
+    /**
+     * The capabilities before authentication, as they were used by the LoginJob.
+     */
+    QStringList capabilities;
+    /**
+     * The capabilities after authentication, as received by a CapabilitiesJob.
+     */
+    QStringList authenticatedCapabilities;
+
+    QString userName;
+    /**
+     * The SASL mechanism, empty for a plain LOGIN.
+     */
+    QString authenticationMode;
+
+    QList<MailBoxDescriptor> personalNamespaces;
+    QList<MailBoxDescriptor> userNamespaces;
+    QList<MailBoxDescriptor> sharedNamespaces;
+    bool namespacesKnown;
+
+    /**
+     * The mailbox that was selected last, with UIDVALIDITY and HIGHESTMODSEQ as reported by the SelectJob.
+     */
+    QString selectedMailBox;
+    qint64 uidValidity;
+    quint64 highestModSequence;
+};
+
+}
+
+#endif
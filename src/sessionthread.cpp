@@ -0,0 +1,165 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#include "sessionthread_p.h"
+
+#include "kimap_debug.h"
+
+#include "imapstreamparser.h"
+#include "message_p.h"
+#include "tlssessioncache.h"
+
+#include <QtNetwork/QSslConfiguration>
+
+using namespace KIMAP2;
+
+static const int _kimap_messagesTypeId = qRegisterMetaType<QVector<KIMAP2::Message> >();
+
+SessionThread::SessionThread(QSslSocket *socket, ImapStreamParser *stream)
+    : QObject(),
+      m_ownerThread(QThread::currentThread()),
+      m_socket(socket),
+      m_stream(stream),
+      m_lastParseTime(0)
+{
+    m_thread.setObjectName(QStringLiteral("KIMAP2::SessionThread"));
+
+    connect(m_socket, &QIODevice::readyRead, this, &SessionThread::readMessage);
+    connect(m_socket, &QSslSocket::encrypted, this, &SessionThread::exportTlsSession);
+    connect(m_socket, &QIODevice::bytesWritten, this, &SessionThread::bytesWritten);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+    //With TLS 1.3 the tickets only arrive after the handshake
+    connect(m_socket, &QSslSocket::newSessionTicketReceived, this, &SessionThread::exportTlsSession);
+#endif
+    m_stream->onResponsesReceived([this](const MessageRange &messages) {
+        //The messages share their data with the parser, but the parser
+        //only reuses what nobody else holds on to, so copies are enough.
+        QVector<Message> responses;
+        responses.reserve(messages.size());
+        for (const Message &message : messages) {
+            responses << message;
+        }
+        const qint64 parseTime = m_stream->parseTime();
+        emit responsesReceived(responses, parseTime - m_lastParseTime);
+        m_lastParseTime = parseTime;
+    });
+
+    m_socket->moveToThread(&m_thread);
+    moveToThread(&m_thread);
+    m_thread.start();
+}
+
+SessionThread::~SessionThread()
+{
+    //The socket is deleted by its owner, so give it back before the thread goes away
+    QMetaObject::invokeMethod(this, "release", Qt::BlockingQueuedConnection);
+    m_thread.quit();
+    m_thread.wait();
+}
+
+void SessionThread::connectToHost(const QString &hostName, quint16 port)
+{
+    m_socket->connectToHost(hostName, port);
+}
+
+void SessionThread::write(const QByteArray &data)
+{
+    m_socket->write(data);
+}
+
+void SessionThread::startSsl(QSsl::SslProtocol protocol, bool sessionPersistence, const QByteArray &sessionTicket)
+{
+    m_socket->setProtocol(protocol);
+    if (sessionPersistence) {
+        TlsSessionCache::prepareResumption(m_socket, sessionTicket);
+    }
+    if (m_socket->state() == QAbstractSocket::ConnectedState) {
+        qCDebug(KIMAP2_LOG) << "Starting client encryption";
+        Q_ASSERT(m_socket->mode() == QSslSocket::UnencryptedMode);
+        m_socket->startClientEncryption();
+    } else {
+        qCWarning(KIMAP2_LOG) << "The socket is not yet connected";
+    }
+}
+
+void SessionThread::ignoreSslErrors(const QList<QSslError> &errors)
+{
+    QMutexLocker locker(&m_ignoredSslErrorsMutex);
+    m_ignoredSslErrors = errors;
+}
+
+void SessionThread::applyIgnoredSslErrors()
+{
+    QMutexLocker locker(&m_ignoredSslErrorsMutex);
+    if (!m_ignoredSslErrors.isEmpty()) {
+        m_socket->ignoreSslErrors(m_ignoredSslErrors);
+    }
+}
+
+void SessionThread::startCompressionAfter(const QByteArray &tag)
+{
+    m_stream->startCompressionAfter(tag);
+}
+
+void SessionThread::enableKeepAlive()
+{
+    m_socket->setSocketOption(QAbstractSocket::KeepAliveOption, 1);
+}
+
+void SessionThread::setParseTimingEnabled(bool enabled)
+{
+    m_stream->setParseTimingEnabled(enabled);
+}
+
+void SessionThread::close()
+{
+    m_socket->close();
+}
+
+void SessionThread::abort()
+{
+    m_socket->abort();
+}
+
+void SessionThread::readMessage()
+{
+    m_stream->parseStream();
+    if (m_stream->error()) {
+        qCWarning(KIMAP2_LOG) << "Error while parsing, closing connection.";
+        qCDebug(KIMAP2_LOG) << "Current buffer: " << m_stream->currentBuffer();
+        m_socket->close();
+    }
+}
+
+void SessionThread::exportTlsSession()
+{
+    const QSslConfiguration configuration = m_socket->sslConfiguration();
+    if (!configuration.testSslOption(QSsl::SslOptionDisableSessionPersistence)) {
+        emit sessionTicketReceived(configuration.sessionTicket());
+    }
+}
+
+void SessionThread::release()
+{
+    disconnect(m_socket, Q_NULLPTR, this, Q_NULLPTR);
+    m_socket->moveToThread(m_ownerThread);
+    moveToThread(m_ownerThread);
+}
+
+#include "moc_sessionthread_p.cpp"
@@ -0,0 +1,93 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+#ifndef KIMAP2_SESSIONTHREAD_P_H
+#define KIMAP2_SESSIONTHREAD_P_H
+
+#include <QtCore/QMutex>
+#include <QtCore/QObject>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
+#include <QtNetwork/QSslSocket>
+
+namespace KIMAP2
+{
+
+struct Message;
+class ImapStreamParser;
+
+/**
+ * Reads the socket and parses the responses of a session on an internal thread.
+ *
+ * The socket and the parser still belong to SessionPrivate, but once they are handed over
+ * they may only be touched through the slots of this object, which are invoked with queued calls.
+ * Every batch of parsed responses is copied and emitted with responsesReceived().
+ */
+class SessionThread : public QObject
+{
+    Q_OBJECT
+
+public:
+    SessionThread(QSslSocket *socket, ImapStreamParser *stream);
+    ~SessionThread();
+
+    /**
+     * Ignore @p errors in the handshake.
+     *
+     * Errors can only be ignored before sslErrors() returns, which a queued call would miss,
+     * so they are stored here and handed to the socket by applyIgnoredSslErrors() on the internal thread.
+     */
+    void ignoreSslErrors(const QList<QSslError> &errors);
+
+public Q_SLOTS:
+    void connectToHost(const QString &hostName, quint16 port);
+    void write(const QByteArray &data);
+    void startSsl(QSsl::SslProtocol protocol, bool sessionPersistence, const QByteArray &sessionTicket);
+    void startCompressionAfter(const QByteArray &tag);
+    void enableKeepAlive();
+    void setParseTimingEnabled(bool enabled);
+    void close();
+    void abort();
+    //Connected directly to QSslSocket::sslErrors(), after the handler of the session
+    void applyIgnoredSslErrors();
+
+Q_SIGNALS:
+    void responsesReceived(const QVector<KIMAP2::Message> &responses, qint64 parseTime);
+    void sessionTicketReceived(const QByteArray &sessionTicket);
+    //Forwarded from the socket, for the write backpressure of SessionPrivate
+    void bytesWritten(qint64 bytes);
+
+private Q_SLOTS:
+    void readMessage();
+    void exportTlsSession();
+    void release();
+
+private:
+    QThread m_thread;
+    QThread *const m_ownerThread;
+    QSslSocket *m_socket;
+    ImapStreamParser *m_stream;
+    qint64 m_lastParseTime;
+    QMutex m_ignoredSslErrorsMutex;
+    QList<QSslError> m_ignoredSslErrors;
+};
+
+}
+
+#endif
@@ -90,7 +90,22 @@ void SetMetaDataJob::doStart()
         }
         parameters[parameters.length() - 1] = ')';
     } else {
-        if (!d->entries.isEmpty()) {
+        //Without waiting for a continuation per value all of them go out with the command
+        bool synchronizing = false;
+        for (QMap<QByteArray, QByteArray>::ConstIterator it = d->entries.constBegin(); it != d->entries.constEnd(); ++it) {
+            const int size = it.value().size();
+            if (!d->sessionInternal()->canSendNonSynchronizingLiteral(size == 0 ? 3 : size)) {
+                synchronizing = true;
+                break;
+            }
+        }
+        if (!synchronizing) {
+            for ( ; d->entriesIt != d->entries.constEnd(); ++d->entriesIt ) {
+                const QByteArray value = d->entriesIt.value().isEmpty() ? QByteArray("NIL") : d->entriesIt.value();
+                parameters += '\"' + d->entriesIt.key() + "\" {" + QByteArray::number(value.size()) + "+}\r\n" + value + ' ';
+            }
+            parameters[parameters.length() - 1] = ')';
+        } else if (!d->entries.isEmpty()) {
             parameters += '\"' + d->entriesIt.key() + "\"";
             int size = d->entriesIt.value().size();
             parameters += " {" + QByteArray::number( size==0 ? 3 : size ) + '}';
@@ -139,6 +154,10 @@ void SetMetaDataJob::handleResponse(const Message &response)
         }
         emitResult();
     } else if (d->serverCapability == Metadata && response.content[0].toString() == "+") {
+        //With non-synchronizing literals all values went out with the command already
+        if (d->entriesIt == d->entries.constEnd()) {
+            return;
+        }
         QByteArray content = "";
         if (d->entriesIt.value().isEmpty()) {
             content += "NIL";
@@ -154,7 +173,7 @@ void SetMetaDataJob::handleResponse(const Message &response)
             content += " {" + QByteArray::number( size==0 ? 3 : size ) + '}';
         }
 //      qCDebug(KIMAP2_LOG) << "SENT: " << content;
-        d->sessionInternal()->sendData(content);
+        d->sessionInternal()->sendData(this, content);
     }
 }
 
@@ -33,6 +33,7 @@ public:
     explicit StatusJobPrivate(Session *session, const QString &name)
         : JobPrivate(session, name)
     {
+        pipelineResponses << "STATUS";
     }
 
     ~StatusJobPrivate()
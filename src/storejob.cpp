@@ -30,7 +30,10 @@ namespace KIMAP2
 class StoreJobPrivate : public JobPrivate
 {
 public:
-    StoreJobPrivate(Session *session, const QString &name) : JobPrivate(session, name) { }
+    StoreJobPrivate(Session *session, const QString &name) : JobPrivate(session, name)
+    {
+        pipelineResponses << "FETCH";
+    }
     ~StoreJobPrivate() { }
 
     QByteArray addFlags(const QByteArray &param, const MessageFlags &flags)
@@ -199,24 +202,26 @@ void StoreJob::handleResponse(const Message &response)
             bool uidFound = false;
             QList<QByteArray> resultingFlags;
 
-            QList<QByteArray> content = response.content[3].toList();
+            const Message::PartRange content = response.content[3].children();
 
-            for (QList<QByteArray>::ConstIterator it = content.constBegin();
+            for (Message::PartRange::const_iterator it = content.constBegin();
                     it != content.constEnd(); ++it) {
-                QByteArray str = *it;
+                const QByteArray str = it->toString();
                 ++it;
+                if (it == content.constEnd()) {
+                    break;
+                }
 
                 if (str == "FLAGS") {
-                    if ((*it).startsWith('(') && (*it).endsWith(')')) {
-                        QByteArray str = *it;
-                        str.chop(1);
-                        str.remove(0, 1);
-                        resultingFlags = str.split(' ');
+                    if (it->type() == Message::Part::List) {
+                        foreach (const Message::Part &flag, it->children()) {
+                            resultingFlags << flag.toString();
+                        }
                     } else {
-                        resultingFlags << *it;
+                        resultingFlags << it->toString();
                     }
                 } else if (str == "UID") {
-                    uid = it->toLongLong(&uidFound);
+                    uid = it->toString().toLongLong(&uidFound);
                 }
             }
 
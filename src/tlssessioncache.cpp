@@ -0,0 +1,106 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "tlssessioncache.h"
+
+#include <QtNetwork/QSslConfiguration>
+#include <QtNetwork/QSslSocket>
+
+using namespace KIMAP2;
+
+TlsSessionCache::TlsSessionCache()
+    : m_handshakes(0),
+      m_resumptionAttempts(0)
+{
+}
+
+TlsSessionCache::~TlsSessionCache()
+{
+}
+
+QString TlsSessionCache::key(const QString &hostName, quint16 port)
+{
+    return hostName.toLower() + QLatin1Char(':') + QString::number(port);
+}
+
+QByteArray TlsSessionCache::sessionTicket(const QString &hostName, quint16 port) const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_sessionTickets.value(key(hostName, port));
+}
+
+void TlsSessionCache::insert(const QString &hostName, quint16 port, const QByteArray &sessionTicket)
+{
+    if (sessionTicket.isEmpty()) {
+        return;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_sessionTickets.insert(key(hostName, port), sessionTicket);
+}
+
+void TlsSessionCache::remove(const QString &hostName, quint16 port)
+{
+    QMutexLocker locker(&m_mutex);
+    m_sessionTickets.remove(key(hostName, port));
+}
+
+void TlsSessionCache::clear()
+{
+    QMutexLocker locker(&m_mutex);
+    m_sessionTickets.clear();
+}
+
+int TlsSessionCache::size() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_sessionTickets.size();
+}
+
+qint64 TlsSessionCache::handshakes() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_handshakes;
+}
+
+qint64 TlsSessionCache::resumptionAttempts() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_resumptionAttempts;
+}
+
+QByteArray TlsSessionCache::handshakeStarted(const QString &hostName, quint16 port)
+{
+    QMutexLocker locker(&m_mutex);
+    const QByteArray sessionTicket = m_sessionTickets.value(key(hostName, port));
+    m_handshakes++;
+    if (!sessionTicket.isEmpty()) {
+        m_resumptionAttempts++;
+    }
+    return sessionTicket;
+}
+
+void TlsSessionCache::prepareResumption(QSslSocket *socket, const QByteArray &sessionTicket)
+{
+    //Without session persistence Qt neither offers nor exports the session
+    QSslConfiguration configuration = socket->sslConfiguration();
+    configuration.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    configuration.setSessionTicket(sessionTicket);
+    socket->setSslConfiguration(configuration);
+}
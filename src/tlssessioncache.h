@@ -0,0 +1,89 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_TLSSESSIONCACHE_H
+#define KIMAP2_TLSSESSIONCACHE_H
+
+#include "kimap2_export.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QMutex>
+#include <QtCore/QString>
+
+class QSslSocket;
+
+namespace KIMAP2
+{
+
+/**
+ * Keeps the TLS sessions of the servers connected to, so reconnects can resume them.
+ *
+ * Share one cache between the sessions with Session::setTlsSessionCache(). Every session stores the
+ * session ticket it received from the server, and offers it in the next handshake to the same host and
+ * port, which the server can then complete without the key exchange. If the server doesn't accept the
+ * ticket the handshake falls back to a full one.
+ *
+ * The cache may be used by sessions in different threads.
+ */
+class KIMAP2_EXPORT TlsSessionCache
+{
+public:
+    TlsSessionCache();
+    ~TlsSessionCache();
+
+    /**
+     * Returns the session ticket stored for @p hostName and @p port, empty if there is none.
+     */
+    QByteArray sessionTicket(const QString &hostName, quint16 port) const;
+    /**
+     * Store a session ticket, e.g. one that was persisted with sessionTicket().
+     */
+    void insert(const QString &hostName, quint16 port, const QByteArray &sessionTicket);
+    void remove(const QString &hostName, quint16 port);
+    void clear();
+    int size() const;
+
+    /**
+     * Returns the number of handshakes the sessions started with the cache.
+     */
+    qint64 handshakes() const;
+    /**
+     * Returns the number of those handshakes that offered a cached session to the server.
+     */
+    qint64 resumptionAttempts() const;
+
+private:
+    friend class SessionPrivate;
+    friend class SessionThread;
+
+    QByteArray handshakeStarted(const QString &hostName, quint16 port);
+    static void prepareResumption(QSslSocket *socket, const QByteArray &sessionTicket);
+    static QString key(const QString &hostName, quint16 port);
+
+    mutable QMutex m_mutex;
+    QHash<QString, QByteArray> m_sessionTickets;
+    qint64 m_handshakes;
+    qint64 m_resumptionAttempts;
+};
+
+}
+
+#endif
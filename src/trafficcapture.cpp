@@ -0,0 +1,111 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#include "trafficcapture.h"
+
+#include "kimap_debug.h"
+
+#include <cstring>
+
+using namespace KIMAP2;
+
+static const char s_magic[] = "KIMAP2CAPTURE";
+static const quint8 s_version = 1;
+
+TrafficCapture::TrafficCapture(const QString &fileName)
+    : m_file(fileName)
+{
+    if (!m_file.open(QFile::WriteOnly | QFile::Truncate)) {
+        qCWarning(KIMAP2_LOG) << "Failed to open the capture file" << fileName;
+        return;
+    }
+    m_stream.setDevice(&m_file);
+    m_stream.writeRawData(s_magic, sizeof(s_magic));
+    m_stream << s_version;
+    m_clock.start();
+}
+
+TrafficCapture::~TrafficCapture()
+{
+    m_file.close();
+}
+
+bool TrafficCapture::isOpen() const
+{
+    return m_file.isOpen();
+}
+
+void TrafficCapture::record(Direction direction, const char *data, int size)
+{
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen()) {
+        return;
+    }
+    m_stream << quint8(direction) << qint64(m_clock.nsecsElapsed() / 1000);
+    m_stream.writeBytes(data, size);
+}
+
+void TrafficCapture::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    m_file.flush();
+}
+
+bool TrafficCapture::read(const QString &fileName, QVector<Record> &records)
+{
+    QFile file(fileName);
+    if (!file.open(QFile::ReadOnly)) {
+        return false;
+    }
+    QDataStream stream(&file);
+    char magic[sizeof(s_magic)];
+    quint8 version = 0;
+    if (stream.readRawData(magic, sizeof(magic)) != int(sizeof(magic)) || memcmp(magic, s_magic, sizeof(magic)) != 0) {
+        return false;
+    }
+    stream >> version;
+    if (version != s_version) {
+        qCWarning(KIMAP2_LOG) << "Unsupported capture version" << version;
+        return false;
+    }
+
+    while (!stream.atEnd()) {
+        quint8 direction;
+        Record record;
+        stream >> direction >> record.time >> record.data;
+        if (stream.status() != QDataStream::Ok) {
+            break;
+        }
+        record.direction = Direction(direction);
+        records << record;
+    }
+    return true;
+}
+
+QByteArray TrafficCapture::data(const QVector<Record> &records, Direction direction)
+{
+    QByteArray result;
+    for (const Record &record : records) {
+        if (record.direction == direction) {
+            result += record.data;
+        }
+    }
+    return result;
+}
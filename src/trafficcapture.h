@@ -0,0 +1,97 @@
+/*
+    Copyright (c) 2026 agent <agent@local>
+
+    This library is free software; you can redistribute it and/or modify it
+    under the terms of the GNU Library General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or (at your
+    option) any later version.
+
+    This library is distributed in the hope that it will be useful, but WITHOUT
+    ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+    FITNESS FOR A PARTICULAR PURPOSE.  See the GNU Library General Public
+    License for more details.
+
+    You should have received a copy of the GNU Library General Public License
+    along with this library; see the file COPYING.LIB.  If not, write to the
+    Free Software Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+    02110-1301, USA.
+*/
+
+
+#ifndef KIMAP2_TRAFFICCAPTURE_H
+#define KIMAP2_TRAFFICCAPTURE_H
+
+#include "kimap2_export.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QDataStream>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+
+namespace KIMAP2
+{
+
+/**
+  The raw traffic of a session, as written to and read from the socket, with timestamps.
+
+  A capture file starts with a header, followed by one record per read or write:
+  the direction, the microseconds since the capture started and the data, all written
+  with QDataStream. Writing goes through the buffer of the file, it is only flushed with
+  flush() or when the capture is destroyed.
+
+  Records may be added from several threads.
+
+  Sessions capture their traffic if KIMAP2_CAPTURE is set, into a file named
+  after it, followed by the process id and the number of the session. FakeServer
+  can play a capture back, and the benchmark can parse it with KIMAP2_REPLAY.
+*/
+class KIMAP2_EXPORT TrafficCapture
+{
+public:
+    enum Direction {
+        Sent = 'C',
+        Received = 'S'
+    };
+
+    struct Record {
+        Direction direction;
+        qint64 time;
+        QByteArray data;
+    };
+
+    /**
+     * Starts a capture into @p fileName, replacing the file if it exists.
+     */
+    explicit TrafficCapture(const QString &fileName);
+    ~TrafficCapture();
+
+    bool isOpen() const;
+
+    void record(Direction direction, const char *data, int size);
+    void flush();
+
+    /**
+     * Reads all records of the capture in @p fileName.
+     *
+     * Returns false if the file is not a capture. A capture that has been cut short is read up to the last complete record.
+     */
+    static bool read(const QString &fileName, QVector<Record> &records);
+
+    /**
+     * Returns the data of all records in @p direction, in one piece.
+     */
+    static QByteArray data(const QVector<Record> &records, Direction direction);
+
+private:
+    Q_DISABLE_COPY(TrafficCapture)
+    QMutex m_mutex;
+    QFile m_file;
+    QDataStream m_stream;
+    QElapsedTimer m_clock;
+};
+
+}
+
+#endif
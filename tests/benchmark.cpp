@@ -20,10 +20,39 @@
 #include "kimap2test/fakeserver.h"
 #include "kimap2/session.h"
 #include "kimap2/fetchjob.h"
+#include "kimap2/loginjob.h"
+#include "kimap2/tlssessioncache.h"
 #include "imapstreamparser.h"
+#include "trafficcapture.h"
+#include "delimiterscanner_p.h"
 
 #include <QtTest>
 
+#if defined(__GLIBC__)
+// Count heap allocations by interposing the allocation functions QByteArray and the Qt containers end up in.
+// The session runs its socket on another thread, so the count is atomic.
+static QAtomicInteger<qint64> s_allocationCount;
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *malloc(size_t size)
+{
+    s_allocationCount.fetchAndAddRelaxed(1);
+    return __libc_malloc(size);
+}
+extern "C" void *realloc(void *ptr, size_t size)
+{
+    s_allocationCount.fetchAndAddRelaxed(1);
+    return __libc_realloc(ptr, size);
+}
+extern "C" void *calloc(size_t count, size_t size)
+{
+    s_allocationCount.fetchAndAddRelaxed(1);
+    return __libc_calloc(count, size);
+}
+#define KIMAP2_COUNT_ALLOCATIONS 1
+#endif
+
 Q_DECLARE_METATYPE(KIMAP2::FetchJob::FetchScope)
 
 using namespace KIMAP2;
@@ -66,8 +95,26 @@ public Q_SLOTS:
 
 private Q_SLOTS:
 
+    void testFetchParseOnly_data()
+    {
+        QTest::addColumn<int>("implementation");
+        QTest::addColumn<bool>("staticDispatch");
+        QTest::newRow("scalar") << int(DelimiterScanner::Scalar) << true;
+        QTest::newRow("sse2") << int(DelimiterScanner::Sse2) << true;
+        QTest::newRow("avx2") << int(DelimiterScanner::Avx2) << true;
+        QTest::newRow("scalar, dynamic dispatch") << int(DelimiterScanner::Scalar) << false;
+        QTest::newRow("sse2, dynamic dispatch") << int(DelimiterScanner::Sse2) << false;
+        QTest::newRow("avx2, dynamic dispatch") << int(DelimiterScanner::Avx2) << false;
+    }
+
     void testFetchParseOnly()
     {
+        QFETCH(int, implementation);
+        QFETCH(bool, staticDispatch);
+        const auto defaultImplementation = DelimiterScanner::implementation();
+        if (!DelimiterScanner::setImplementation(DelimiterScanner::Implementation(implementation))) {
+            QSKIP("Not supported by this CPU");
+        }
         int count = 5000;
         int parsedBytes = 0;
         QByteArray data;
@@ -80,12 +127,12 @@ private Q_SLOTS:
         QBuffer buffer(&data);
         buffer.open(QIODevice::ReadOnly);
         KIMAP2::ImapStreamParser parser(&buffer);
+        parser.setStaticDispatchEnabled(staticDispatch);
         int resultCount = 0;
         parser.onResponseReceived([&resultCount](const KIMAP2::Message &) {
             resultCount++;
         });
 
-
         QTime time;
         time.start();
 
@@ -96,6 +143,117 @@ private Q_SLOTS:
         qWarning() << "Reading " << count << " messages took: " << time.elapsed() << " ms.";
         qWarning() << parsedBytes << " bytes expected to be parsed";
         qWarning() << "Received " << resultCount << " results";
+        DelimiterScanner::setImplementation(defaultImplementation);
+    }
+
+    /**
+     * Parses the responses of a capture recorded with KIMAP2_CAPTURE, e.g. from a production session.
+     *
+     * KIMAP2_REPLAY=<capture file> ./benchmark testReplayParseOnly
+     */
+    void testReplayParseOnly()
+    {
+        const QString fileName = QFile::decodeName(qgetenv("KIMAP2_REPLAY"));
+        if (fileName.isEmpty()) {
+            QSKIP("Set KIMAP2_REPLAY to a capture file");
+        }
+        QVector<KIMAP2::TrafficCapture::Record> records;
+        QVERIFY(KIMAP2::TrafficCapture::read(fileName, records));
+        QByteArray data = KIMAP2::TrafficCapture::data(records, KIMAP2::TrafficCapture::Received);
+        // The parser needs to know where the responses become compressed, like in a session
+        QByteArray compressTag;
+        foreach (const QByteArray &command, KIMAP2::TrafficCapture::data(records, KIMAP2::TrafficCapture::Sent).split('\n')) {
+            const QList<QByteArray> words = command.trimmed().split(' ');
+            if (words.size() >= 2 && words.at(1).toUpper() == "COMPRESS") {
+                compressTag = words.at(0);
+                break;
+            }
+        }
+
+        int resultCount = 0;
+        QBENCHMARK {
+            QBuffer buffer(&data);
+            buffer.open(QIODevice::ReadOnly);
+            KIMAP2::ImapStreamParser parser(&buffer);
+            parser.setZeroCopyEnabled(true);
+            if (!compressTag.isEmpty()) {
+                parser.startCompressionAfter(compressTag);
+            }
+            resultCount = 0;
+            parser.onResponsesReceived([&resultCount](const KIMAP2::MessageRange &responses) {
+                resultCount += responses.size();
+            });
+            while (buffer.bytesAvailable() && !parser.error()) {
+                parser.parseStream();
+            }
+            QVERIFY(!parser.error());
+        }
+        qWarning() << "Parsed" << resultCount << "responses," << data.size() << "bytes";
+    }
+
+    void testFetchFlagsParseOnlyAllocations_data()
+    {
+        QTest::addColumn<bool>("zeroCopy");
+        QTest::addColumn<bool>("events");
+        QTest::newRow("copy") << false << false;
+        QTest::newRow("zero-copy") << true << false;
+        QTest::newRow("events") << false << true;
+    }
+
+    void testFetchFlagsParseOnlyAllocations()
+    {
+        QFETCH(bool, zeroCopy);
+        QFETCH(bool, events);
+        int count = 50000;
+        QByteArray data;
+        for (int i = 1; i <= count; i++) {
+            data += QString("* %1 FETCH (FLAGS (\\Seen) UID %2)\r\n").arg(i).arg(i).toLatin1();
+        };
+        data += "A000001 OK fetch done\r\n";
+
+        QBuffer buffer(&data);
+        buffer.open(QIODevice::ReadOnly);
+        KIMAP2::ImapStreamParser parser(&buffer);
+        parser.setZeroCopyEnabled(zeroCopy);
+        int resultCount = 0;
+        qint64 uidSum = 0;
+        bool nextIsUid = false;
+        if (events) {
+            //Pick the UIDs straight from the token events, like a flag sync would
+            parser.onString([&](const char *token, int size) {
+                if (nextIsUid) {
+                    uidSum += QByteArray::fromRawData(token, size).toLongLong();
+                }
+                nextIsUid = (size == 3 && !qstrncmp(token, "UID", 3));
+            });
+            parser.onLineEnd([&resultCount]() {
+                resultCount++;
+            });
+        } else {
+            parser.onResponseReceived([&resultCount](const KIMAP2::Message &) {
+                resultCount++;
+            });
+        }
+
+#ifdef KIMAP2_COUNT_ALLOCATIONS
+        const qint64 allocationsBefore = s_allocationCount.load();
+#endif
+        QTime time;
+        time.start();
+
+        while (parser.availableDataSize()) {
+            parser.parseStream();
+        }
+
+        qWarning() << "Reading " << count << " flag responses took: " << time.elapsed() << " ms.";
+#ifdef KIMAP2_COUNT_ALLOCATIONS
+        const qint64 allocations = s_allocationCount.load() - allocationsBefore;
+        qWarning() << "Allocations: " << allocations << ", per response: " << double(allocations) / resultCount;
+#endif
+        QCOMPARE(resultCount, count + 1);
+        if (events) {
+            QCOMPARE(uidSum, qint64(count) * (count + 1) / 2);
+        }
     }
 
     void testFetchParts()
@@ -217,6 +375,58 @@ private Q_SLOTS:
         m_attrs.clear();
     }
 
+    void testTlsReconnect_data()
+    {
+        QTest::addColumn<bool>("resume");
+        QTest::newRow("full handshake") << false;
+        QTest::newRow("resumed") << true;
+    }
+
+    void testTlsReconnect()
+    {
+        QFETCH(bool, resume);
+        const int count = 50;
+
+        FakeServer fakeServer;
+        fakeServer.setEncrypted(QSsl::TlsV1_2);
+        for (int i = 0; i < count; i++) {
+            fakeServer.addScenario(QList<QByteArray>()
+                                   << FakeServer::greeting()
+                                   << "C: A000001 CAPABILITY"
+                                   << "S: A000001 OK"
+                                   << "C: A000002 LOGIN \"user\" \"password\""
+                                   << "S: A000002 OK");
+        }
+        fakeServer.startAndWait();
+
+        QSharedPointer<KIMAP2::TlsSessionCache> cache(new KIMAP2::TlsSessionCache);
+
+        QTime time;
+        time.start();
+        for (int i = 0; i < count; i++) {
+            KIMAP2::Session session(QStringLiteral("127.0.0.1"), 5989);
+            if (resume) {
+                session.setTlsSessionCache(cache);
+            }
+            QObject::connect(&session, &KIMAP2::Session::sslErrors, [&session](const QList<QSslError> &errors) {
+                session.ignoreErrors(errors);
+            });
+            KIMAP2::LoginJob *login = new KIMAP2::LoginJob(&session);
+            login->setUserName(QStringLiteral("user"));
+            login->setPassword(QStringLiteral("password"));
+            login->setEncryptionMode(QSsl::TlsV1_2, false);
+            QVERIFY(login->exec());
+        }
+
+        qWarning() << count << "TLS connections took:" << time.elapsed() << "ms, offered a cached session"
+                   << cache->resumptionAttempts() << "times";
+        if (resume) {
+            QCOMPARE(cache->resumptionAttempts(), qint64(count - 1));
+        }
+
+        fakeServer.quit();
+    }
+
 };
 
 QTEST_GUILESS_MAIN(Benchmark)